@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "arena.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    void *
+    query_arena::overflow_resource::do_allocate(size_t bytes_, size_t alignment) {
+        bytes += bytes_;
+        return pmr::new_delete_resource()->allocate(bytes_, alignment);
+    }
+
+    void
+    query_arena::overflow_resource::do_deallocate(void * p, size_t bytes_, size_t alignment) {
+        pmr::new_delete_resource()->deallocate(p, bytes_, alignment);
+    }
+
+    bool
+    query_arena::overflow_resource::do_is_equal(const pmr::memory_resource & other) const noexcept {
+        return this == &other;
+    }
+
+    query_arena::query_arena(size_t capacity_) : capacity(capacity_),
+    buffer(new char[capacity_]), depth(0) {
+        resource.emplace(buffer.get(), capacity, &overflow);
+    }
+
+    pmr::memory_resource *
+    query_arena::get() {
+        return &*resource;
+    }
+
+    size_t
+    query_arena::get_capacity() const {
+        return capacity;
+    }
+
+    void
+    query_arena::reset() {
+        if (overflow.bytes == 0) {
+            resource->release();
+            return;
+        }
+        // Twice what the last query needed, so that growing is rare.
+        capacity = 2 * (capacity + overflow.bytes);
+        overflow.bytes = 0;
+        resource.reset();
+        buffer.reset(new char[capacity]);
+        resource.emplace(buffer.get(), capacity, &overflow);
+    }
+
+    query_arena &
+    query_arena::local() {
+        static thread_local query_arena arena;
+        return arena;
+    }
+
+    arena_scope::arena_scope() : arena(query_arena::local()) {
+        ++arena.depth;
+    }
+
+    pmr::memory_resource *
+    arena_scope::get() const {
+        return arena.get();
+    }
+
+    arena_scope::~arena_scope() {
+        if (--arena.depth == 0)
+            arena.reset();
+    }
+}
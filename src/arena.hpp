@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   arena.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 6:20 PM
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace magicSearchEngine {
+
+    /*
+     * Memory of temporaries of queries on one thread. Everything is taken
+     * from a monotonic buffer and freed at once when the outermost
+     * arena_scope ends. A query that did not fit into the buffer makes it
+     * bigger afterwards, so that queries in steady state do not call the
+     * global allocator at all.
+     */
+    class query_arena {
+    private:
+        /*
+         * Upstream of the monotonic resource, it is used only when the
+         * buffer is exhausted and records how much was missing.
+         */
+        class overflow_resource : public std::pmr::memory_resource {
+        public:
+            size_t bytes = 0;
+
+        private:
+            void *
+            do_allocate(size_t bytes_, size_t alignment) override;
+
+            void
+            do_deallocate(void * p, size_t bytes_, size_t alignment) override;
+
+            bool
+            do_is_equal(const std::pmr::memory_resource & other) const noexcept override;
+        } ;
+
+        size_t capacity;
+        std::unique_ptr<char[] > buffer;
+        overflow_resource overflow;
+        std::optional<std::pmr::monotonic_buffer_resource> resource;
+        size_t depth;
+
+        friend class arena_scope;
+
+        void
+        reset();
+
+    public:
+        explicit
+        query_arena(size_t capacity_ = 256 * 1024);
+
+        query_arena(const query_arena &) = delete;
+
+        query_arena &
+        operator=(const query_arena &) = delete;
+
+        std::pmr::memory_resource *
+        get();
+
+        size_t
+        get_capacity() const;
+
+        // Arena of the calling thread.
+        static query_arena &
+        local();
+    } ;
+
+    /*
+     * One query on the arena of the calling thread. Scopes nest, only the
+     * outermost one frees the memory, so a caller can keep results of
+     * a query allocated from get() until its own scope ends.
+     */
+    class arena_scope {
+    private:
+        query_arena & arena;
+
+    public:
+        arena_scope();
+
+        arena_scope(const arena_scope &) = delete;
+
+        arena_scope &
+        operator=(const arena_scope &) = delete;
+
+        std::pmr::memory_resource *
+        get() const;
+
+        ~arena_scope();
+    } ;
+}
+
+#endif /* ARENA_HPP */
@@ -0,0 +1,414 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Micro- and macrobenchmarks of loading and searching. The JSON report is
+ * meant to be stored for each version, so that regressions can be found.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "database.hpp"
+#include "searching.hpp"
+#include "card.hpp"
+#include "card_reader.hpp"
+#include "json_index.hpp"
+#include "mapped_file.hpp"
+#include "zip_input.hpp"
+#include "profiling.hpp"
+#include "src/json.hpp"
+#include "../docopt.cpp/docopt.h"
+
+using namespace magicSearchEngine;
+using namespace std;
+using json = nlohmann::json;
+
+static const char USAGE[] =
+        R"(Benchmarks of Magic Search Engine.
+
+    Usage:
+      benchmarks [--min-time=<s>] [--repeat=<n>] [--per-type=<n>] [--label=<l>] [--check-parser]
+      benchmarks (-h | --help)
+
+    Options:
+      --min-time=<s>    Minimal duration of each microbenchmark in seconds [default: 0.5].
+      --repeat=<n>      Repetitions of cold start macrobenchmarks [default: 3].
+      --per-type=<n>    Base cards of each type for find_similar [default: 50].
+      --label=<l>       Label of the run (e.g. version) stored in the report.
+      --check-parser    Fail if card_reader (with SIMD or scalar index) reads
+                        other cards than the nlohmann parser.
+      -h --help         Show this screen.
+
+    Run from the directory containing src/AllCards.json. The report is
+    written to the standard output, progress to the standard error.
+)";
+
+// Results of benchmarked calls are added here, so they are not optimized out.
+static volatile size_t sink;
+
+static double
+seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Calls f(i) for i = 0, 1, ... at least for min_time seconds and reports
+ * the mean time of one call. The number of calls is found by running
+ * ten times more of them until it takes a tenth of min_time.
+ */
+template<typename Function>
+static json
+measure(const string & name, double min_time, Function && f) {
+    cerr << "bench: " << name << endl;
+    size_t iterations = 1;
+    while (true) {
+        size_t result = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            result += f(i);
+        double elapsed = seconds_since(start);
+        sink = sink + result;
+        if (elapsed >= min_time) {
+            return {
+                {"ns_per_op", elapsed * 1e9 / static_cast<double> (iterations)},
+                {"iterations", iterations}
+            };
+        }
+        if (elapsed < min_time / 10)
+            iterations *= 10;
+        else
+            iterations = static_cast<size_t> (ceil(static_cast<double> (iterations) * min_time / elapsed));
+    }
+}
+
+// Text of the catalog at path, inflated if it is a zip archive.
+static string
+catalog_text(const string & path) {
+    if (zip_input::is_zip(path)) {
+        zip_input zip(path);
+        size_t size = zip.view().size();
+        for (size_t ready = 0; ready < size;)
+            ready = zip.wait_beyond(ready);
+        return string(zip.view());
+    }
+    mapped_file input(path);
+    return string(input.view());
+}
+
+static json
+summary(vector<double> & values) {
+    sort(begin(values), end(values));
+    auto && percentile = [&values](double p) {
+        return values.empty() ? 0 : values[static_cast<size_t> (p * static_cast<double> (values.size() - 1))];
+    };
+    double mean = values.empty() ? 0 :
+            accumulate(begin(values), end(values), 0.0) / static_cast<double> (values.size());
+    return {
+        {"mean", mean},
+        {"p50", percentile(0.5)},
+        {"p99", percentile(0.99)},
+        {"count", values.size()}
+    };
+}
+
+static json
+micro_benchmarks(const JSONDatabase & database, search_engine & oraculum, double min_time) {
+    const vector<Card> & cards = database.get_cards();
+    mt19937 rng(1);
+    uniform_int_distribution<size_t> any_card(0, cards.size() - 1);
+    const size_t samples = 1024;
+    vector<const Card *> random_cards;
+    for (size_t i = 0; i < samples; ++i)
+        random_cards.push_back(&(cards[any_card(rng)]));
+    json res;
+
+    // Records of the catalog are parsed again, Card is built from them.
+    vector<json> records;
+    string catalog = catalog_text(database.get_path());
+    {
+        json data = json::parse(catalog);
+        for (auto && record : data) {
+            records.push_back(record);
+            if (records.size() == samples)
+                break;
+        }
+    }
+    // Records repeat, so their interned strings do not grow the pool.
+    string_pool strings;
+    res["card_construction"] = measure("Card construction", min_time, [&](size_t i) {
+        Card card(records[i % records.size()], strings);
+        return card.get_name().size();
+    });
+
+    vector<string> mana_costs;
+    for (auto && record : records) {
+        if (record.find("manaCost") != record.end())
+            mana_costs.push_back(record["manaCost"]);
+    }
+    // Throughput of parsing the whole catalog, in GB/s.
+    string_view input = catalog;
+    double bytes = static_cast<double> (input.size());
+    for (scan_mode mode : {scan_mode::simd, scan_mode::scalar}) {
+        string name = mode == scan_mode::simd ? "structural_index" : "structural_index_scalar";
+        vector<uint32_t> positions;
+        res[name] = measure(name, min_time, [&](size_t) {
+            positions.clear();
+            structural_index(input, positions, mode);
+            return positions.size();
+        });
+        res[name]["gb_per_s"] = bytes / res[name]["ns_per_op"].get<double>();
+    }
+    res["card_reader"] = measure("card_reader", min_time, [&](size_t) {
+        card_reader reader(input);
+        card_record record;
+        string_view key;
+        size_t read = 0;
+        while (reader.next(key, record))
+            ++read;
+        return read;
+    });
+    res["card_reader"]["gb_per_s"] = bytes / res["card_reader"]["ns_per_op"].get<double>();
+    if (string(simd_name()) != "none")
+        res["structural_index"]["simd"] = simd_name();
+
+    res["get_mana_symbol"] = measure("get_mana_symbol", min_time, [&](size_t i) {
+        string cost = mana_costs[i % mana_costs.size()];
+        size_t symbols = 0;
+        while (Card::get_mana_symbol(cost).size() != 0)
+            ++symbols;
+        return symbols;
+    });
+
+    res["tokenize"] = measure("create_index tokenizer", min_time, [&](size_t i) {
+        return oraculum.tokenize(random_cards[i % samples]->get_text()).size();
+    });
+
+    res["search_for"] = measure("search_for", min_time, [&](size_t i) {
+        return oraculum.search_for(random_cards[i % samples]->get_name()) != nullptr;
+    });
+
+    vector<string> types;
+    for (size_t id = 0; id < database.get_types().size(); ++id)
+        types.push_back(database.get_types()[symbol_id(id)].name);
+    res["get_type"] = measure("get_type", min_time, [&](size_t i) {
+        return oraculum.get_type(types[i % types.size()]).size();
+    });
+
+    res["get_distance"] = measure("get_distance", min_time, [&](size_t i) {
+        return oraculum.get_distance(random_cards[i % samples], random_cards[(i * 7 + 1) % samples]);
+    });
+
+    res["full_text"] = measure("full_text", min_time, [&](size_t i) {
+        return oraculum.full_text(random_cards[i % samples], random_cards[(i * 7 + 1) % samples]);
+    });
+    return res;
+}
+
+/*
+ * Conformance of card_reader: cards it reads (with either index) must be
+ * the same as those built from the DOM of the nlohmann parser, and both
+ * indexes must be the same.
+ */
+static json
+parser_conformance(const string & path) {
+    cerr << "bench: parser conformance" << endl;
+    string input = catalog_text(path);
+    vector<uint32_t> simd_positions, scalar_positions;
+    structural_index(input, simd_positions, scan_mode::simd);
+    structural_index(input, scalar_positions, scan_mode::scalar);
+
+    string_pool strings;
+    json data = json::parse(input);
+    json res = {
+        {"cards", data.size()},
+        {"same_index", simd_positions == scalar_positions},
+        {"mismatches", 0}
+    };
+    for (scan_mode mode : {scan_mode::simd, scan_mode::scalar}) {
+        map<string, Card> read;
+        card_reader reader(input, mode);
+        card_record record;
+        string_view key;
+        while (reader.next(key, record))
+            read.insert_or_assign(string(key), Card(record, strings));
+        size_t mismatches = (read.size() == data.size()) ? 0 : 1;
+        auto it = read.begin();
+        for (auto && entry : data.items()) {
+            if (it == read.end())
+                break;
+            if (it->first != entry.key() || !same_values(it->second, Card(entry.value(), strings))) {
+                if (mismatches == 0)
+                    res["first_mismatch"] = entry.key();
+                ++mismatches;
+            }
+            ++it;
+        }
+        res["mismatches"] = res["mismatches"].get<size_t>() + mismatches;
+    }
+    return res;
+}
+
+/*
+ * Cold start is loading of the database and creating of the index by fresh
+ * objects, time to first query adds one find_similar, as main() does when
+ * run with "similar". Texts are tokenized while loading, as there, or by
+ * the query for a lazy index.
+ */
+static json
+cold_start(size_t repeat, index_mode indexing = index_mode::eager) {
+    vector<double> load_s, index_s, first_query_s;
+    for (size_t r = 0; r < repeat; ++r) {
+        cerr << "bench: cold start" << (indexing == index_mode::lazy ? " lazy " : " ") << r + 1 << "/" << repeat << endl;
+        auto start = chrono::steady_clock::now();
+        JSONDatabase database;
+        search_engine oraculum(database);
+        oraculum.set_index_mode(indexing);
+        thread data_loading([&]() {
+            oraculum.index_while_loading(database);
+            database.load_database();
+            load_s.push_back(seconds_since(start));
+            oraculum.create_index();
+        });
+        data_loading.join();
+        double indexed = seconds_since(start);
+        index_s.push_back(indexed - load_s.back());
+        const vector<Card> & cards = database.get_cards();
+        sink = sink + oraculum.find_similar(cards[cards.size() / 2].get_name(), 3).size();
+        first_query_s.push_back(seconds_since(start));
+    }
+    return {
+        {"load_database_s", summary(load_s)},
+        {"create_index_s", summary(index_s)},
+        {"time_to_first_query_s", summary(first_query_s)}
+    };
+}
+
+static json
+similar_by_type(const JSONDatabase & database, search_engine & oraculum, size_t per_type) {
+    const vector<Card> & cards = database.get_cards();
+    json res;
+    const symbol_table & types = database.get_types();
+    for (size_t id = 0; id < types.size(); ++id) {
+        const string & type = types[symbol_id(id)].name;
+        card_list with_type = oraculum.get_type(type);
+        if (with_type.empty())
+            continue;
+        cerr << "bench: find_similar " << type << endl;
+        shuffle(begin(with_type), end(with_type), mt19937(1));
+        with_type.resize(min(per_type, with_type.size()));
+        vector<double> latencies_us;
+        for (const Card * card : with_type) {
+            auto start = chrono::steady_clock::now();
+            arena_scope scope;
+            sink = sink + oraculum.find_similar(card->get_name(), 3, scope.get()).size();
+            latencies_us.push_back(seconds_since(start) * 1e6);
+        }
+        res[type] = summary(latencies_us);
+        res[type]["cards_of_type"] = oraculum.get_type(type).size();
+    }
+    res["catalog_size"] = cards.size();
+    return res;
+}
+
+/*
+ * Calls of the global allocator by find_similar once the query arena has
+ * grown, i.e. after the same queries were run once, should be zero.
+ */
+static json
+steady_state_allocations(const JSONDatabase & database, search_engine & oraculum, size_t per_type) {
+    vector<const Card *> bases;
+    const symbol_table & types = database.get_types();
+    for (size_t id = 0; id < types.size(); ++id) {
+        card_list with_type = oraculum.get_type(types[symbol_id(id)].name);
+        with_type.resize(min(per_type, with_type.size()));
+        bases.insert(end(bases), begin(with_type), end(with_type));
+    }
+    auto run = [&]() {
+        for (const Card * card : bases) {
+            arena_scope scope;
+            sink = sink + oraculum.find_similar(card->get_name(), 3, scope.get()).size();
+        }
+    };
+    run();
+    size_t before = allocation_count();
+    run();
+    size_t allocations = allocation_count() - before;
+    json res;
+    res["queries"] = bases.size();
+    res["allocations"] = allocations;
+    res["arena_bytes"] = query_arena::local().get_capacity();
+    return res;
+}
+
+int
+main(int argc, char * argv[]) {
+    map<string, docopt::value> args = docopt::docopt(USAGE,{argv + 1, argv + argc}, true);
+    double min_time;
+    size_t repeat, per_type;
+    try {
+        min_time = args["--min-time"] ? stod(args["--min-time"].asString()) : 0.5;
+        repeat = args["--repeat"] ? stoul(args["--repeat"].asString()) : 3;
+        per_type = args["--per-type"] ? stoul(args["--per-type"].asString()) : 50;
+    }
+    catch (...) {
+        cout << USAGE << endl;
+        return 1;
+    }
+
+    json report;
+    report["label"] = args["--label"] ? args["--label"].asString() : "";
+    if (args["--check-parser"].asBool()) {
+        report["parser_conformance"] = parser_conformance(JSONDatabase().get_path());
+        if (report["parser_conformance"]["mismatches"] != 0 ||
+                !report["parser_conformance"]["same_index"].get<bool>()) {
+            cout << report.dump(2) << endl;
+            cerr << "bench: card_reader and nlohmann parser read other cards." << endl;
+            return 3;
+        }
+    }
+    report["macro"]["cold_start"] = cold_start(repeat);
+    report["macro"]["cold_start_lazy"] = cold_start(repeat, index_mode::lazy);
+
+    JSONDatabase database;
+    search_engine oraculum(database);
+    database.load_database();
+    oraculum.create_index();
+    report["cards"] = database.get_cards().size();
+    report["micro"] = micro_benchmarks(database, oraculum, min_time);
+    report["macro"]["find_similar_by_type_us"] = similar_by_type(database, oraculum, per_type);
+    report["macro"]["steady_state_allocations"] = steady_state_allocations(database, oraculum, per_type);
+
+    cout << report.dump(2) << endl;
+    return 0;
+}
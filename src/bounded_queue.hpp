@@ -0,0 +1,172 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   bounded_queue.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 11:20 PM
+ */
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace magicSearchEngine {
+
+    /*
+     * Lock free queue of a fixed capacity for any number of producers and
+     * consumers (Vyukov's bounded MPMC queue): each cell has a sequence
+     * number telling whether it waits for a value of the current lap or for
+     * its consumer. A full queue makes producers wait, which bounds memory
+     * taken by stages of a pipeline running at different speeds.
+     *
+     * Waiting spins with yields, then sleeps, so values should be large
+     * pieces of work (e.g. batches), not single items.
+     */
+    template<typename T>
+    class bounded_queue {
+    private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T value;
+        } ;
+
+        std::unique_ptr<cell[] > cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> head; // Next position to push to.
+        alignas(64) std::atomic<size_t> tail; // Next position to pop from.
+        std::atomic<bool> closed;
+
+        static void
+        wait(size_t & round) {
+            if (++round < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+    public:
+        // Capacity is rounded up to a power of two.
+        explicit
+        bounded_queue(size_t capacity) : mask(1), head(0), tail(0), closed(false) {
+            while (mask < capacity)
+                mask <<= 1;
+            cells.reset(new cell[mask]);
+            for (size_t i = 0; i < mask; ++i)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            --mask;
+        }
+
+        bounded_queue(const bounded_queue &) = delete;
+
+        bounded_queue &
+        operator=(const bounded_queue &) = delete;
+
+        // Moves value into the queue unless it is full.
+        bool
+        try_push(T & value) {
+            size_t pos = head.load(std::memory_order_relaxed);
+            while (true) {
+                cell & c = cells[pos & mask];
+                size_t sequence = c.sequence.load(std::memory_order_acquire);
+                if (sequence == pos) {
+                    if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        c.value = std::move(value);
+                        c.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (sequence < pos) {
+                    return false;
+                }
+                else {
+                    pos = head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Moves the oldest value out of the queue unless it is empty.
+        bool
+        try_pop(T & value) {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            while (true) {
+                cell & c = cells[pos & mask];
+                size_t sequence = c.sequence.load(std::memory_order_acquire);
+                if (sequence == pos + 1) {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        value = std::move(c.value);
+                        c.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (sequence < pos + 1) {
+                    return false;
+                }
+                else {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Waits while the queue is full.
+        void
+        push(T value) {
+            size_t round = 0;
+            while (!try_push(value))
+                wait(round);
+        }
+
+        /*
+         * Waits for a value, false once the queue is closed and there are
+         * no more values.
+         */
+        bool
+        pop(T & value) {
+            size_t round = 0;
+            while (!try_pop(value)) {
+                if (closed.load(std::memory_order_acquire)) {
+                    // Values pushed before closing are still taken.
+                    return try_pop(value);
+                }
+                wait(round);
+            }
+            return true;
+        }
+
+        // No more values will be pushed.
+        void
+        close() {
+            closed.store(true, std::memory_order_release);
+        }
+    } ;
+}
+
+#endif /* BOUNDED_QUEUE_HPP */
@@ -29,27 +29,64 @@
 #include <algorithm>
 #include <limits.h>
 #include "src/card.hpp"
-#include "src/database.hpp"
+#include "src/memstats.hpp"
+#include "src/tracing.hpp"
 
 using namespace std;
 
 namespace magicSearchEngine {
 
-    Card::Card(const card_t & card, const Database * dat) : db(dat) {
-        set_name(card);
-        set_text(card);
-        set_power(card);
-        set_toughness(card);
-        set_loyalty(card);
-        set_hand(card);
-        set_life(card);
-        set_layout(card);
-        set_names(card);
-        set_manaCost(card);
-        set_colors(card);
-        set_supertypes(card);
-        set_types(card);
-        set_subtypes(card);
+    Card::Card(const card_t & card, string_pool & strings) :
+    Card(card_record::from_json(card), strings) {
+    }
+
+    Card::Card() : loyalty(INT_MIN), hand(INT_MIN), life(INT_MIN), layout(symbol_table::none) {
+    }
+
+    // Defined here, so that cards are not inlined wherever they are copied or destroyed.
+    Card::Card(const Card &) = default;
+
+    Card::Card(Card &&) noexcept = default;
+
+    Card::~Card() {
+    }
+
+    Card &
+    Card::operator=(const Card &) = default;
+
+    Card &
+    Card::operator=(Card &&) noexcept = default;
+
+    Card::Card(const card_record & card, string_pool & strings) {
+        {
+            TRACE_SPAN("Card text");
+            set_name(card, strings);
+            set_text(card, strings);
+        }
+        {
+            TRACE_SPAN("Card numbers");
+            set_power(card);
+            set_toughness(card);
+            set_loyalty(card);
+            set_hand(card);
+            set_life(card);
+        }
+        {
+            TRACE_SPAN("Card layout");
+            set_layout(card);
+            set_names(card, strings);
+        }
+        {
+            TRACE_SPAN("Card mana");
+            set_manaCost(card);
+            set_colors(card);
+        }
+        {
+            TRACE_SPAN("Card types");
+            set_supertypes(card);
+            set_types(card);
+            set_subtypes(card);
+        }
     }
 
     /*
@@ -95,120 +132,212 @@ namespace magicSearchEngine {
         return os;
     }
 
+    // Inverse of parse_feature.
+    static std::string
+    feature_text(const feature & f) {
+        std::string res;
+        if (f.whole_part != INT_MIN)
+            res = std::to_string(f.whole_part);
+        else if (f.asterics)
+            res = "*";
+        if (f.half)
+            res += ".5";
+        if (f.whole_part != INT_MIN && f.asterics)
+            res += "+*";
+        return res;
+    }
+
+    void
+    Card::write_record(std::ostream & os) const {
+        nlohmann::json record = nlohmann::json::object();
+        auto && list_field = [&record](const char * field, const auto & values) {
+            if (values.size() == 0)
+                return;
+            nlohmann::json list = nlohmann::json::array();
+            for (auto && value : values)
+                list.push_back(std::string(value));
+            record[field] = std::move(list);
+        };
+        // Keys of symbols, names are only for printing.
+        auto && symbols = [](const symbol_list & values, const symbol_table & table) {
+            std::vector<std::string> res;
+            for (size_t i = 0; i < values.size(); ++i)
+                res.push_back(table[values.ids()[i]].key);
+            return res;
+        };
+        const vocabulary & words = vocabulary::instance();
+        record["name"] = std::string(name);
+        if (!text.empty())
+            record["text"] = std::string(text);
+        if (!words.layout[layout].key.empty())
+            record["layout"] = words.layout[layout].key;
+        if (manaCost.size() != 0) {
+            std::string cost;
+            for (const manaCnt & m : manaCost) {
+                for (short i = 0; i < m.count; ++i)
+                    cost += "{" + words.mana[m.color].key + "}";
+            }
+            record["manaCost"] = cost;
+        }
+        if (power.whole_part != INT_MIN || power.half || power.asterics)
+            record["power"] = feature_text(power);
+        if (toughness.whole_part != INT_MIN || toughness.half || toughness.asterics)
+            record["toughness"] = feature_text(toughness);
+        if (loyalty != INT_MIN)
+            record["loyalty"] = loyalty;
+        if (hand != INT_MIN)
+            record["hand"] = hand;
+        if (life != INT_MIN)
+            record["life"] = life;
+        list_field("names", names);
+        list_field("colors", symbols(get_colors(), words.colors));
+        list_field("supertypes", symbols(get_supertypes(), words.supertypes));
+        list_field("types", symbols(get_types(), words.types));
+        list_field("subtypes", symbols(get_subtypes(), words.subtypes));
+        os << nlohmann::json(std::string(name)).dump() << ": " << record.dump();
+    }
+
     /*
-     * These basic setters cannot be simply traits-templated nor shortened
-     * with ?: notation because of properties of the json library. This applies
-     * for name, text, loyalty, hand, life card fields.
+     * Views of fields of a JSON card, strings stay in card.
      */
+    // Defined here, so that records are not inlined wherever they are copied or destroyed.
+    card_record::card_record(const card_record &) = default;
+
+    card_record::card_record(card_record &&) noexcept = default;
+
+    card_record::~card_record() {
+    }
+
+    card_record &
+    card_record::operator=(const card_record &) = default;
+
+    card_record &
+    card_record::operator=(card_record &&) noexcept = default;
+
+    card_record
+    card_record::from_json(const card_t & card) {
+        card_record res;
+        auto && string_field = [&card](const char * field, std::optional<std::string_view> & value) {
+            auto it = card.find(field);
+            if (it != card.end())
+                value = it->get_ref<const std::string &>();
+        };
+        auto && int_field = [&card](const char * field, std::optional<int> & value) {
+            auto it = card.find(field);
+            if (it != card.end())
+                value = it->get<int>();
+        };
+        auto && list_field = [&card](const char * field, std::vector<std::string_view> & values) {
+            auto it = card.find(field);
+            if (it != card.end()) {
+                for (const auto & value : *it)
+                    values.push_back(value.get_ref<const std::string &>());
+            }
+        };
+        string_field("name", res.name);
+        string_field("text", res.text);
+        string_field("layout", res.layout);
+        string_field("manaCost", res.manaCost);
+        string_field("power", res.power);
+        string_field("toughness", res.toughness);
+        int_field("loyalty", res.loyalty);
+        int_field("hand", res.hand);
+        int_field("life", res.life);
+        list_field("names", res.names);
+        list_field("colors", res.colors);
+        list_field("supertypes", res.supertypes);
+        list_field("types", res.types);
+        list_field("subtypes", res.subtypes);
+        return res;
+    }
+
     void
-    Card::set_name(const card_t & card) {
-        if (card.find("name") != card.end()) {
-            name = card["name"];
-        }
-        else {
-            name = "";
-        }
+    card_record::clear() {
+        name.reset();
+        text.reset();
+        layout.reset();
+        manaCost.reset();
+        power.reset();
+        toughness.reset();
+        loyalty.reset();
+        hand.reset();
+        life.reset();
+        names.clear();
+        colors.clear();
+        supertypes.clear();
+        types.clear();
+        subtypes.clear();
     }
 
+    /*
+     * A record can, but mustn't contain a field, so the setters fill the card
+     * with some predefined default variable (see usings in card.hpp) if the
+     * field is absent.
+     */
     void
-    Card::set_text(const card_t & card) {
-        if (card.find("text") != card.end()) {
-            text = card["text"];
-        }
-        else {
-            text = "";
-        }
+    Card::set_name(const card_record & card, string_pool & strings) {
+        name = card.name ? strings.intern(*card.name) : "";
+    }
+
+    void
+    Card::set_text(const card_record & card, string_pool & strings) {
+        text = card.text ? strings.intern(*card.text) : "";
     }
 
     /*
      * Both following setters expect form of .5, <num>.5, <num>+*, *, <num>.
      * Even negative num is possible.
      */
-    void
-    Card::set_power(const card_t & card) {
+    static feature
+    parse_feature(const std::optional<std::string_view> & value) {
         feature ftr;
-        if (card.find("power") != card.end()) {
-            std::string pow = card["power"];
-            if (pow.find('*') != string::npos) ftr.asterics = true;
-            if (pow.find('.') != string::npos) ftr.half = true;
-            if (pow[0] == '*') goto final_set;
-            if (pow == ".5") goto final_set;
-            ftr.whole_part = std::stoi(pow);
+        if (value) {
+            std::string_view f = *value;
+            if (f.find('*') != string::npos) ftr.asterics = true;
+            if (f.find('.') != string::npos) ftr.half = true;
+            if (f[0] == '*') return ftr;
+            if (f == ".5") return ftr;
+            ftr.whole_part = std::stoi(std::string(f));
         }
-    final_set:
-        power = ftr;
+        return ftr;
     }
 
     void
-    Card::set_toughness(const card_t & card) {
-        feature ftr;
-        if (card.find("toughness") != card.end()) {
-            std::string tou = card["toughness"];
-            if (tou.find('*') != string::npos) ftr.asterics = true;
-            if (tou.find('.') != string::npos) ftr.half = true;
-            if (tou[0] == '*') goto final_set;
-            if (tou == ".5") goto final_set;
-            ftr.whole_part = std::stoi(tou);
-        }
-    final_set:
-        toughness = ftr;
+    Card::set_power(const card_record & card) {
+        power = parse_feature(card.power);
     }
 
     void
-    Card::set_loyalty(const card_t & card) {
-        if (card.find("loyalty") != card.end()) {
-            loyalty = card["loyalty"];
-        }
-        else {
-            loyalty = INT_MIN;
-        }
+    Card::set_toughness(const card_record & card) {
+        toughness = parse_feature(card.toughness);
     }
 
     void
-    Card::set_hand(const card_t & card) {
-        if (card.find("hand") != card.end()) {
-            hand = card["hand"];
-        }
-        else {
-            hand = INT_MIN;
-        }
+    Card::set_loyalty(const card_record & card) {
+        loyalty = card.loyalty.value_or(INT_MIN);
     }
 
     void
-    Card::set_life(const card_t & card) {
-        if (card.find("life") != card.end()) {
-            life = card["life"];
-        }
-        else {
-            life = INT_MIN;
-        }
+    Card::set_hand(const card_record & card) {
+        hand = card.hand.value_or(INT_MIN);
     }
 
     void
-    Card::set_layout(const card_t & card) {
-        const auto & layouts = db->get_layout();
-        try {
-            if (card.find("layout") != card.end()) {
-                layout = (layouts.at(card["layout"]));
-                return;
-            }
-        }
-        catch (const std::out_of_range &) {
-            std::string msg = "Layout of " + name +
-                    " does not refer to any layout in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
-        layout = (layouts.at(""));
+    Card::set_life(const card_record & card) {
+        life = card.life.value_or(INT_MIN);
     }
 
     void
-    Card::set_names(const card_t & card) {
-        std::vector<std::string> names_;
-        if (card.find("names") != card.end()) {
-            for (std::string name_ : card["names"]) {
-                names_.push_back(name_);
-            }
-        }
+    Card::set_layout(const card_record & card) {
+        layout = vocabulary::instance().layout.intern(card.layout.value_or(""));
+    }
+
+    void
+    Card::set_names(const card_record & card, string_pool & strings) {
+        names_t names_;
+        names_.reserve(card.names.size());
+        for (std::string_view name_ : card.names)
+            names_.push_back(strings.intern(name_));
         names = std::move(names_);
     }
 
@@ -216,37 +345,29 @@ namespace magicSearchEngine {
      * This method expects that all mana types of one kind are in row for a card.
      */
     void
-    Card::set_manaCost(const card_t & card) {
-        const auto & db_mana = db->get_mana();
+    Card::set_manaCost(const card_record & card) {
+        symbol_table & db_mana = vocabulary::instance().mana;
         manaCost_t cards_cost;
-        try {
-            if (card.find("manaCost") != card.end()) {
-                std::string manaCost_ = card.at("manaCost");
-                string str = get_mana_symbol(manaCost_); // Has side effects on arg!
-                // Each cycle one "{<mana>}" substr is removed from manaCost
-                // and accordingly processed.
-                while (str.size() != 0) {
-                    const string & mana_s = db_mana.at(str);
-                    // Either the cards_cost is yet empty or ("in row" assumtion)
-                    // the last element of cards_cost is not the same as currently read.
-                    if (cards_cost.size() == 0 || *(cards_cost[cards_cost.size() - 1].color) != mana_s) {
-                        cards_cost.push_back(manaCnt(&mana_s, 1));
-                        // strcmp((*(cards_cost[cards_cost.size() - 1].color)).c_str(), mana_s.c_str()) != 0) {// 
-                    }
-                        // If the last element of cards_cost is the same as currently
-                        // read we just enlarge the count of that mana type.
-                    else {
-                        cards_cost[cards_cost.size() - 1].count++;
-                    }
-                    str = get_mana_symbol(manaCost_); // Has side effects on arg!
+        if (card.manaCost) {
+            std::string manaCost_(*card.manaCost);
+            string str = get_mana_symbol(manaCost_); // Has side effects on arg!
+            // Each cycle one "{<mana>}" substr is removed from manaCost
+            // and accordingly processed.
+            while (str.size() != 0) {
+                symbol_id mana_s = db_mana.intern(str);
+                // Either the cards_cost is yet empty or ("in row" assumtion)
+                // the last element of cards_cost is not the same as currently read.
+                if (cards_cost.size() == 0 || cards_cost[cards_cost.size() - 1].color != mana_s) {
+                    cards_cost.push_back(manaCnt(mana_s, 1));
+                }
+                    // If the last element of cards_cost is the same as currently
+                    // read we just enlarge the count of that mana type.
+                else {
+                    cards_cost[cards_cost.size() - 1].count++;
                 }
+                str = get_mana_symbol(manaCost_); // Has side effects on arg!
             }
         }
-        catch (const std::out_of_range &) {
-            std::string msg = "One of mana symbols of " + name +
-                    " does not refer to any mana symbol in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
         sort(begin(cards_cost), end(cards_cost));
         manaCost = std::move(cards_cost);
     }
@@ -269,89 +390,59 @@ namespace magicSearchEngine {
         return std::move(mana);
     }
 
+    // Ids of values in table.
+    static small_vector<symbol_id, 2>
+    intern_all(const std::vector<std::string_view> & values, symbol_table & table) {
+        small_vector<symbol_id, 2> res;
+        res.reserve(values.size());
+        for (std::string_view value : values)
+            res.push_back(table.intern(value));
+        return res;
+    }
+
     void
-    Card::set_colors(const card_t & card) {
-        const auto & db_colors = db->get_colors();
-        colors_t card_colors;
-        try {
-            if (card.find("colors") != card.end()) {
-                for (const std::string & color : card["colors"]) {
-                    card_colors.push_back(&(db_colors.at(color)));
-                }
-            }
-        }
-        catch (const std::out_of_range &) {
-            std::string msg = "One of colors of " + name +
-                    " does not refer to any color in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
+    Card::set_colors(const card_record & card) {
+        symbol_ids card_colors = intern_all(card.colors, vocabulary::instance().colors);
         sort(begin(card_colors), end(card_colors));
         colors = std::move(card_colors);
     }
 
     void
-    Card::set_supertypes(const card_t & card) {
-        const auto & db_supertypes = db->get_supertypes();
-        supertypes_t card_supertypes;
-        try {
-            if (card.find("supertypes") != card.end()) {
-                for (const std::string & supertype : card["supertypes"]) {
-                    card_supertypes.push_back(&(db_supertypes.at(supertype)));
-                }
-            }
-        }
-        catch (const std::out_of_range &) {
-            std::string msg = "One of supertypes of " + name +
-                    " does not refer to any supertype in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
-        supertypes = std::move(card_supertypes);
+    Card::set_supertypes(const card_record & card) {
+        supertypes = intern_all(card.supertypes, vocabulary::instance().supertypes);
     }
 
     void
-    Card::set_types(const card_t & card) {
-        const auto & db_types = db->get_types();
-        types_t card_types;
-        try {
-            if (card.find("types") != card.end()) {
-                for (const std::string & type : card["types"]) {
-                    card_types.push_back(&(db_types.at(type)));
-                }
-            }
-        }
-        catch (const std::out_of_range &) {
-            std::string msg = "One of types of " + name +
-                    " does not refer to any type in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
-        types = std::move(card_types);
+    Card::set_types(const card_record & card) {
+        types = intern_all(card.types, vocabulary::instance().types);
     }
 
     void
-    Card::set_subtypes(const card_t & card) {
-        const auto & db_subtypes = db->get_subtypes();
-        subtypes_t card_subtypes;
-        try {
-            if (card.find("subtypes") != card.end()) {
-                for (const std::string & subtype : card["subtypes"]) {
-                    card_subtypes.push_back(&(db_subtypes.at(subtype)));
-                }
-            }
-        }
-        catch (const std::out_of_range &) {
-            std::string msg = "One of subtypes of " + name +
-                    " does not refer to any subtype in the database, check rules.";
-            throw std::out_of_range(msg);
-        }
-        subtypes = std::move(card_subtypes);
+    Card::set_subtypes(const card_record & card) {
+        subtypes = intern_all(card.subtypes, vocabulary::instance().subtypes);
+    }
+
+    void
+    Card::account_memory(memory_report & report) const {
+        report.add_vector("card names", names);
+        report.add_vector("card vectors", manaCost);
+        report.add_vector("card vectors", colors);
+        report.add_vector("card vectors", supertypes);
+        report.add_vector("card vectors", types);
+        report.add_vector("card vectors", subtypes);
     }
 
     /*
      * Only getters follows.
      */
 
-    const layout_t &
+    layout_t
     Card::get_layout() const {
+        return vocabulary::instance().layout[layout].name;
+    }
+
+    symbol_id
+    Card::get_layout_id() const {
         return layout;
     }
 
@@ -370,24 +461,24 @@ namespace magicSearchEngine {
         return manaCost;
     }
 
-    const colors_t &
+    colors_t
     Card::get_colors() const {
-        return colors;
+        return colors_t(colors.begin(), colors.end(), vocabulary::instance().colors);
     }
 
-    const supertypes_t &
+    supertypes_t
     Card::get_supertypes() const {
-        return supertypes;
+        return supertypes_t(supertypes.begin(), supertypes.end(), vocabulary::instance().supertypes);
     }
 
-    const types_t &
+    types_t
     Card::get_types() const {
-        return types;
+        return types_t(types.begin(), types.end(), vocabulary::instance().types);
     }
 
-    const subtypes_t &
+    subtypes_t
     Card::get_subtypes() const {
-        return subtypes;
+        return subtypes_t(subtypes.begin(), subtypes.end(), vocabulary::instance().subtypes);
     }
 
     const text_t &
@@ -419,5 +510,32 @@ namespace magicSearchEngine {
     Card::get_life() const {
         return life;
     }
+
+    bool
+    same_values(const Card & a, const Card & b) {
+        auto && same_ids = [](const symbol_list & x, const symbol_list & y) {
+            return x.size() == y.size() && equal(x.ids(), x.ids() + x.size(), y.ids());
+        };
+        auto && same_feature = [](const feature & x, const feature & y) {
+            return x.whole_part == y.whole_part && x.half == y.half && x.asterics == y.asterics;
+        };
+        auto && same_mana = [](const manaCnt & x, const manaCnt & y) {
+            return x.color == y.color && x.count == y.count;
+        };
+        return a.get_name() == b.get_name() && a.get_text() == b.get_text() &&
+                equal(a.get_names().begin(), a.get_names().end(),
+                b.get_names().begin(), b.get_names().end()) &&
+                a.get_layout_id() == b.get_layout_id() &&
+                equal(a.get_manaCost().begin(), a.get_manaCost().end(),
+                b.get_manaCost().begin(), b.get_manaCost().end(), same_mana) &&
+                same_ids(a.get_colors(), b.get_colors()) &&
+                same_ids(a.get_supertypes(), b.get_supertypes()) &&
+                same_ids(a.get_types(), b.get_types()) &&
+                same_ids(a.get_subtypes(), b.get_subtypes()) &&
+                same_feature(a.get_power(), b.get_power()) &&
+                same_feature(a.get_toughness(), b.get_toughness()) &&
+                a.get_loyalty() == b.get_loyalty() && a.get_hand() == b.get_hand() &&
+                a.get_life() == b.get_life();
+    }
 }
 
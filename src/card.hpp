@@ -32,22 +32,28 @@
 #ifndef CARD_HPP
 #define CARD_HPP
 
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <limits.h>
 #include "src/json.hpp"
+#include "src/small_vector.hpp"
+#include "src/string_pool.hpp"
+#include "src/symbol_table.hpp"
+#include "src/vocabulary.hpp"
 
 namespace magicSearchEngine {
 
     struct manaCnt {
     public:
-        const std::string * color;
+        symbol_id color; // In vocabulary::instance().mana.
         short count;
 
-        manaCnt() : color(nullptr), count(0) {
+        manaCnt() : color(symbol_table::none), count(0) {
         }
 
-        manaCnt(const std::string * c, short cnt) : color(c), count(cnt) {
+        manaCnt(symbol_id c, short cnt) : color(c), count(cnt) {
         }
         
         bool operator <(const manaCnt & b) const {
@@ -58,7 +64,7 @@ namespace magicSearchEngine {
     } ;
 
     inline std::ostream & operator<<(std::ostream & os, const manaCnt & m) {
-        os << *(m.color) << ": " << m.count;
+        os << vocabulary::instance().mana[m.color].name << ": " << m.count;
         return os;
     }
 
@@ -88,15 +94,18 @@ namespace magicSearchEngine {
         return os;
     }
 
-    using layout_t     = std::string;                       // Default: ""
-    using name_t       = std::string;                       // Default: ""
-    using names_t      = std::vector<std::string>;
-    using manaCost_t   = std::vector<manaCnt>;
-    using colors_t     = std::vector<const std::string *>;
-    using supertypes_t = std::vector<const std::string *>;
-    using types_t      = std::vector<const std::string *>;
-    using subtypes_t   = std::vector<const std::string *>;
-    using text_t       = std::string;                       // Default: ""
+    // Strings are views of the string_pool of the database, or of the
+    // vocabulary in case of layout. Colors and types are kept as ids of
+    // symbols in the vocabulary and got as views of pointers to their names.
+    using layout_t     = std::string_view;                  // Default: ""
+    using name_t       = std::string_view;                  // Default: ""
+    using names_t      = small_vector<std::string_view, 1>;
+    using manaCost_t   = small_vector<manaCnt, 3>;
+    using colors_t     = symbol_list;
+    using supertypes_t = symbol_list;
+    using types_t      = symbol_list;
+    using subtypes_t   = symbol_list;
+    using text_t       = std::string_view;                  // Default: ""
     using power_t      = feature;                           // Default: {INT_MIN, false, false}
     using toughness_t  = feature;                           // Default: {INT_MIN, false, false}
     using loyalty_t    = int;                               // Default: INT_MIN
@@ -107,41 +116,109 @@ namespace magicSearchEngine {
             std::allocator<char> >, bool, long, unsigned long, double,
             std::allocator, nlohmann::adl_serializer> &;
 
-    // Forward declaration, avoiding cycle dependencies.
-    class Database;
+    class memory_report;
 
+    /*
+     * Fields of a card a Card is made of, views of strings of the input (or
+     * of its reader). Absent fields are empty optionals or empty lists.
+     */
+    struct card_record {
+        std::optional<std::string_view> name;
+        std::optional<std::string_view> text;
+        std::optional<std::string_view> layout;
+        std::optional<std::string_view> manaCost;
+        std::optional<std::string_view> power;
+        std::optional<std::string_view> toughness;
+        std::optional<int>              loyalty;
+        std::optional<int>              hand;
+        std::optional<int>              life;
+        std::vector<std::string_view>   names;
+        std::vector<std::string_view>   colors;
+        std::vector<std::string_view>   supertypes;
+        std::vector<std::string_view>   types;
+        std::vector<std::string_view>   subtypes;
+
+        card_record() = default;
+        card_record(const card_record &);
+        card_record(card_record &&) noexcept;
+        ~card_record();
+
+        card_record &
+        operator=(const card_record &);
+
+        card_record &
+        operator=(card_record &&) noexcept;
+
+        static card_record
+        from_json(const card_t & card);
+
+        // Lists keep their capacity for the next card.
+        void
+        clear();
+    } ;
+
+    /*
+     * Fields are ordered to leave no padding. Lists of colors and types
+     * hardly have more than two elements, so they are inline in the card.
+     */
     class Card {
     private:
-        const Database* db;
-        layout_t        layout;
+        // Makes cards of its records.
+        friend class engine_image;
+
+        using symbol_ids = small_vector<symbol_id, 2>;
+
         name_t          name;
+        text_t          text;
         names_t         names;
         manaCost_t      manaCost;
-        colors_t        colors;
-        supertypes_t    supertypes;
-        types_t         types;
-        subtypes_t      subtypes;
-        text_t          text;
+        symbol_ids      colors;
+        symbol_ids      supertypes;
+        symbol_ids      types;
+        symbol_ids      subtypes;
         power_t         power;
         toughness_t     toughness;
         loyalty_t       loyalty;
         hand_t          hand;
         life_t          life;
+        symbol_id       layout;
 
     public:
-        Card(const card_t & card, const Database * dat);
+        // Strings of the card are stored in strings, its types, colors etc.
+        // are interned in vocabulary::instance().
+        Card(const card_record & card, string_pool & strings);
+        Card(const card_t & card, string_pool & strings);
+        Card(const Card &);
+        Card(Card &&) noexcept;
+        ~Card();
+
+        Card &
+        operator=(const Card &);
+
+        Card &
+        operator=(Card &&) noexcept;
+
         friend std::ostream & operator<<(std::ostream &, const Card &) ;
+
+        /*
+         * Writes the card as a record of AllCards.json ("name": {...}), which
+         * is read as an equal card (mana symbols may come in other order).
+         */
+        void
+        write_record(std::ostream & os) const;
+
         /*
          * Getters.
          */
-        const layout_t &     get_layout() const;
+        layout_t             get_layout() const;
+        symbol_id            get_layout_id() const;
         const name_t &       get_name() const;
         const names_t &      get_names() const;
         const manaCost_t &   get_manaCost() const;
-        const colors_t &     get_colors() const;
-        const supertypes_t & get_supertypes() const;
-        const types_t &      get_types() const;
-        const subtypes_t &   get_subtypes() const;
+        colors_t             get_colors() const;
+        supertypes_t         get_supertypes() const;
+        types_t              get_types() const;
+        subtypes_t           get_subtypes() const;
         const text_t &       get_text() const;
         const power_t &      get_power() const;
         const toughness_t &  get_toughness() const;
@@ -149,40 +226,54 @@ namespace magicSearchEngine {
         const hand_t &       get_hand() const;
         const life_t &       get_life() const;
 
+        // An auxiliary method for set_manaCost.
+        static std::string
+        get_mana_symbol(std::string & s);
+
+        // Heap blocks of lists that did not fit into the card.
+        void
+        account_memory(memory_report & report) const;
+
     private:
+        // Empty card filled by engine_image.
+        Card();
+
         /*
-         * Setters. JSON card record can, but mustn't contain field, so the
+         * Setters. Card record can, but mustn't contain field, so the
          * following methods must check presence of given field and if absent,
          * fill card with some predefined default variable (see usings above).
          */
-        void set_name(const card_t & card);
-        void set_text(const card_t & card);
-        void set_power(const card_t & card);
-        void set_toughness(const card_t & card);
-        void set_loyalty(const card_t & card);
-        void set_hand(const card_t & card);
-        void set_life(const card_t & card);
+        void set_name(const card_record & card, string_pool & strings);
+        void set_text(const card_record & card, string_pool & strings);
+        void set_power(const card_record & card);
+        void set_toughness(const card_record & card);
+        void set_loyalty(const card_record & card);
+        void set_hand(const card_record & card);
+        void set_life(const card_record & card);
         // Following setters parse more complicated input (slower).
-        void set_layout(const card_t & card);
-        void set_names(const card_t & card);
-        void set_manaCost(const card_t & card);
-        void set_colors(const card_t & card);
-        void set_supertypes(const card_t & card);
-        void set_types(const card_t & card);
-        void set_subtypes(const card_t & card);
-
-        // An auxiliary method for set_manaCost.
-        std::string
-        get_mana_symbol(std::string & s);
+        void set_layout(const card_record & card);
+        void set_names(const card_record & card, string_pool & strings);
+        void set_manaCost(const card_record & card);
+        void set_colors(const card_record & card);
+        void set_supertypes(const card_record & card);
+        void set_types(const card_record & card);
+        void set_subtypes(const card_record & card);
     } ;
 
+    /*
+     * Whether the cards have the same values of all fields, mana symbols in
+     * the same order. Used to check readers of cards against each other.
+     */
+    bool
+    same_values(const Card & a, const Card & b);
+
     /*
      * Auxiliar function that can print anything that can be traversed via ':'
      * notation to ostream os. Before printing itself the values in the to_print
      * can be amended via f function.
      */
     template<typename T, typename Function>
-    inline void
+    void
     print_vec(std::ostream & os, const T & to_print, const std::string & name, Function && f) {
         if (to_print.size() != 0) {
             os << name;
@@ -0,0 +1,381 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include "src/card_reader.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    card_reader::card_reader(string_view input, scan_mode mode) : start(input.data()),
+    size(input.size()), started(false), finished(false), used(0), keeping(false), card_begin(0), card_end(0), source(nullptr),
+    indexer(mode), indexed(input.size()), nesting(0), closed_cards(0), read_cards(0) {
+        // Structural characters take about a tenth of the catalog.
+        index.reserve(input.size() / 8);
+        indexer.add(input, index);
+        token = index.data();
+        last = index.data() + index.size();
+        if (!indexer.closed()) {
+            token = last;
+            fail("unterminated string");
+        }
+    }
+
+    card_reader::card_reader(zip_input & input) : start(input.view().data()),
+    size(input.view().size()), started(false), finished(false), used(0), keeping(false), card_begin(0), card_end(0), source(&input),
+    indexed(0), nesting(0), closed_cards(0), read_cards(0) {
+        index.reserve(size / 8);
+        token = index.data();
+        last = index.data();
+    }
+
+    /*
+     * The indexer takes whole blocks of 64 bytes but the last one. Cards are
+     * counted by closing braces at depth of cards, next() waits until the
+     * card it reads is closed.
+     */
+    void
+    card_reader::index_more() {
+        size_t at = static_cast<size_t> (token - index.data());
+        size_t ready = source->wait_beyond(indexed + 63);
+        size_t upto = ready == size ? size : ready - ready % 64;
+        size_t first = index.size();
+        indexer.add(string_view(start + indexed, upto - indexed), index);
+        indexed = upto;
+        for (size_t i = first; i < index.size(); ++i) {
+            char c = start[index[i]];
+            if (c == '{' || c == '[')
+                ++nesting;
+            else if ((c == '}' || c == ']') && --nesting == 1)
+                ++closed_cards;
+        }
+        token = index.data() + at;
+        last = index.data() + index.size();
+        if (indexed == size && !indexer.closed()) {
+            token = last;
+            fail("unterminated string");
+        }
+    }
+
+    void
+    card_reader::fail(const char * what) const {
+        size_t at = token != last ? *token : size;
+        throw runtime_error("Cards are not valid JSON at byte " + to_string(at) +
+                ": " + what + ".");
+    }
+
+    char
+    card_reader::peek() const {
+        return token != last ? start[*token] : '\0';
+    }
+
+    void
+    card_reader::expect(char c) {
+        if (peek() != c) {
+            const char what[] = {'e', 'x', 'p', 'e', 'c', 't', 'e', 'd', ' ', c, '\0'};
+            fail(what);
+        }
+        ++token;
+    }
+
+    // Appends code point cp to s in UTF-8.
+    static void
+    append_utf8(string & s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char> (cp);
+        }
+        else if (cp < 0x800) {
+            s += static_cast<char> (0xC0 | (cp >> 6));
+            s += static_cast<char> (0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000) {
+            s += static_cast<char> (0xE0 | (cp >> 12));
+            s += static_cast<char> (0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char> (0x80 | (cp & 0x3F));
+        }
+        else {
+            s += static_cast<char> (0xF0 | (cp >> 18));
+            s += static_cast<char> (0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char> (0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char> (0x80 | (cp & 0x3F));
+        }
+    }
+
+    /*
+     * The string at the current token: a view of the input if it has no
+     * escapes, otherwise of the next free buffer it is unescaped into. Quotes
+     * come in pairs in the index, the input does not end inside a string.
+     */
+    string_view
+    card_reader::read_string() {
+        if (peek() != '"')
+            fail("expected string");
+        const char * first = start + token[0] + 1;
+        const char * after = start + token[1];
+        token += 2;
+        string_view res(first, static_cast<size_t> (after - first));
+        if (memchr(first, '\\', res.size()) == nullptr)
+            return res;
+        return unescape(res);
+    }
+
+    string_view
+    card_reader::unescape(string_view s) {
+        if (used == unescaped.size())
+            unescaped.emplace_back();
+        string & res = unescaped[used++];
+        res.clear();
+        const char * pos = s.data();
+        const char * end = s.data() + s.size();
+        auto && hex4 = [this, &pos, end]() {
+            uint32_t cp = 0;
+            auto r = from_chars(pos, min(pos + 4, end), cp, 16);
+            if (r.ptr != pos + 4)
+                fail("invalid \\u escape");
+            pos += 4;
+            return cp;
+        };
+        while (pos != end) {
+            const char * backslash = static_cast<const char *> (memchr(pos, '\\',
+                    static_cast<size_t> (end - pos)));
+            if (backslash == nullptr)
+                backslash = end;
+            res.append(pos, backslash);
+            pos = backslash;
+            if (pos == end || ++pos == end)
+                break;
+            char c = *pos++;
+            switch (c) {
+                case 'n': res += '\n';
+                    break;
+                case 't': res += '\t';
+                    break;
+                case 'r': res += '\r';
+                    break;
+                case 'b': res += '\b';
+                    break;
+                case 'f': res += '\f';
+                    break;
+                case 'u':
+                {
+                    uint32_t cp = hex4();
+                    // A surrogate pair is one code point.
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - pos >= 6 &&
+                            pos[0] == '\\' && pos[1] == 'u') {
+                        pos += 2;
+                        uint32_t low = hex4();
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(res, cp);
+                    break;
+                }
+                default: res += c; // ", \ and /
+            }
+        }
+        return res;
+    }
+
+    string_view
+    card_reader::scalar() const {
+        const char * first = start + token[-1] + 1;
+        const char * after = token != last ? start + *token : start + size;
+        while (first != after && isspace(static_cast<unsigned char> (*first)))
+            ++first;
+        while (after != first && isspace(static_cast<unsigned char> (after[-1])))
+            --after;
+        return string_view(first, static_cast<size_t> (after - first));
+    }
+
+    void
+    card_reader::skip_value() {
+        char c = peek();
+        if (c == '"') {
+            token += 2;
+            return;
+        }
+        if (c == '{' || c == '[') {
+            size_t depth = 0;
+            do {
+                c = start[*token];
+                if (c == '"') {
+                    token += 2;
+                    continue;
+                }
+                if (c == '{' || c == '[')
+                    ++depth;
+                else if (c == '}' || c == ']')
+                    --depth;
+                ++token;
+            } while (depth != 0 && token != last);
+            if (depth != 0)
+                fail("unexpected end");
+            return;
+        }
+        // A number or literal is not a token, the next one follows it.
+        if (scalar().empty())
+            fail("expected value");
+    }
+
+    void
+    card_reader::read_string(optional<string_view> & value) {
+        if (peek() == '"')
+            value = read_string();
+        else
+            skip_value();
+    }
+
+    void
+    card_reader::read_int(optional<int> & value) {
+        char c = peek();
+        if (c == '"' || c == '{' || c == '[') {
+            skip_value();
+            return;
+        }
+        string_view text = scalar();
+        if (text.empty())
+            fail("expected value");
+        int res;
+        // A fractional part is dropped.
+        if (from_chars(text.data(), text.data() + text.size(), res).ec == errc())
+            value = res;
+    }
+
+    void
+    card_reader::read_strings(vector<string_view> & values) {
+        if (peek() != '[') {
+            skip_value();
+            return;
+        }
+        ++token;
+        if (peek() == ']') {
+            ++token;
+            return;
+        }
+        while (true) {
+            if (peek() == '"')
+                values.push_back(read_string());
+            else
+                skip_value();
+            if (peek() == ',')
+                ++token;
+            else {
+                expect(']');
+                return;
+            }
+        }
+    }
+
+    void
+    card_reader::read_field(string_view field, card_record & record) {
+        if (field == "name") read_string(record.name);
+        else if (field == "text") read_string(record.text);
+        else if (field == "layout") read_string(record.layout);
+        else if (field == "manaCost") read_string(record.manaCost);
+        else if (field == "power") read_string(record.power);
+        else if (field == "toughness") read_string(record.toughness);
+        else if (field == "loyalty") read_int(record.loyalty);
+        else if (field == "hand") read_int(record.hand);
+        else if (field == "life") read_int(record.life);
+        else if (field == "names") read_strings(record.names);
+        else if (field == "colors") read_strings(record.colors);
+        else if (field == "supertypes") read_strings(record.supertypes);
+        else if (field == "types") read_strings(record.types);
+        else if (field == "subtypes") read_strings(record.subtypes);
+        else skip_value();
+    }
+
+    bool
+    card_reader::next(string_view & key, card_record & record) {
+        if (finished)
+            return false;
+        if (source != nullptr)
+            while (indexed < size && closed_cards <= read_cards)
+                index_more();
+        if (!started) {
+            expect('{');
+            started = true;
+        }
+        else if (peek() == ',') {
+            ++token;
+        }
+        else {
+            expect('}');
+            finished = true;
+            return false;
+        }
+        if (peek() == '}') {
+            ++token;
+            finished = true;
+            return false;
+        }
+
+        if (!keeping)
+            used = 0;
+        record.clear();
+        card_begin = token != last ? *token : size;
+        key = read_string();
+        expect(':');
+        expect('{');
+        ++read_cards;
+        if (peek() == '}') {
+            card_end = *token++ + 1;
+            return true;
+        }
+        while (true) {
+            string_view field = read_string();
+            expect(':');
+            read_field(field, record);
+            if (peek() == ',')
+                ++token;
+            else {
+                expect('}');
+                card_end = token[-1] + 1;
+                return true;
+            }
+        }
+    }
+
+    string_view
+    card_reader::card_text() const {
+        return string_view(start + card_begin, card_end - card_begin);
+    }
+
+    void
+    card_reader::keep_unescaped() {
+        keeping = true;
+    }
+
+    deque<string>
+    card_reader::take_unescaped() {
+        deque<string> res;
+        res.swap(unescaped);
+        used = 0;
+        return res;
+    }
+}
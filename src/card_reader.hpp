@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   card_reader.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 9:30 PM
+ */
+
+#ifndef CARD_READER_HPP
+#define CARD_READER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "src/card.hpp"
+#include "src/json_index.hpp"
+#include "src/zip_input.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * In-situ reader of AllCards.json, an object of card objects keyed by
+     * names of cards. Strings without escapes are views of the input, others
+     * are unescaped into buffers of the reader, which are reused for the next
+     * card. Fields a Card does not use are skipped without copying.
+     *
+     * The input is indexed by structural_index first, then the reader jumps
+     * from one structural character to the next: a string ends at the quote
+     * following its opening one, a number lies between two of them.
+     *
+     * Input of a zip_input is indexed by parts while it is inflated, a card
+     * is read once the index reaches its end.
+     */
+    class card_reader {
+    private:
+        const char * start;
+        size_t size;
+        std::vector<uint32_t> index;
+        const uint32_t * token;
+        const uint32_t * last;
+        bool started;
+        bool finished;
+        std::deque<std::string> unescaped;
+        size_t used;
+        bool keeping;
+        size_t card_begin;
+        size_t card_end;
+
+        zip_input * source;
+        structural_indexer indexer;
+        size_t indexed; // Bytes of the input in the index.
+        size_t nesting; // Of the indexed input.
+        size_t closed_cards; // In the index.
+        size_t read_cards;
+
+        // Waits for the next part of the source and indexes it.
+        void
+        index_more();
+
+        [[noreturn]] void
+        fail(const char * what) const;
+
+        char
+        peek() const;
+
+        void
+        expect(char c);
+
+        std::string_view
+        read_string();
+
+        std::string_view
+        unescape(std::string_view s);
+
+        // Text of a number or literal, which precedes the current token.
+        std::string_view
+        scalar() const;
+
+        void
+        skip_value();
+
+        void
+        read_string(std::optional<std::string_view> & value);
+
+        void
+        read_int(std::optional<int> & value);
+
+        void
+        read_strings(std::vector<std::string_view> & values);
+
+        void
+        read_field(std::string_view field, card_record & record);
+
+    public:
+        explicit
+        card_reader(std::string_view input, scan_mode mode = scan_mode::simd);
+
+        // Reads input while it is inflated, which must outlive the reader.
+        explicit
+        card_reader(zip_input & input);
+
+        /*
+         * Reads the next card into record and its key, false after the last
+         * one. Views are valid until the next call. Throws runtime_error if
+         * the input is not valid.
+         */
+        bool
+        next(std::string_view & key, card_record & record);
+
+        // Text of the last card read, from its key to the end of its object.
+        std::string_view
+        card_text() const;
+
+        /*
+         * From now on, strings unescaped for cards are not reused for the
+         * following ones but kept until take_unescaped(), so that views of
+         * several cards can be passed on together.
+         */
+        void
+        keep_unescaped();
+
+        // Strings kept since the last call, their views live with the result.
+        std::deque<std::string>
+        take_unescaped();
+    } ;
+}
+
+#endif /* CARD_READER_HPP */
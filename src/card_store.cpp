@@ -0,0 +1,657 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "src/card_store.hpp"
+#include "src/card_reader.hpp"
+#include "src/engine_image.hpp"
+#include "src/mapped_file.hpp"
+#include "src/profiling.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    static const char manifest_magic[8] = {'M', 'S', 'E', 'S', 'T', 'O', 'R', '1'};
+    static const char segment_magic[8] = {'M', 'S', 'E', 'S', 'E', 'G', '0', '1'};
+
+    /*
+     * A change is stored as this header, its key and its text. The checksum
+     * covers the rest of the header, the key and the text.
+     */
+    struct change_header {
+        uint64_t sequence;
+        uint32_t key_size;
+        uint32_t text_size;
+        uint32_t crc;
+        uint32_t reserved;
+    } ;
+
+    static uint32_t
+    change_crc(const change_header & header, string_view key, string_view text) {
+        uLong sum = crc32(0, nullptr, 0);
+        sum = crc32(sum, reinterpret_cast<const Bytef *> (&header), offsetof(change_header, crc));
+        sum = crc32(sum, reinterpret_cast<const Bytef *> (key.data()), static_cast<uInt> (key.size()));
+        sum = crc32(sum, reinterpret_cast<const Bytef *> (text.data()), static_cast<uInt> (text.size()));
+        return static_cast<uint32_t> (sum);
+    }
+
+    static void
+    write_all(int fd, const string & bytes, const string & path) {
+        size_t done = 0;
+        while (done < bytes.size()) {
+            ssize_t written = write(fd, bytes.data() + done, bytes.size() - done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0) {
+                int error = errno;
+                close(fd);
+                throw runtime_error("File " + path + " could not be written: " + strerror(error) + ".");
+            }
+            done += static_cast<size_t> (written);
+        }
+    }
+
+    // A renamed or created file survives a crash once its directory is synced.
+    static void
+    sync_directory(const string & path) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            throw runtime_error("Directory " + path + " cannot be opened: " + strerror(errno) + ".");
+        fsync(fd);
+        close(fd);
+    }
+
+    // Replaces the file at path by bytes, atomically for a crash.
+    static void
+    write_durably(const string & directory, const string & path, const string & bytes) {
+        string temporary = path + ".tmp";
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw runtime_error("File " + temporary + " cannot be created: " + strerror(errno) + ".");
+        write_all(fd, bytes, temporary);
+        if (fsync(fd) != 0) {
+            int error = errno;
+            close(fd);
+            throw runtime_error("File " + temporary + " could not be synced: " + strerror(error) + ".");
+        }
+        close(fd);
+        if (rename(temporary.c_str(), path.c_str()) != 0)
+            throw runtime_error("File " + path + " could not be replaced: " + strerror(errno) + ".");
+        sync_directory(directory);
+    }
+
+    static void
+    encode(string & out, uint64_t sequence, string_view key, string_view text) {
+        change_header header = {sequence, static_cast<uint32_t> (key.size()),
+            static_cast<uint32_t> (text.size()), 0, 0};
+        header.crc = change_crc(header, key, text);
+        out.append(reinterpret_cast<const char *> (&header), sizeof (header));
+        out.append(key);
+        out.append(text);
+    }
+
+    /*
+     * Reads the change at pos of bytes and moves pos past it, false if it is
+     * incomplete or its checksum does not match.
+     */
+    static bool
+    decode(string_view bytes, size_t & pos, uint64_t & sequence, string_view & key, string_view & text) {
+        change_header header;
+        if (bytes.size() - pos < sizeof (header))
+            return false;
+        memcpy(&header, bytes.data() + pos, sizeof (header));
+        size_t size = sizeof (header) + size_t(header.key_size) + header.text_size;
+        if (bytes.size() - pos < size)
+            return false;
+        key = bytes.substr(pos + sizeof (header), header.key_size);
+        text = bytes.substr(pos + sizeof (header) + header.key_size, header.text_size);
+        if (change_crc(header, key, text) != header.crc)
+            return false;
+        sequence = header.sequence;
+        pos += size;
+        return true;
+    }
+
+    static bool
+    exists(const string & path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    /*
+     * Lock of the store among processes, exclusive for writing. The exclusive
+     * one creates the store.
+     */
+    class card_store::store_lock {
+    private:
+        int fd;
+
+    public:
+
+        store_lock(const string & store_path, bool exclusive) {
+            if (exclusive && mkdir(store_path.c_str(), 0755) != 0 && errno != EEXIST)
+                throw runtime_error("Card store " + store_path + " cannot be created: " + strerror(errno) + ".");
+            string path = store_path + "/LOCK";
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                throw runtime_error("Card store " + store_path + " cannot be opened: " + strerror(errno) + ".");
+            while (flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+                if (errno != EINTR) {
+                    close(fd);
+                    throw runtime_error("Card store " + store_path + " cannot be locked.");
+                }
+            }
+        }
+
+        store_lock(const store_lock &) = delete;
+
+        store_lock &
+        operator=(const store_lock &) = delete;
+
+        ~store_lock() {
+            close(fd);
+        }
+    } ;
+
+    store_snapshot::store_snapshot(const store_snapshot &) = default;
+
+    card_store::card_store(const string & path_, const string & store_path_) :
+    JSONDatabase(path_), store_path(store_path_), log_id(1), log_size(0), sequence(0) {
+    }
+
+    card_store::~card_store() {
+    }
+
+    string
+    card_store::file(const string & name, uint64_t id) const {
+        return store_path + "/" + name + "." + to_string(id);
+    }
+
+    /*
+     * Layout of MANIFEST: magic, id of the log, number of segments, their ids
+     * from the oldest one and a checksum of the numbers.
+     */
+    void
+    card_store::write_manifest(uint64_t log_id_, const vector<uint64_t> & segments_) const {
+        vector<uint64_t> numbers = {log_id_, segments_.size()};
+        numbers.insert(end(numbers), begin(segments_), end(segments_));
+        string bytes(manifest_magic, sizeof (manifest_magic));
+        bytes.append(reinterpret_cast<const char *> (numbers.data()), numbers.size() * sizeof (uint64_t));
+        uint32_t sum = static_cast<uint32_t> (crc32(0, reinterpret_cast<const Bytef *> (numbers.data()),
+                static_cast<uInt> (numbers.size() * sizeof (uint64_t))));
+        bytes.append(reinterpret_cast<const char *> (&sum), sizeof (sum));
+        write_durably(store_path, store_path + "/MANIFEST", bytes);
+    }
+
+    void
+    card_store::open(bool repair) {
+        string damaged = "Card store " + store_path + " is damaged.";
+        changes.clear();
+        logged.clear();
+        segments.clear();
+        log_id = 1;
+        log_size = 0;
+        sequence = 0;
+        if (exists(store_path + "/MANIFEST")) {
+            mapped_file manifest(store_path + "/MANIFEST");
+            string_view bytes = manifest.view();
+            const size_t numbers_at = sizeof (manifest_magic);
+            uint64_t header[2];
+            if (bytes.size() < numbers_at + sizeof (header) + sizeof (uint32_t) ||
+                    !equal(begin(manifest_magic), end(manifest_magic), bytes.data()))
+                throw runtime_error(damaged);
+            memcpy(header, bytes.data() + numbers_at, sizeof (header));
+            size_t numbers = 2 + header[1];
+            uint32_t sum;
+            if (bytes.size() != numbers_at + numbers * sizeof (uint64_t) + sizeof (sum))
+                throw runtime_error(damaged);
+            memcpy(&sum, bytes.data() + numbers_at + numbers * sizeof (uint64_t), sizeof (sum));
+            if (sum != crc32(0, reinterpret_cast<const Bytef *> (bytes.data() + numbers_at),
+                    static_cast<uInt> (numbers * sizeof (uint64_t))))
+                throw runtime_error(damaged);
+            log_id = header[0];
+            segments.resize(header[1]);
+            // An empty vector may have no storage to copy to.
+            if (header[1] != 0)
+                memcpy(segments.data(), bytes.data() + numbers_at + sizeof (header), header[1] * sizeof (uint64_t));
+        }
+
+        uint64_t at;
+        string_view key, text;
+        for (uint64_t id : segments) {
+            mapped_file segment(file("segment", id));
+            string_view bytes = segment.view();
+            if (bytes.size() < sizeof (segment_magic) ||
+                    !equal(begin(segment_magic), end(segment_magic), bytes.data()))
+                throw runtime_error(damaged);
+            size_t pos = sizeof (segment_magic);
+            while (pos < bytes.size()) {
+                if (!decode(bytes, pos, at, key, text))
+                    throw runtime_error(damaged);
+                changes[string(key)] = change{at, string(key), string(text)};
+                sequence = max(sequence, at);
+            }
+        }
+
+        string log = file("log", log_id);
+        if (exists(log)) {
+            mapped_file input(log);
+            string_view bytes = input.view();
+            size_t pos = 0;
+            while (decode(bytes, pos, at, key, text)) {
+                change c{at, string(key), string(text)};
+                changes[c.key] = c;
+                logged[c.key] = move(c);
+                sequence = max(sequence, at);
+                ++log_size;
+            }
+            // The rest was being written when the writer stopped.
+            if (pos < bytes.size()) {
+                if (!repair) {
+                    // A writer must read the log again to repair it.
+                    read_state.clear();
+                    return;
+                }
+                if (truncate(log.c_str(), static_cast<off_t> (pos)) != 0)
+                    throw runtime_error("Card store " + store_path + " cannot be repaired: " + strerror(errno) + ".");
+            }
+        }
+        read_state = state();
+    }
+
+    /*
+     * Another process changing the store replaces the manifest or appends
+     * to the log.
+     */
+    string
+    card_store::state() const {
+        string s;
+        struct stat st;
+        if (stat((store_path + "/MANIFEST").c_str(), &st) == 0)
+            s = to_string(st.st_ino) + ":" + to_string(st.st_mtim.tv_sec) + "." + to_string(st.st_mtim.tv_nsec);
+        s += "/";
+        if (stat(file("log", log_id).c_str(), &st) == 0)
+            s += to_string(st.st_size);
+        return s;
+    }
+
+    Card
+    card_store::card_of(const change & c) {
+        // The record is read as a catalog of one card.
+        string text = "{";
+        text += c.text;
+        text += '}';
+        card_reader reader(text);
+        string_view key;
+        card_record record;
+        if (!reader.next(key, record))
+            throw runtime_error("Card " + c.key + " is not valid.");
+        return Card(record, strings);
+    }
+
+    vector<Card>
+    card_store::apply(const vector<Card> & base, const vector<const change *> & applied,
+            vector<uint32_t> * positions) {
+        vector<Card> result;
+        result.reserve(base.size() + applied.size());
+        auto && add = [&](const change & c, size_t at) {
+            if (c.text.empty())
+                return;
+            result.push_back(card_of(c));
+            if (positions)
+                positions->push_back(static_cast<uint32_t> (base.size() + at));
+        };
+        size_t next = 0;
+        string_view replaced;
+        bool replacing = false;
+        for (size_t pos = 0; pos < base.size(); ++pos) {
+            string_view name = base[pos].get_name();
+            for (; next < applied.size() && applied[next]->key < name; ++next)
+                add(*applied[next], next);
+            if (next < applied.size() && applied[next]->key == name) {
+                add(*applied[next], next);
+                ++next;
+                replaced = name;
+                replacing = true;
+                continue;
+            }
+            // Further cards of the name are replaced as well.
+            if (replacing && name == replaced)
+                continue;
+            result.push_back(base[pos]);
+            if (positions)
+                positions->push_back(static_cast<uint32_t> (pos));
+        }
+        for (; next < applied.size(); ++next)
+            add(*applied[next], next);
+        return result;
+    }
+
+    namespace {
+
+        /*
+         * Passes cards of the catalog to the observer of the store, keeps
+         * their order for the observer to get it with cards of the store.
+         */
+        class catalog_order : public card_observer {
+        private:
+            card_observer & observer;
+            std::mutex read_mtx;
+            size_t read;
+
+        public:
+            vector<uint32_t> read_order;
+
+            explicit
+            catalog_order(card_observer & observer_) : observer(observer_), read(0) {
+            }
+
+            void
+            cards_built(size_t first, const vector<Card> & cards) override {
+                observer.cards_built(first, cards);
+                lock_guard<std::mutex> lock(read_mtx);
+                read = max(read, first + cards.size());
+            }
+
+            void
+            cards_loaded(const vector<uint32_t> & read_order_) override {
+                read_order = read_order_;
+            }
+
+            // Number of cards read from the catalog.
+            size_t
+            cards_read() const {
+                return read;
+            }
+        } ;
+    }
+
+    void
+    card_store::load_database() {
+        if (exists(store_path)) {
+            store_lock lock(store_path, false);
+            open(false);
+        }
+        card_observer * outer = observer;
+        optional<catalog_order> order;
+        if (outer)
+            observer = &order.emplace(*outer);
+        try {
+            load_catalog();
+        }
+        catch (...) {
+            observer = outer;
+            throw;
+        }
+        observer = outer;
+
+        lock_guard<mutex> guard(writing);
+        shared_ptr<store_snapshot> loaded(new store_snapshot);
+        loaded->version = sequence;
+        if (changes.empty()) {
+            loaded->cards = move(cards);
+        }
+        else {
+            vector<const change *> applied;
+            for (auto && c : changes)
+                applied.push_back(&c.second);
+            vector<uint32_t> positions;
+            loaded->cards = apply(cards, applied, &positions);
+            if (outer) {
+                // Cards of the store follow those read from the catalog.
+                vector<Card> added;
+                vector<uint32_t> read_order;
+                for (size_t pos = 0; pos < positions.size(); ++pos) {
+                    if (positions[pos] < cards.size()) {
+                        read_order.push_back(order->read_order[positions[pos]]);
+                        continue;
+                    }
+                    read_order.push_back(static_cast<uint32_t> (order->cards_read() + added.size()));
+                    added.push_back(loaded->cards[pos]);
+                }
+                outer->cards_built(order->cards_read(), added);
+                outer->cards_loaded(read_order);
+            }
+            vector<Card>().swap(cards);
+        }
+        if (outer && changes.empty())
+            outer->cards_loaded(order->read_order);
+        publish(move(loaded));
+        was_db_loaded = true;
+        report_unknown(cerr);
+    }
+
+    void
+    card_store::load_image(shared_ptr<const engine_image> image_) {
+        startup_phase phase("attach image");
+        image = move(image_);
+        define_vocabulary();
+        lock_guard<mutex> guard(writing);
+        shared_ptr<store_snapshot> loaded(new store_snapshot);
+        loaded->cards = image->cards();
+        publish(move(loaded));
+        was_db_loaded = true;
+    }
+
+    vector<card_update>
+    card_store::upsert(string_view key, string_view text) {
+        lock_guard<mutex> guard(writing);
+        change c{0, string(key), string(text)};
+        // An empty text marks a delete.
+        if (text.empty())
+            throw runtime_error("Card " + c.key + " is not valid.");
+        card_of(c);
+        vector<change> batch;
+        batch.push_back(move(c));
+        return append(move(batch));
+    }
+
+    vector<card_update>
+    card_store::upsert(const vector<pair<string_view, string_view> > & records) {
+        lock_guard<mutex> guard(writing);
+        vector<change> batch;
+        for (auto && record : records) {
+            change c{0, string(record.first), string(record.second)};
+            if (c.text.empty())
+                throw runtime_error("Card " + c.key + " is not valid.");
+            card_of(c);
+            batch.push_back(move(c));
+        }
+        if (batch.empty())
+            return {};
+        return append(move(batch));
+    }
+
+    vector<card_update>
+    card_store::remove(string_view key) {
+        lock_guard<mutex> guard(writing);
+        vector<change> batch;
+        batch.push_back(change{0, string(key), string()});
+        return append(move(batch));
+    }
+
+    void
+    card_store::compact() {
+        lock_guard<mutex> guard(writing);
+        if (!exists(store_path))
+            return;
+        store_lock lock(store_path, true);
+        if (state() != read_state)
+            open(true);
+        compact_locked();
+    }
+
+    /*
+     * Changes of other processes are read again under the lock (see
+     * state()), so the sequence and the published cards include them.
+     */
+    vector<card_update>
+    card_store::append(vector<change> && batch) {
+        // Other processes share the cards, they are changed only when loaded.
+        if (image)
+            throw runtime_error("Cards of an engine image cannot be changed.");
+        store_lock lock(store_path, true);
+        if (state() != read_state)
+            open(true);
+        if (!exists(store_path + "/MANIFEST"))
+            write_manifest(log_id, segments);
+        string bytes;
+        for (change & c : batch) {
+            c.sequence = ++sequence;
+            encode(bytes, c.sequence, c.key, c.text);
+        }
+        string log = file("log", log_id);
+        int fd = ::open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw runtime_error("File " + log + " cannot be opened: " + strerror(errno) + ".");
+        struct stat st;
+        bool created = fstat(fd, &st) == 0 && st.st_size == 0;
+        write_all(fd, bytes, log);
+        if (fdatasync(fd) != 0) {
+            int error = errno;
+            close(fd);
+            throw runtime_error("File " + log + " could not be synced: " + strerror(error) + ".");
+        }
+        close(fd);
+        if (created)
+            sync_directory(store_path);
+        for (const change & c : batch) {
+            changes[c.key] = c;
+            logged[c.key] = c;
+            ++log_size;
+        }
+        if (log_size >= compaction_threshold)
+            compact_locked();
+        read_state = state();
+        if (!current)
+            return {};
+
+        // Cards are copied once for the batch. The card of the key is
+        // replaced in place, further ones of its name are removed, a new
+        // one goes to the end.
+        shared_ptr<store_snapshot> changed(new store_snapshot(*current));
+        changed->version = sequence;
+        vector<card_update> updates;
+        for (const change & applied : batch) {
+            bool replaced = false;
+            for (size_t pos = 0; pos < changed->cards.size(); ++pos) {
+                if (changed->is_removed(pos) || changed->cards[pos].get_name() != applied.key)
+                    continue;
+                if (!replaced && !applied.text.empty()) {
+                    changed->cards[pos] = card_of(applied);
+                    updates.push_back({update_kind::replaced, pos});
+                    replaced = true;
+                    continue;
+                }
+                changed->removed.resize(changed->cards.size());
+                changed->removed[pos] = true;
+                updates.push_back({update_kind::removed, pos});
+            }
+            if (!replaced && !applied.text.empty()) {
+                changed->cards.push_back(card_of(applied));
+                updates.push_back({update_kind::added, changed->cards.size() - 1});
+            }
+        }
+        publish(move(changed));
+        return updates;
+    }
+
+    void
+    card_store::publish(shared_ptr<const store_snapshot> snapshot_) {
+        // The former snapshot is freed by the exchange, after get_cards
+        // turned to the new one.
+        published.store(snapshot_.get(), memory_order_release);
+        atomic_store(&current, move(snapshot_));
+    }
+
+    /*
+     * The log becomes the newest segment, or all changes become the only one
+     * when there would be too many. Files the new manifest does not name are
+     * deleted after it is written.
+     */
+    void
+    card_store::compact_locked() {
+        if (logged.empty())
+            return;
+        bool merging = segments.size() + 1 > max_segments;
+        vector<uint64_t> kept;
+        if (!merging)
+            kept = segments;
+        kept.push_back(log_id);
+        string bytes(segment_magic, sizeof (segment_magic));
+        for (auto && c : merging ? changes : logged)
+            encode(bytes, c.second.sequence, c.second.key, c.second.text);
+        write_durably(store_path, file("segment", log_id), bytes);
+        write_manifest(log_id + 1, kept);
+        unlink(file("log", log_id).c_str());
+        for (uint64_t id : segments) {
+            if (find(begin(kept), end(kept), id) == end(kept))
+                unlink(file("segment", id).c_str());
+        }
+        segments = kept;
+        ++log_id;
+        logged.clear();
+        log_size = 0;
+        read_state = state();
+    }
+
+    shared_ptr<const store_snapshot>
+    card_store::snapshot() const {
+        if (!was_db_loaded)
+            throw bad_optional_access(db_not_loaded);
+        return atomic_load(&current);
+    }
+
+    const vector<Card> &
+    card_store::get_cards() const {
+        if (!was_db_loaded)
+            throw bad_optional_access(db_not_loaded);
+        return published.load(memory_order_acquire)->cards;
+    }
+
+    uint64_t
+    card_store::get_version() const {
+        return snapshot()->version;
+    }
+
+    size_t
+    card_store::changed_keys() const {
+        lock_guard<mutex> guard(writing);
+        return changes.size();
+    }
+
+    bool
+    card_store::is_used() const {
+        return exists(store_path);
+    }
+}
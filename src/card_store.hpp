@@ -0,0 +1,222 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   card_store.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 20, 2026, 1:05 AM
+ */
+
+#ifndef CARD_STORE_HPP
+#define CARD_STORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "src/database.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * Cards of the catalog at one version of the store, it does not change.
+     */
+    struct store_snapshot {
+        // Sequence number of the last change applied.
+        uint64_t version = 0;
+        std::vector<Card> cards;
+        // Cards deleted since loading (their positions are kept), if any.
+        std::vector<bool> removed;
+
+        store_snapshot() = default;
+        // Changes copy the published snapshot.
+        store_snapshot(const store_snapshot &);
+
+        bool
+        is_removed(size_t pos) const {
+            return pos < removed.size() && removed[pos];
+        }
+    } ;
+
+    /*
+     * Custom and playtest cards kept on disk between drops of the catalog:
+     * upserts and deletes of cards by key (the name of a card, as in
+     * AllCards.json) applied over the JSON catalog.
+     *
+     * The store is a directory next to the catalog. A change is appended to
+     * the log and synced before it returns. Once the log holds
+     * compaction_threshold changes, they are written as a segment sorted by
+     * key, and more than max_segments segments are merged into one.
+     * MANIFEST names the segments and the log and is replaced by rename, so
+     * a crash leaves either the old or the new set of files; a change torn
+     * by a crash fails its checksum and is cut off the log.
+     *
+     * Cards of the store are published as snapshots: get_cards() gives those
+     * of the latest one, a reader holding snapshot() keeps its version while
+     * changes are made. Loading puts cards in order of keys, a change after
+     * it keeps positions of other cards (see card_update), so that indexes
+     * can follow it, and a process sees changes of other processes once it
+     * loads again. Processes writing the store take its lock in turn, a
+     * loading one waits for them.
+     */
+    class card_store : public JSONDatabase {
+    public:
+        static constexpr size_t compaction_threshold = 1024;
+        static constexpr size_t max_segments = 4;
+
+    private:
+        // A change in the log or in a segment, text is empty for a delete.
+        struct change {
+            uint64_t sequence;
+            std::string key;
+            std::string text;
+        } ;
+
+        class store_lock;
+
+        std::string store_path;
+        mutable std::mutex writing;
+        std::shared_ptr<const store_snapshot> current;
+        // Snapshot held by current, read by get_cards without reference
+        // counting; it lives until current is replaced.
+        std::atomic<const store_snapshot *> published{nullptr};
+        // Latest change of each key in the segments and the log.
+        std::map<std::string, change, std::less<> > changes;
+        // Changes in the log, written to the next segment.
+        std::map<std::string, change, std::less<> > logged;
+        std::vector<uint64_t> segments;
+        uint64_t log_id;
+        size_t log_size; // Changes in the log.
+        uint64_t sequence;
+        // Of the files when they were read, empty if they must be read again.
+        std::string read_state;
+
+        // Reads the manifest, segments and the log, repairs a torn log.
+        void
+        open(bool repair);
+
+        std::string
+        state() const;
+
+        /*
+         * Appends changes to the log, synced once for all of them, returns
+         * their updates of published cards.
+         */
+        std::vector<card_update>
+        append(std::vector<change> && batch);
+
+        // Makes snapshot the current one.
+        void
+        publish(std::shared_ptr<const store_snapshot> snapshot_);
+
+        void
+        compact_locked();
+
+        void
+        write_manifest(uint64_t log_id_, const std::vector<uint64_t> & segments_) const;
+
+        std::string
+        file(const std::string & name, uint64_t id) const;
+
+        /*
+         * Cards (sorted by key) with changes applied: a change of a key
+         * takes the place of the cards of its name, new keys are inserted
+         * in order. Positions in base of cards of the result (base.size()
+         * + i for applied[i]) are stored to positions.
+         */
+        std::vector<Card>
+        apply(const std::vector<Card> & base, const std::vector<const change *> & applied,
+                std::vector<uint32_t> * positions = nullptr);
+
+        Card
+        card_of(const change & c);
+
+    public:
+        // The store is at store_path_, it is created by the first change.
+        card_store(const std::string & path_, const std::string & store_path_);
+
+        ~card_store();
+
+        // Loads the catalog and applies changes of the store to it.
+        void
+        load_database() override;
+
+        // Only for an unused store, whose cards are those of the catalog.
+        void
+        load_image(std::shared_ptr<const engine_image> image_) override;
+
+        /*
+         * Inserts or replaces the card of key, text is its record as in
+         * AllCards.json ("key": {...}). Returns how cards of get_cards()
+         * changed, nothing before load_database. Throws runtime_error if the
+         * record is not valid or cannot be written, or cards are those of an
+         * engine image.
+         */
+        std::vector<card_update>
+        upsert(std::string_view key, std::string_view text);
+
+        /*
+         * Upserts records (key and text as above) as one change of cards, so
+         * they are synced and published once. Nothing is written if any of
+         * them is not valid.
+         */
+        std::vector<card_update>
+        upsert(const std::vector<std::pair<std::string_view, std::string_view> > & records);
+
+        // Deletes the card of key, also a card of the catalog.
+        std::vector<card_update>
+        remove(std::string_view key);
+
+        // Writes the log to a segment now.
+        void
+        compact();
+
+        // Cards of the version last published.
+        std::shared_ptr<const store_snapshot>
+        snapshot() const;
+
+        // Valid until the next change, see snapshot().
+        const std::vector<Card> &
+        get_cards() const override;
+
+        uint64_t
+        get_version() const;
+
+        // Number of keys changed by the store.
+        size_t
+        changed_keys() const;
+
+        // Whether the store was created, i.e. cards may differ from the catalog.
+        bool
+        is_used() const;
+    } ;
+}
+
+#endif /* CARD_STORE_HPP */
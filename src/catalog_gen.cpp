@@ -0,0 +1,339 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Generator of synthetic catalogs in the schema of AllCards.json for
+ * measuring how loading, indexing and searching scale. Distributions are
+ * learned from a real catalog:
+ *  - every card follows a random real card (template), whose layout,
+ *    types, supertypes, colors, loyalty, hand and life it takes, so the
+ *    joint distribution of these fields is kept,
+ *  - subtypes and power/toughness are taken from a random card with the
+ *    same types, the mana cost from a random card with the same colors,
+ *  - the rules text is generated by a word bigram chain of all texts and
+ *    has the length of the template's text,
+ *  - names are made of words of real names.
+ * Values thus always belong to the vocabulary JSONDatabase knows.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "src/json.hpp"
+#include "../docopt.cpp/docopt.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+static const char USAGE[] =
+        R"(Synthetic card catalog for scale testing.
+
+    Usage:
+      catalog_gen <scale> [--source=<file>] [--seed=<s>] [--output=<file>]
+      catalog_gen (-h | --help)
+
+    Options:
+      <scale>           Number of cards relative to the source catalog (e.g. 10, 1000, 0.5).
+      --source=<file>   Catalog the distributions are learned from [default: ./src/AllCards.json].
+      --seed=<s>        Seed of the generator [default: 1].
+      --output=<file>   Output file instead of the standard output.
+      -h --help         Show this screen.
+)";
+
+/*
+ * First order Markov chain over words of rules texts. Line breaks are
+ * words too, so texts keep their structure of abilities.
+ */
+class text_chain {
+private:
+    std::vector<std::string> words;
+    std::unordered_map<std::string, uint32_t> ids;
+    // Successors with repetitions, i.e. with their frequencies.
+    std::vector<std::vector<uint32_t> > successors;
+    std::vector<uint32_t> starts;
+
+public:
+
+    ~text_chain();
+
+    void
+    learn(const std::string & text) {
+        vector<uint32_t> tokens = split(text);
+        if (tokens.empty())
+            return;
+        starts.push_back(tokens[0]);
+        for (size_t i = 1; i < tokens.size(); ++i)
+            successors[tokens[i - 1]].push_back(tokens[i]);
+    }
+
+    std::string
+    generate(size_t length, mt19937_64 & rng) const {
+        string res;
+        if (starts.empty())
+            return res;
+        uint32_t word = starts[rng() % starts.size()];
+        for (size_t i = 0; i < length; ++i) {
+            if (i != 0 && words[word] != "\n" && res.back() != '\n')
+                res += ' ';
+            res += words[word];
+            const vector<uint32_t> & next = successors[word];
+            word = next.empty() ? starts[rng() % starts.size()] : next[rng() % next.size()];
+        }
+        // Texts do not end by a line break.
+        while (!res.empty() && res.back() == '\n')
+            res.pop_back();
+        return res;
+    }
+
+    static size_t
+    length(const std::string & text) {
+        size_t res = 0;
+        istringstream is(text);
+        string line;
+        while (getline(is, line)) {
+            istringstream ls(line);
+            string word;
+            while (ls >> word)
+                ++res;
+            ++res;
+        }
+        return res == 0 ? 0 : res - 1;
+    }
+
+private:
+
+    std::vector<uint32_t>
+    split(const std::string & text) {
+        vector<uint32_t> res;
+        istringstream is(text);
+        string line;
+        bool first = true;
+        while (getline(is, line)) {
+            if (!first)
+                res.push_back(id("\n"));
+            first = false;
+            istringstream ls(line);
+            string word;
+            while (ls >> word)
+                res.push_back(id(word));
+        }
+        return res;
+    }
+
+    uint32_t
+    id(const std::string & word) {
+        auto it = ids.find(word);
+        if (it != ids.end())
+            return it->second;
+        uint32_t res = static_cast<uint32_t> (words.size());
+        ids[word] = res;
+        words.push_back(word);
+        successors.emplace_back();
+        return res;
+    }
+} ;
+
+text_chain::~text_chain() = default;
+
+static string
+key_of(const json & record, const string & field) {
+    string res;
+    if (record.find(field) != record.end()) {
+        for (const json & value : record[field])
+            res += value.get<string>() + ",";
+    }
+    return res;
+}
+
+/*
+ * Converted mana cost of a "{2}{W}{U/B}"-like cost: numbers count by their
+ * value, X by zero and every other symbol by one.
+ */
+static int
+converted_cost(const string & cost) {
+    int res = 0;
+    size_t i = 0;
+    while ((i = cost.find('{', i)) != string::npos) {
+        size_t end = cost.find('}', i);
+        string symbol = cost.substr(i + 1, end - i - 1);
+        if (!symbol.empty() && isdigit(static_cast<unsigned char> (symbol[0])) && symbol.find('/') == string::npos)
+            res += stoi(symbol);
+        else if (symbol != "X" && symbol != "Y" && symbol != "Z")
+            res += 1;
+        i = end;
+    }
+    return res;
+}
+
+static string
+type_line(const json & card) {
+    string res;
+    for (const char * field : {"supertypes", "types"}) {
+        if (card.find(field) != card.end()) {
+            for (const json & value : card[field])
+                res += (res.empty() ? "" : " ") + value.get<string>();
+        }
+    }
+    if (card.find("subtypes") != card.end() && !card["subtypes"].empty()) {
+        res += " —";
+        for (const json & value : card["subtypes"])
+            res += " " + value.get<string>();
+    }
+    return res;
+}
+
+int
+main(int argc, char * argv[]) {
+    map<string, docopt::value> args = docopt::docopt(USAGE,{argv + 1, argv + argc}, true);
+    double scale;
+    uint64_t seed;
+    try {
+        scale = stod(args["<scale>"].asString());
+        seed = args["--seed"] ? stoull(args["--seed"].asString()) : 1;
+    }
+    catch (...) {
+        cout << USAGE << endl;
+        return 1;
+    }
+    string source = args["--source"] ? args["--source"].asString() : "./src/AllCards.json";
+
+    vector<json> records;
+    {
+        ifstream ifs{source};
+        if (!ifs) {
+            cerr << "Source catalog " << source << " cannot be read." << endl;
+            return 1;
+        }
+        json data = json::parse(ifs);
+        for (auto && record : data)
+            records.push_back(record);
+    }
+    if (records.empty() || scale <= 0) {
+        cout << USAGE << endl;
+        return 1;
+    }
+
+    // Positions of records by the conditioning fields.
+    unordered_map<string, vector<size_t> > by_types, by_colors, with_pt_by_types;
+    text_chain chain;
+    vector<string> name_words;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const json & record = records[i];
+        by_types[key_of(record, "types")].push_back(i);
+        by_colors[key_of(record, "colors")].push_back(i);
+        if (record.find("power") != record.end() && record.find("toughness") != record.end())
+            with_pt_by_types[key_of(record, "types")].push_back(i);
+        if (record.find("text") != record.end())
+            chain.learn(record["text"]);
+        istringstream name(record.value("name", string()));
+        string word;
+        while (name >> word) {
+            // Separators of split cards ("Fire // Ice") are not words.
+            if (any_of(begin(word), end(word), [](char c) {
+                    return isalpha(static_cast<unsigned char> (c)); }))
+                name_words.push_back(word);
+        }
+    }
+    if (name_words.empty()) {
+        cerr << "Source catalog " << source << " has no named cards." << endl;
+        return 1;
+    }
+
+    ofstream ofs;
+    if (args["--output"])
+        ofs.open(args["--output"].asString());
+    ostream & os = args["--output"] ? ofs : cout;
+
+    mt19937_64 rng(seed);
+    // An empty pool falls back to all records.
+    auto && pick = [&rng, &records](const vector<size_t> & pool) {
+        return pool.empty() ? rng() % records.size() : pool[rng() % pool.size()];
+    };
+    size_t count = static_cast<size_t> (static_cast<double> (records.size()) * scale);
+    unordered_set<string> names;
+    size_t serial = 0;
+    auto && new_name = [&]() {
+        for (size_t attempt = 0;; ++attempt) {
+            size_t words = 1 + rng() % 3;
+            string name;
+            for (size_t w = 0; w < words; ++w)
+                name += (w == 0 ? "" : " ") + name_words[rng() % name_words.size()];
+            // Large catalogs or few name words exhaust combinations, a number distinguishes them.
+            if (names.size() > records.size() || attempt >= 8)
+                name += " " + to_string(serial++);
+            if (names.insert(name).second)
+                return name;
+        }
+    };
+
+    // Cards are written one by one, only their names are kept to tell them apart.
+    os << "{";
+    for (size_t i = 0; i < count; ++i) {
+        const json & tmpl = records[rng() % records.size()];
+        json card;
+        string name = new_name();
+        card["name"] = name;
+        for (const char * field : {"layout", "supertypes", "types", "colors", "loyalty", "hand", "life"}) {
+            if (tmpl.find(field) != tmpl.end())
+                card[field] = tmpl[field];
+        }
+        if (tmpl.find("names") != tmpl.end())
+            card["names"] = {name, new_name()};
+
+        const json & same_types = records[pick(by_types[key_of(tmpl, "types")])];
+        if (same_types.find("subtypes") != same_types.end())
+            card["subtypes"] = same_types["subtypes"];
+        if (tmpl.find("power") != tmpl.end()) {
+            const json & pt = records[pick(with_pt_by_types[key_of(tmpl, "types")])];
+            for (const char * field : {"power", "toughness"}) {
+                if (pt.find(field) != pt.end())
+                    card[field] = pt[field];
+            }
+        }
+        const json & same_colors = records[pick(by_colors[key_of(tmpl, "colors")])];
+        if (same_colors.find("manaCost") != same_colors.end()) {
+            card["manaCost"] = same_colors["manaCost"];
+            card["cmc"] = converted_cost(same_colors["manaCost"]);
+        }
+        if (tmpl.find("text") != tmpl.end())
+            card["text"] = chain.generate(text_chain::length(tmpl["text"]), rng);
+        card["type"] = type_line(card);
+
+        os << (i == 0 ? "\n" : ",\n") << json(name).dump() << ": " << card.dump();
+    }
+    os << "\n}" << endl;
+    if (!os) {
+        cerr << "Catalog could not be written." << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -22,19 +22,47 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <iostream>
-#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <string>
 #include <vector>
 #include <exception>
-#include <unordered_map>
+#include <optional>
+#include <thread>
 #include <unordered_set>
+#include <unistd.h>
 #include "src/database.hpp"
+#include "src/bounded_queue.hpp"
 #include "src/card.hpp"
-#include "src/json.hpp"
+#include "src/card_reader.hpp"
+#include "src/engine_image.hpp"
+#include "src/mapped_file.hpp"
+#include "src/zip_input.hpp"
+#include "src/profiling.hpp"
+#include "src/tracing.hpp"
+#include "src/sampler.hpp"
 
 namespace magicSearchEngine {
-    using json = nlohmann::json;
+
+    /*
+     * AllCards.json is distributed zipped, the archive is read if there is
+     * no unzipped file.
+     */
+    static std::string
+    existing_data(const std::string & path) {
+        if (access(path.c_str(), F_OK) != 0 && access((path + ".zip").c_str(), F_OK) == 0)
+            return path + ".zip";
+        return path;
+    }
+
+    JSONDatabase::JSONDatabase(const std::string & path_) : path(existing_data(path_)) {
+    }
 
     /*
      * Only definitions of member functions of the JSON
@@ -42,497 +70,36 @@ namespace magicSearchEngine {
      */
 
     /*
-     * This instantiates maps which serve as a databases of types,
-     * where all card members have pointers to strings in these maps.
-     * Motivation: space efficiency, fast lookup, simple outputting
-     * of type's string representation.
-     * 
-     * All know -types, colors etc. you can find in comprehensive rules at:
+     * This instantiates sets of keywords, types of cards are interned in the
+     * vocabulary (see vocabulary.cpp). Values of cards which are not there
+     * (e.g. a creature type of a new set) are added to the vocabulary while
+     * loading and reported on std::cerr.
+     *
+     * All know keywords you can find in comprehensive rules at:
      * http://magic.wizards.com/en/game-info/gameplay/rules-and-formats/rules
      */
     void
     JSONDatabase::load_database() {
-        std::ifstream ifs{"./src/AllCards.json"};
-        json data = json::parse(ifs);
-        // <editor-fold defaultstate="collapsed" desc="types instantiation">
-        types["General"] = "General";
-        types["Artifact"] = "Artifact";
-        types["Creature"] = "Creature";
-        types["Eaturecray"] = "Eaturecray"; // not in rules, special card
-        types["Enchantment"] = "Enchantment";
-        types["Enchant"] = "Enchant";
-        types["Instant"] = "Instant";
-        types["Land"] = "Land";
-        types["Planeswalker"] = "Planeswalker";
-        types["Sorcery"] = "Sorcery";
-        types["Tribal"] = "Tribal";
-        types["Plane"] = "Plane";
-        types["Player"] = "Player";
-        types["Phenomenon"] = "Phenomenon";
-        types["Vanguard"] = "Vanguard";
-        types["Scheme"] = "Scheme";
-        types["Conspiracy"] = "Conspiracy";
-        types["Scariest"] = "Scariest"; // Because of Big Furry Monster:
-        types["You'll"] = "You'll";     // The Scariest Creature You'll Ever See
-        types["See"] = "See";
-        types["Ever"] = "Ever";
-        // </editor-fold>
-        // <editor-fold defaultstate="collapsed" desc="subtypes instantiation">
-        // eaturecray
-        subtypes["Igpay"] = "Igpay"; // not in rules, special card
-        // artifact
-        subtypes["Clue"] = "Clue";
-        subtypes["Contraption"] = "Contraption";
-        subtypes["Equipment"] = "Equipment";
-        subtypes["Fortification"] = "Fortification";
-        subtypes["Vehicle"] = "Vehicle";
-        // enchantements
-        subtypes["Aura"] = "Aura";
-        subtypes["Curse"] = "Curse";
-        subtypes["Shrine"] = "Shrine";
-        // land
-        subtypes["Desert"] = "Desert";
-        subtypes["Forest"] = "Forest";
-        subtypes["Gate"] = "Gate";
-        subtypes["Island"] = "Island";
-        subtypes["Lair"] = "Lair";
-        subtypes["Locus"] = "Locus";
-        subtypes["Mine"] = "Mine";
-        subtypes["Mountain"] = "Mountain";
-        subtypes["Plains"] = "Plains";
-        subtypes["Power-Plant"] = "Power-Plant";
-        subtypes["Swamp"] = "Swamp";
-        subtypes["Tower"] = "Tower";
-        subtypes["Urza’s"] = "Urza’s";
-        // planeswolkers
-        subtypes["Ajani"] = "Ajani";
-        subtypes["Arlinn"] = "Arlinn";
-        subtypes["Ashiok"] = "Ashiok";
-        subtypes["Bolas"] = "Bolas";
-        subtypes["Chandra"] = "Chandra";
-        subtypes["Dack"] = "Dack";
-        subtypes["Daretti"] = "Daretti";
-        subtypes["Domri"] = "Domri";
-        subtypes["Dovin"] = "Dovin";
-        subtypes["Elspeth"] = "Elspeth";
-        subtypes["Freyalise"] = "Freyalise";
-        subtypes["Garruk"] = "Garruk";
-        subtypes["Gideon"] = "Gideon";
-        subtypes["Jace"] = "Jace";
-        subtypes["Karn"] = "Karn";
-        subtypes["Kaya"] = "Kaya";
-        subtypes["Kiora"] = "Kiora";
-        subtypes["Koth"] = "Koth";
-        subtypes["Liliana"] = "Liliana";
-        subtypes["Nahiri"] = "Nahiri";
-        subtypes["Narset"] = "Narset";
-        subtypes["Nissa"] = "Nissa";
-        subtypes["Nixilis"] = "Nixilis";
-        subtypes["Ral"] = "Ral";
-        subtypes["Saheeli"] = "Saheeli";
-        subtypes["Sarkhan"] = "Sarkhan";
-        subtypes["Sorin"] = "Sorin";
-        subtypes["Tamiyo"] = "Tamiyo";
-        subtypes["Teferi"] = "Teferi";
-        subtypes["Tezzeret"] = "Tezzeret";
-        subtypes["Tibalt"] = "Tibalt";
-        subtypes["Ugin"] = "Ugin";
-        subtypes["Venser"] = "Venser";
-        subtypes["Vraska"] = "Vraska";
-        subtypes["Xenagos"] = "Xenagos";
-        // instants
-        subtypes["Arcane"] = "Arcane";
-        subtypes["Trap"] = "Trap";
-        // creatures
-        subtypes["Advisor"] = "Advisor";
-        subtypes["Aetherborn"] = "Aetherborn";
-        subtypes["Ally"] = "Ally";
-        subtypes["Angel"] = "Angel";
-        subtypes["Antelope"] = "Antelope";
-        subtypes["Ape"] = "Ape";
-        subtypes["Archer"] = "Archer";
-        subtypes["Archon"] = "Archon";
-        subtypes["Artificer"] = "Artificer";
-        subtypes["Assassin"] = "Assassin";
-        subtypes["Assembly-Worker"] = "Assembly worker";
-        subtypes["Atog"] = "Atog";
-        subtypes["Aurochs"] = "Aurochs";
-        subtypes["Avatar"] = "Avatar";
-        subtypes["Badger"] = "Badger";
-        subtypes["Barbarian"] = "Barbarian";
-        subtypes["Basilisk"] = "Basilisk";
-        subtypes["Bat"] = "Bat";
-        subtypes["Bear"] = "Bear";
-        subtypes["Beast"] = "Beast";
-        subtypes["Beeble"] = "Beeble";
-        subtypes["Berserker"] = "Berserker";
-        subtypes["Bird"] = "Bird";
-        subtypes["Blinkmoth"] = "Blinkmoth";
-        subtypes["Boar"] = "Boar";
-        subtypes["Bringer"] = "Bringer";
-        subtypes["Brushwagg"] = "Brushwagg";
-        subtypes["Bureaucrat"] = "Bureaucrat";
-        subtypes["Camarid"] = "Camarid";
-        subtypes["Camel"] = "Camel";
-        subtypes["Caribou"] = "Caribou";
-        subtypes["Carrier"] = "Carrier";
-        subtypes["Cat"] = "Cat";
-        subtypes["Centaur"] = "Centaur";
-        subtypes["Cephalid"] = "Cephalid";
-        subtypes["Chicken"] = "Chicken";
-        subtypes["Child"] = "Child";
-        subtypes["Chimera"] = "Chimera";
-        subtypes["Citizen"] = "Citizen";
-        subtypes["Clamfolk"] = "Clamfolk";
-        subtypes["Cleric"] = "Cleric";
-        subtypes["Cockatrice"] = "Cockatrice";
-        subtypes["Construct"] = "Construct";
-        subtypes["Coward"] = "Coward";
-        subtypes["Cow"] = "Cow";
-        subtypes["Crab"] = "Crab";
-        subtypes["Crocodile"] = "Crocodile";
-        subtypes["Cyclops"] = "Cyclops";
-        subtypes["Dauthi"] = "Dauthi";
-        subtypes["Dinosaur"] = "Dinosaur";
-        subtypes["Demon"] = "Demon";
-        subtypes["Deserter"] = "Deserter";
-        subtypes["Designer"] = "Designer";
-        subtypes["Devil"] = "Devil";
-        subtypes["Djinn"] = "Djinn";
-        subtypes["Donkey"] = "Donkey";
-        subtypes["Dragon"] = "Dragon";
-        subtypes["Drake"] = "Drake";
-        subtypes["Dreadnought"] = "Dreadnought";
-        subtypes["Drone"] = "Drone";
-        subtypes["Druid"] = "Druid";
-        subtypes["Dryad"] = "Dryad";
-        subtypes["Dwarf"] = "Dwarf";
-        subtypes["Egg"] = "Egg";
-        subtypes["Efreet"] = "Efreet";
-        subtypes["Elder"] = "Elder";
-        subtypes["Eldrazi"] = "Eldrazi";
-        subtypes["Elemental"] = "Elemental";
-        subtypes["Elephant"] = "Elephant";
-        subtypes["Elf"] = "Elf";
-        subtypes["Elk"] = "Elk";
-        subtypes["Elves"] = "Elves";
-        subtypes["Eye"] = "Eye";
-        subtypes["Faerie"] = "Faerie";
-        subtypes["Ferret"] = "Ferret";
-        subtypes["Fish"] = "Fish";
-        subtypes["Flagbearer"] = "Flagbearer";
-        subtypes["Fox"] = "Fox";
-        subtypes["Frog"] = "Frog";
-        subtypes["Fungus"] = "Fungus";
-        subtypes["Gamer"] = "Gamer";
-        subtypes["Gargoyle"] = "Gargoyle";
-        subtypes["Germ"] = "Germ";
-        subtypes["Giant"] = "Giant";
-        subtypes["Gnome"] = "Gnome";
-        subtypes["Goat"] = "Goat";
-        subtypes["Goblin"] = "Goblin";
-        subtypes["Goblins"] = "Goblins";
-        subtypes["God"] = "God";
-        subtypes["Golem"] = "Golem";
-        subtypes["Gorgon"] = "Gorgon";
-        subtypes["Graveborn"] = "Graveborn";
-        subtypes["Gremlin"] = "Gremlin";
-        subtypes["Griffin"] = "Griffin";
-        subtypes["Gus"] = "Gus";
-        subtypes["Hag"] = "Hag";
-        subtypes["Harpy"] = "Harpy";
-        subtypes["Hellion"] = "Hellion";
-        subtypes["Hero"] = "Hero";
-        subtypes["Hippo"] = "Hippo";
-        subtypes["Hippogriff"] = "Hippogriff";
-        subtypes["Homarid"] = "Homarid";
-        subtypes["Homunculus"] = "Homunculus";
-        subtypes["Horror"] = "Horror";
-        subtypes["Horse"] = "Horse";
-        subtypes["Hound"] = "Hound";
-        subtypes["Human"] = "Human";
-        subtypes["Hydra"] = "Hydra";
-        subtypes["Hyena"] = "Hyena";
-        subtypes["Illusion"] = "Illusion";
-        subtypes["Imp"] = "Imp";
-        subtypes["Incarnation"] = "Incarnation";
-        subtypes["Insect"] = "Insect";
-        subtypes["Jellyfish"] = "Jellyfish";
-        subtypes["Juggernaut"] = "Juggernaut";
-        subtypes["Kavu"] = "Kavu";
-        subtypes["Kirin"] = "Kirin";
-        subtypes["Kithkin"] = "Kithkin";
-        subtypes["Knight"] = "Knight";
-        subtypes["Kobold"] = "Kobold";
-        subtypes["Kor"] = "Kor";
-        subtypes["Kraken"] = "Kraken";
-        subtypes["Lamia"] = "Lamia";
-        subtypes["Lammasu"] = "Lammasu";
-        subtypes["Leech"] = "Leech";
-        subtypes["Leviathan"] = "Leviathan";
-        subtypes["Lhurgoyf"] = "Lhurgoyf";
-        subtypes["Licid"] = "Licid";
-        subtypes["Lizard"] = "Lizard";
-        subtypes["Lord"] = "Lord";
-        subtypes["Manticore"] = "Manticore";
-        subtypes["Masticore"] = "Masticore";
-        subtypes["Mercenary"] = "Mercenary";
-        subtypes["Merfolk"] = "Merfolk";
-        subtypes["Metathran"] = "Metathran";
-        subtypes["Minion"] = "Minion";
-        subtypes["Minotaur"] = "Minotaur";
-        subtypes["Mime"] = "Mime";
-        subtypes["Mole"] = "Mole";
-        subtypes["Monger"] = "Monger";
-        subtypes["Mongoose"] = "Mongoose";
-        subtypes["Monk"] = "Monk";
-        subtypes["Monkey"] = "Monkey";
-        subtypes["Moonfolk"] = "Moonfolk";
-        subtypes["Mummy"] = "Mummy";
-        subtypes["Mutant"] = "Mutant";
-        subtypes["Myr"] = "Myr";
-        subtypes["Mystic"] = "Mystic";
-        subtypes["Naga"] = "Naga";
-        subtypes["Nautilus"] = "Nautilus";
-        subtypes["Nephilim"] = "Nephilim";
-        subtypes["Nightmare"] = "Nightmare";
-        subtypes["Nightstalker"] = "Nightstalker";
-        subtypes["Ninja"] = "Ninja";
-        subtypes["Noggle"] = "Noggle";
-        subtypes["Nomad"] = "Nomad";
-        subtypes["Nymph"] = "Nymph";
-        subtypes["Octopus"] = "Octopus";
-        subtypes["Ogre"] = "Ogre";
-        subtypes["Ooze"] = "Ooze";
-        subtypes["Orb"] = "Orb";
-        subtypes["Orc"] = "Orc";
-        subtypes["Orgg"] = "Orgg";
-        subtypes["Ouphe"] = "Ouphe";
-        subtypes["Ox"] = "Ox";
-        subtypes["Oyster"] = "Oyster";
-        subtypes["Paratrooper"] = "Paratrooper";
-        subtypes["Pegasus"] = "Pegasus";
-        subtypes["Pentavite"] = "Pentavite";
-        subtypes["Pest"] = "Pest";
-        subtypes["Phelddagrif"] = "Phelddagrif";
-        subtypes["Phoenix"] = "Phoenix";
-        subtypes["Pilot"] = "Pilot";
-        subtypes["Pincher"] = "Pincher";
-        subtypes["Pirate"] = "Pirate";
-        subtypes["Plant"] = "Plant";
-        subtypes["Praetor"] = "Praetor";
-        subtypes["Prism"] = "Prism";
-        subtypes["Processor"] = "Processor";
-        subtypes["Rabbit"] = "Rabbit";
-        subtypes["Rat"] = "Rat";
-        subtypes["Rebel"] = "Rebel";
-        subtypes["Reflection"] = "Reflection";
-        subtypes["Rhino"] = "Rhino";
-        subtypes["Rigger"] = "Rigger";
-        subtypes["Rogue"] = "Rogue";
-        subtypes["Sable"] = "Sable";
-        subtypes["Salamander"] = "Salamander";
-        subtypes["Samurai"] = "Samurai";
-        subtypes["Sand"] = "Sand";
-        subtypes["Saproling"] = "Saproling";
-        subtypes["Satyr"] = "Satyr";
-        subtypes["Scarecrow"] = "Scarecrow";
-        subtypes["Scion"] = "Scion";
-        subtypes["Scorpion"] = "Scorpion";
-        subtypes["Scout"] = "Scout";
-        subtypes["Serf"] = "Serf";
-        subtypes["Serpent"] = "Serpent";
-        subtypes["Servo"] = "Servo";
-        subtypes["Shade"] = "Shade";
-        subtypes["Shaman"] = "Shaman";
-        subtypes["Shapeshifter"] = "Shapeshifter";
-        subtypes["Sheep"] = "Sheep";
-        subtypes["Ship"] = "Ship";
-        subtypes["Siren"] = "Siren";
-        subtypes["Skeleton"] = "Skeleton";
-        subtypes["Slith"] = "Slith";
-        subtypes["Sliver"] = "Sliver";
-        subtypes["Slug"] = "Slug";
-        subtypes["Snake"] = "Snake";
-        subtypes["Soldier"] = "Soldier";
-        subtypes["Soltari"] = "Soltari";
-        subtypes["Spawn"] = "Spawn";
-        subtypes["Specter"] = "Specter";
-        subtypes["Spellshaper"] = "Spellshaper";
-        subtypes["Sphinx"] = "Sphinx";
-        subtypes["Spider"] = "Spider";
-        subtypes["Spike"] = "Spike";
-        subtypes["Spirit"] = "Spirit";
-        subtypes["Splinter"] = "Splinter";
-        subtypes["Sponge"] = "Sponge";
-        subtypes["Squid"] = "Squid";
-        subtypes["Squirrel"] = "Squirrel";
-        subtypes["Starfish"] = "Starfish";
-        subtypes["Surrakar"] = "Surrakar";
-        subtypes["Survivor"] = "Survivor";
-        subtypes["Tetravite"] = "Tetravite";
-        subtypes["Thalakos"] = "Thalakos";
-        subtypes["Thopter"] = "Thopter";
-        subtypes["Thrull"] = "Thrull";
-        subtypes["Townsfolk"] = "Townsfolk"; // not in rules, special card
-        subtypes["Treefolk"] = "Treefolk";
-        subtypes["Triskelavite"] = "Triskelavite";
-        subtypes["Troll"] = "Troll";
-        subtypes["Turtle"] = "Turtle";
-        subtypes["Unicorn"] = "Unicorn";
-        subtypes["Vampire"] = "Vampire";
-        subtypes["Vedalken"] = "Vedalken";
-        subtypes["Viashino"] = "Viashino";
-        subtypes["Volver"] = "Volver";
-        subtypes["Waiter"] = "Waiter";
-        subtypes["Wall"] = "Wall";
-        subtypes["Warrior"] = "Warrior";
-        subtypes["Weird"] = "Weird";
-        subtypes["Werewolf"] = "Werewolf";
-        subtypes["Whale"] = "Whale";
-        subtypes["Wizard"] = "Wizard";
-        subtypes["Wolf"] = "Wolf";
-        subtypes["Wolverine"] = "Wolverine";
-        subtypes["Wombat"] = "Wombat";
-        subtypes["Worm"] = "Worm";
-        subtypes["Wraith"] = "Wraith";
-        subtypes["Wurm"] = "Wurm";
-        subtypes["Yeti"] = "Yeti";
-        subtypes["Zombie"] = "Zombie";
-        subtypes["Zubera"] = "Zubera";
-        subtypes["Lady"] = "Lady";
-        subtypes["of"] = "of";
-        subtypes["Proper"] = "Proper";
-        subtypes["Etiquette"] = "Etiquette";
-        // planes
-        subtypes["Alara"] = "Alara";
-        subtypes["Arkhos"] = "Arkhos";
-        subtypes["Azgol"] = "Azgol";
-        subtypes["Belenon"] = "Belenon";
-        subtypes["Bolas’s Meditation Realm"] = "Bolas’s Meditation Realm";
-        subtypes["Dominaria"] = "Dominaria";
-        subtypes["Equilor"] = "Equilor";
-        subtypes["Ergamon"] = "Ergamon";
-        subtypes["Fabacin"] = "Fabacin";
-        subtypes["Innistrad"] = "Innistrad";
-        subtypes["Iquatana"] = "Iquatana";
-        subtypes["Ir"] = "Ir";
-        subtypes["Kaldheim"] = "Kaldheim";
-        subtypes["Kamigawa"] = "Kamigawa";
-        subtypes["Karsus"] = "Karsus";
-        subtypes["Kephalai"] = "Kephalai";
-        subtypes["Kinshala"] = "Kinshala";
-        subtypes["Kolbahan"] = "Kolbahan";
-        subtypes["Kyneth"] = "Kyneth";
-        subtypes["Lorwyn"] = "Lorwyn";
-        subtypes["Luvion"] = "Luvion";
-        subtypes["Mercadia"] = "Mercadia";
-        subtypes["Mirrodin"] = "Mirrodin";
-        subtypes["Moag"] = "Moag";
-        subtypes["Mongseng"] = "Mongseng";
-        subtypes["Muraganda"] = "Muraganda";
-        subtypes["New Phyrexia"] = "New Phyrexia";
-        subtypes["Phyrexia"] = "Phyrexia";
-        subtypes["Pyrulea"] = "Pyrulea";
-        subtypes["Rabiah"] = "Rabiah";
-        subtypes["Rath"] = "Rath";
-        subtypes["Ravnica"] = "Ravnica";
-        subtypes["Regatha"] = "Regatha";
-        subtypes["Segovia"] = "Segovia";
-        subtypes["Serra’s Realm"] = "Serra’s Realm";
-        subtypes["Shadowmoor"] = "Shadowmoor";
-        subtypes["Shandalar"] = "Shandalar";
-        subtypes["Ulgrotha"] = "Ulgrotha";
-        subtypes["Valla"] = "Valla";
-        subtypes["Vryn"] = "Vryn";
-        subtypes["Wildfire"] = "Wildfire";
-        subtypes["Xerex"] = "Xerex";
-        subtypes["Zendikar"] = "Zendikar";
-        subtypes["Legend"] = "Legend (obsolete)";
-        // </editor-fold>
-        // <editor-fold defaultstate="collapsed" desc="supertypes instantiation">
-        supertypes["Basic"] = "Basic";
-        supertypes["Legendary"] = "Legendary";
-        supertypes["Ongoing"] = "Ongoing";
-        supertypes["Snow"] = "Snow";
-        supertypes["World"] = "World";
-        // </editor-fold>
-        // <editor-fold defaultstate="collapsed" desc="layout instantiation">
-        layout[""] = "";
-        layout["normal"] = "normal";
-        layout["split"] = "split";
-        layout["flip"] = "flip";
-        layout["double-faced"] = "double-faced";
-        layout["token"] = "token";
-        layout["plane"] = "plane";
-        layout["scheme"] = "scheme";
-        layout["phenomenon"] = "phenomenon";
-        layout["leveler"] = "leveler";
-        layout["vanguard"] = "vanguard";
-        layout["meld"] = "meld";
-        // </editor-fold>
-        // <editor-fold defaultstate="collapsed" desc="colors instantiation">
-        colors["Blue"] = "blue";
-        colors["White"] = "white";
-        colors["Green"] = "green";
-        colors["Red"] = "red";
-        colors["Black"] = "black";
-        // </editor-fold>
-        // <editor-fold defaultstate="collapsed" desc="mana instantiation">
-        mana["U"] = "blue";
-        mana["W"] = "white";
-        mana["G"] = "green";
-        mana["R"] = "red";
-        mana["B"] = "black";
-        mana["C"] = "colorless";
-        mana["0"] = "0";
-        mana["1"] = "generic";
-        mana["2"] = "2 generic";
-        mana["3"] = "3 generic";
-        mana["4"] = "4 generic";
-        mana["5"] = "5 generic";
-        mana["6"] = "6 generic";
-        mana["7"] = "7 generic";
-        mana["8"] = "8 generic";
-        mana["9"] = "9 generic";
-        mana["10"] = "10 generic";
-        mana["11"] = "11 generic";
-        mana["12"] = "12 generic";
-        mana["13"] = "13 generic";
-        mana["14"] = "14 generic";
-        mana["15"] = "15 generic";
-        mana["16"] = "16 generic";
-        mana["17"] = "17 generic";
-        mana["18"] = "18 generic";
-        mana["19"] = "19 generic";
-        mana["20"] = "20 generic";
-        mana["1000000"] = "1000000 generic";
-        mana["X"] = "X generic";
-        mana["W/U"] = "white/blue";
-        mana["W/B"] = "white/black";
-        mana["U/B"] = "blue/black";
-        mana["U/R"] = "blue/red";
-        mana["B/R"] = "black/red";
-        mana["B/G"] = "black/green";
-        mana["R/G"] = "red/green";
-        mana["R/W"] = "red/white";
-        mana["G/W"] = "green/white";
-        mana["G/U"] = "green/blue";
-        mana["2/W"] = "generic/white";
-        mana["2/U"] = "generic/blue";
-        mana["2/B"] = "generic/black";
-        mana["2/R"] = "generic/red";
-        mana["2/G"] = "generic/green";
-        mana["W/P"] = "white/-2life";
-        mana["U/P"] = "blue/-2life";
-        mana["B/P"] = "black/-2life";
-        mana["R/P"] = "red/-2life";
-        mana["G/P"] = "green/-2life";
-        mana["S"] = "snow generic";
-        mana["hw"] = "half white";
-        mana["Y"] = "Y";
-        mana["Z"] = "Z";
-        // </editor-fold>
+        load_catalog();
+        // Readers check this before waiting for the loading thread, so it is
+        // set only once the cards are there.
+        was_db_loaded = true;
+        report_unknown(std::cerr);
+    }
+
+    void
+    JSONDatabase::load_image(std::shared_ptr<const engine_image> image_) {
+        startup_phase phase("attach image");
+        image = std::move(image_);
+        define_vocabulary();
+        cards = image->cards();
+        was_db_loaded = true;
+    }
+
+    void
+    JSONDatabase::define_vocabulary() {
+        // Vocabulary of rules is defined at its first use.
+        vocabulary::instance();
         // <editor-fold defaultstate="collapsed" desc="keyword_abilities instantiation">
         keyword_abilities.insert("deathtouch");
         keyword_abilities.insert("defender");
@@ -697,48 +264,276 @@ namespace magicSearchEngine {
         keyword_actions.insert("meld");
         keyword_actions.insert("goad");
         // </editor-fold>
-        was_db_loaded = true;
-        cards = load_cards(data);
-        ifs.close();
+    }
+
+    void
+    JSONDatabase::load_catalog() {
+        TRACE_SPAN("load_database");
+        PROFILE_PHASE("load_database");
+        startup_phase mapping("map file");
+        // An archive is inflated on a second thread while cards are read.
+        std::optional<mapped_file> input;
+        std::optional<zip_input> zipped;
+        if (zip_input::is_zip(path))
+            zipped.emplace(path);
+        else
+            input.emplace(path);
+        mapping.finish();
+        startup_phase defining("vocabulary");
+        define_vocabulary();
+        defining.finish();
+        startup_phase loading("load_cards");
+        TRACE_SPAN("load_cards");
+        PROFILE_PHASE("load_cards");
+        if (zipped) {
+            card_reader reader(*zipped);
+            cards = load_cards(reader);
+        }
+        else {
+            card_reader reader(input->view());
+            cards = load_cards(reader);
+        }
+        loading.finish();
     }
     
+    void
+    JSONDatabase::report_unknown(std::ostream & os) const {
+        const vocabulary & vocab = vocabulary::instance();
+        std::pair<const char *, const symbol_table *> tables[] = {
+            {"types", &vocab.types},
+            {"subtypes", &vocab.subtypes},
+            {"supertypes", &vocab.supertypes},
+            {"layouts", &vocab.layout},
+            {"colors", &vocab.colors},
+            {"mana symbols", &vocab.mana}
+        };
+        for (auto && table : tables) {
+            const symbol_table & symbols = *table.second;
+            if (symbols.size() == symbols.known())
+                continue;
+            // Cards are built concurrently, ids of unknown values vary.
+            std::vector<std::string> unknown;
+            for (size_t id = symbols.known(); id < symbols.size(); ++id)
+                unknown.push_back(symbols[symbol_id(id)].key);
+            std::sort(begin(unknown), end(unknown));
+            os << "Unknown " << table.first << " (not in rules) were loaded:";
+            for (const std::string & key : unknown)
+                os << " " << key;
+            os << std::endl;
+        }
+    }
+
+    const engine_image *
+    JSONDatabase::get_image() const {
+        return image.get();
+    }
+
+    const std::string &
+    JSONDatabase::get_path() const {
+        return path;
+    }
+
     bool
     JSONDatabase::is_ready() const {
         return was_db_loaded;
     }
 
+    void
+    JSONDatabase::set_load_stages(const load_stages & stages_) {
+        stages = stages_;
+    }
+
+    void
+    JSONDatabase::set_card_observer(card_observer * observer_) {
+        observer = observer_;
+    }
+
+    namespace {
+
+        // Cards on their way through stages of load_cards.
+        struct card_batch {
+            size_t first = 0;
+            std::vector<std::string_view> read_keys;
+            std::vector<card_record> records;
+            // Escaped strings of read_keys and records.
+            std::deque<std::string> unescaped;
+            std::vector<std::string> keys;
+            std::vector<Card> cards;
+        } ;
+    }
+
+    /*
+     * Cards are constructed straight from the mapped input, the parser of
+     * nlohmann gave them sorted by key (in a std::map), where a card of a
+     * repeated key replaced the former one. Positions of cards in neighbour
+     * tables and HNSW graphs rely on that order, so it is kept.
+     *
+     * The loading thread parses batches of records, build workers make cards
+     * of them (into strings of their own, absorbed at the end) and observe
+     * workers hand them to the observer. Queues between stages are bounded,
+     * so a slow stage holds back the parser instead of piling up records.
+     */
     std::vector<Card>
-    JSONDatabase::load_cards(const json & data) {
-        std::vector<Card> cards_;
+    JSONDatabase::load_cards(card_reader & reader) {
+        size_t cores = std::max(1U, std::thread::hardware_concurrency());
+        size_t builders = stages.build_workers;
+        size_t observers = stages.observe_workers;
+        if (builders == 0)
+            builders = observer ? std::max<size_t>(1, (cores - 1) / 2) : std::max<size_t>(1, cores - 1);
+        if (observers == 0)
+            observers = observer ? std::max<size_t>(1, cores - 1 - std::min(cores - 1, builders)) : 1;
+        size_t batch_size = std::max<size_t>(1, stages.batch_size);
+        using batch_ptr = std::unique_ptr<card_batch>;
+        bounded_queue<batch_ptr> parsed(std::max<size_t>(2, stages.queued_batches * builders));
+        bounded_queue<batch_ptr> built(std::max<size_t>(2, stages.queued_batches * observers));
+
+        std::mutex done_mtx;
+        std::vector<batch_ptr> done;
+        std::exception_ptr failure;
+        auto && fail = [&](std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(done_mtx);
+            if (!failure)
+                failure = error;
+        };
+
+        std::vector<string_pool> pools(builders);
+        std::atomic<size_t> building(builders);
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < builders; ++w) {
+            workers.emplace_back([&, w]() {
+                TRACE_THREAD("card_builder");
+                batch_ptr batch;
+                while (parsed.pop(batch)) {
+                    try {
+                        batch->keys.assign(begin(batch->read_keys), end(batch->read_keys));
+                        batch->cards.reserve(batch->records.size());
+                        for (const card_record & record : batch->records)
+                            batch->cards.emplace_back(record, pools[w]);
+                    }
+                    catch (...) {
+                        fail(std::current_exception());
+                    }
+                    // Records are not needed any more, nor their strings.
+                    batch->read_keys = {};
+                    batch->records = {};
+                    batch->unescaped = {};
+                    built.push(std::move(batch));
+                }
+                if (--building == 0)
+                    built.close();
+            });
+        }
+        for (size_t w = 0; w < observers; ++w) {
+            workers.emplace_back([&]() {
+                TRACE_THREAD("card_observer");
+                batch_ptr batch;
+                while (built.pop(batch)) {
+                    try {
+                        if (observer)
+                            observer->cards_built(batch->first, batch->cards);
+                    }
+                    catch (...) {
+                        fail(std::current_exception());
+                    }
+                    std::lock_guard<std::mutex> lock(done_mtx);
+                    done.push_back(std::move(batch));
+                }
+            });
+        }
+
+        try {
+            card_record record;
+            std::string_view key;
+            size_t read = 0;
+            batch_ptr batch;
+            reader.keep_unescaped();
+            while (true) {
+                bool more = reader.next(key, record);
+                if (more) {
+                    if (!batch) {
+                        batch.reset(new card_batch);
+                        batch->first = read;
+                    }
+                    batch->read_keys.push_back(key);
+                    batch->records.push_back(record);
+                    ++read;
+                }
+                if (batch && (!more || batch->records.size() == batch_size)) {
+                    batch->unescaped = reader.take_unescaped();
+                    parsed.push(std::move(batch));
+                }
+                if (!more)
+                    break;
+            }
+        }
+        catch (...) {
+            fail(std::current_exception());
+        }
+        parsed.close();
+        for (std::thread & worker : workers)
+            worker.join();
+        if (failure)
+            std::rethrow_exception(failure);
+        for (string_pool & pool : pools)
+            strings.absorb(std::move(pool));
 
-        for (auto && card : data) {
-            Card entry{card, this};
-            cards_.push_back(entry);
+        std::sort(begin(done), end(done), [](const batch_ptr & a, const batch_ptr & b) {
+            return a->first < b->first; });
+        std::vector<std::string> keys;
+        std::vector<Card> read;
+        for (batch_ptr & batch : done) {
+            std::move(begin(batch->keys), end(batch->keys), std::back_inserter(keys));
+            std::move(begin(batch->cards), end(batch->cards), std::back_inserter(read));
+            batch.reset();
         }
 
-        return std::move(cards_);
+        std::vector<uint32_t> order(read.size());
+        std::iota(begin(order), end(order), 0);
+        std::stable_sort(begin(order), end(order), [&keys](uint32_t a, uint32_t b) {
+            return keys[a] < keys[b]; });
+        std::vector<Card> cards_;
+        std::vector<uint32_t> read_order;
+        cards_.reserve(read.size());
+        read_order.reserve(read.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && keys[order[i]] == keys[order[i + 1]])
+                continue;
+            cards_.push_back(std::move(read[order[i]]));
+            read_order.push_back(order[i]);
+        }
+        if (observer)
+            observer->cards_loaded(read_order);
+        return cards_;
+    }
+
+    const string_pool &
+    JSONDatabase::get_strings() const {
+        if (was_db_loaded)
+            return strings;
+        else
+            throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_types() const {
         if (was_db_loaded)
-            return types;
+            return vocabulary::instance().types;
         else
             throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_subtypes() const {
         if (was_db_loaded)
-            return subtypes;
+            return vocabulary::instance().subtypes;
         else
             throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_supertypes() const {
         if (was_db_loaded)
-            return supertypes;
+            return vocabulary::instance().supertypes;
         else
             throw bad_optional_access(db_not_loaded);
     }
@@ -751,26 +546,26 @@ namespace magicSearchEngine {
             throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_layout() const {
         if (was_db_loaded)
-            return layout;
+            return vocabulary::instance().layout;
         else
             throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_colors() const {
         if (was_db_loaded)
-            return colors;
+            return vocabulary::instance().colors;
         else
             throw bad_optional_access(db_not_loaded);
     }
 
-    const std::unordered_map<std::string, std::string> &
+    const symbol_table &
     JSONDatabase::get_mana() const {
         if (was_db_loaded)
-            return mana;
+            return vocabulary::instance().mana;
         else
             throw bad_optional_access(db_not_loaded);
     }
@@ -32,17 +32,74 @@
 #ifndef DATABASE_HPP
 #define DATABASE_HPP
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
 #include "src/card.hpp"
-#include "src/json.hpp"
+#include "src/vocabulary.hpp"
 
 namespace magicSearchEngine {
 
+    class card_reader;
+    class engine_image;
+
+    /*
+     * Receives cards while load_database builds them, e.g. to index them
+     * before loading ends.
+     */
+    class card_observer {
+    public:
+        /*
+         * Cards from position first on among the cards read (in the order of
+         * the file). Workers call it concurrently for other cards.
+         */
+        virtual void
+        cards_built(size_t first, const std::vector<Card> & cards) = 0;
+
+        // Position among the cards read of each card of get_cards().
+        virtual void
+        cards_loaded(const std::vector<uint32_t> & read_order) = 0;
+
+        virtual
+        ~card_observer() {
+        };
+    } ;
+
+    /*
+     * A card of get_cards() changed after loading, the position of a card
+     * added is the previous number of cards. A removed card keeps its
+     * position until the next load_database.
+     */
+    enum class update_kind {
+        added, replaced, removed
+    } ;
+
+    struct card_update {
+        update_kind kind;
+        size_t position;
+    } ;
+
+    /*
+     * Stages of load_database run concurrently: the file is read (and
+     * inflated) by one thread, parsed by the loading thread, cards are built
+     * by build workers and passed to the observer by observe workers, each
+     * stage gets batches of cards through a bounded queue. Counts of 0 share
+     * the cores among the stages.
+     */
+    struct load_stages {
+        size_t build_workers = 0;
+        size_t observe_workers = 0;
+        size_t batch_size = 256;
+        // Capacity of a queue in batches per worker reading it.
+        size_t queued_batches = 2;
+    } ;
+
     /*
      * Serves as a contract for all possible implementations
      * of database.
@@ -55,22 +112,22 @@ namespace magicSearchEngine {
         virtual const std::vector<Card> &
         get_cards() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_types() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_subtypes() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_supertypes() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_layout() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_colors() const = 0;
 
-        virtual const std::unordered_map<std::string, std::string> &
+        virtual const symbol_table &
         get_mana() const = 0;
 
         virtual const std::unordered_set<std::string> &
@@ -79,13 +136,23 @@ namespace magicSearchEngine {
         virtual const std::unordered_set<std::string> &
         get_keyword_actions() const = 0;
 
+        // Storage of names and texts of cards.
+        virtual const string_pool &
+        get_strings() const = 0;
+
+        // Image the cards were taken from, if any (see engine_image).
+        virtual const engine_image *
+        get_image() const {
+            return nullptr;
+        }
+
         virtual
         ~Database() {
         };
     } ;
 
     class JSONDatabase : public Database {
-    private:
+    protected:
         /* 
          * Question: Shall a boolean indicator of already loaded
          * database be used or some magic with a static member? The first solution
@@ -95,47 +162,71 @@ namespace magicSearchEngine {
          * JSONDatabase object. In order the construction
          * to be cheap I decided to have a status boolean variable.
          */
-        bool was_db_loaded = false;
+        std::atomic<bool> was_db_loaded{false};
         const char * db_not_loaded =
                 "Database access before it was loaded. Firstly, call JSONDatabase::load_database().";
 
+        std::string path;
         std::vector<Card> cards;
-        std::unordered_map<std::string, std::string> types;
-        std::unordered_map<std::string, std::string> subtypes;
-        std::unordered_map<std::string, std::string> supertypes;
-        std::unordered_map<std::string, std::string> layout;
-        std::unordered_map<std::string, std::string> colors;
-        std::unordered_map<std::string, std::string> mana;
+        string_pool strings;
+        load_stages stages;
+        card_observer * observer = nullptr;
+        // Names and texts of cards are views of it.
+        std::shared_ptr<const engine_image> image;
 
         std::unordered_set<std::string> keyword_abilities;
         std::unordered_set<std::string> keyword_actions;
 
     public:
+        static constexpr const char * default_path = "./src/AllCards.json";
+
+        // Cards are loaded from the JSON file at path, or from a zip archive of
+        // it: path itself if it ends with .zip, path.zip if path does not exist.
+        explicit
+        JSONDatabase(const std::string & path_ = default_path);
+
         void
         load_database() override;
+
+        /*
+         * Takes cards of image instead of loading them, then they cannot
+         * change.
+         */
+        virtual void
+        load_image(std::shared_ptr<const engine_image> image_);
+
+        void
+        set_load_stages(const load_stages & stages_);
+
+        // The observer must live until load_database returns.
+        void
+        set_card_observer(card_observer * observer_);
         
         bool
         is_ready() const;
 
+        const std::string &
+        get_path() const;
+
         const std::vector<Card> &
         get_cards() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_types() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_subtypes() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_supertypes() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_layout() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_colors() const override;
 
-        const std::unordered_map<std::string, std::string> &
+        const symbol_table &
         get_mana() const override;
 
         const std::unordered_set<std::string> &
@@ -144,11 +235,30 @@ namespace magicSearchEngine {
         const std::unordered_set<std::string> &
         get_keyword_actions() const override;
 
+        const string_pool &
+        get_strings() const override;
+
+        const engine_image *
+        get_image() const override;
+
         ~JSONDatabase() {
         }
+    protected:
+        // load_database without marking the database loaded.
+        void
+        load_catalog();
+
+        // Vocabulary of rules and keywords, before cards come.
+        void
+        define_vocabulary();
+
+        // Prints values of cards that were not defined by load_database.
+        void
+        report_unknown(std::ostream & os) const;
+
     private:
         std::vector<Card>
-        load_cards(const nlohmann::json & data);
+        load_cards(card_reader & reader);
     } ;
 
     /*
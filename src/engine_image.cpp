@@ -0,0 +1,652 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   engine_image.cpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 20, 2026, 3:05 AM
+ */
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "src/engine_image.hpp"
+#include "src/database.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    static const char image_magic[8] = {'M', 'S', 'E', 'I', 'M', 'G', '0', '1'};
+    // Raised whenever the layout of the image changes.
+    static const uint32_t image_format = 2;
+
+    /*
+     * Layout: the header, then sections at its offsets, each aligned to 8
+     * bytes. Strings are names and texts of cards, symbols are ids of their
+     * colors, supertypes, types and subtypes in this order, mana holds pairs
+     * of a symbol and its count. Terms of the card at pos are term_ids from
+     * term_first[pos] to term_first[pos + 1], the term of an id is the
+     * dictionary from dictionary_first[id] to dictionary_first[id + 1].
+     */
+    struct engine_image::header {
+        char magic[8];
+        // Of the build which wrote the image.
+        uint32_t format;
+        uint32_t tokenizer;
+        uint32_t card_size;
+        uint32_t reserved;
+        uint64_t catalog_size;
+        uint64_t catalog_mtime;
+        uint64_t bytes;
+        uint64_t card_count;
+        uint64_t term_count;
+        uint64_t vocabulary;
+        uint64_t strings;
+        uint64_t cards;
+        uint64_t names;
+        uint64_t symbols;
+        uint64_t mana;
+        uint64_t term_first;
+        uint64_t term_ids;
+        uint64_t dictionary_first;
+        uint64_t dictionary;
+        uint64_t keywords;
+        uint64_t hashes;
+    } ;
+
+    struct engine_image::card_record {
+        // Offsets in strings.
+        uint64_t name;
+        uint64_t text;
+        uint32_t name_size;
+        uint32_t text_size;
+        int32_t power;
+        int32_t toughness;
+        int32_t loyalty;
+        int32_t hand;
+        int32_t life;
+        uint32_t layout;
+        // First entries of the card in names, symbols and mana.
+        uint32_t names;
+        uint32_t symbols;
+        uint32_t mana;
+        uint16_t names_count;
+        uint16_t mana_count;
+        uint16_t colors;
+        uint16_t supertypes;
+        uint16_t types;
+        uint16_t subtypes;
+        // Half 1, asterics 2.
+        uint8_t power_flags;
+        uint8_t toughness_flags;
+    } ;
+
+    struct engine_image::name_record {
+        uint64_t offset;
+        uint64_t size;
+    } ;
+
+    // Tables with discovered symbols, in the order of the image.
+    static array<symbol_table *, 6>
+    tables_of(vocabulary & words) {
+        return {&words.types, &words.subtypes, &words.supertypes, &words.layout,
+            &words.colors, &words.mana};
+    }
+
+    // Size and modification time of the catalog, false if there is none.
+    static bool
+    catalog_stamp(const string & data_path, uint64_t & size, uint64_t & mtime) {
+        struct stat st;
+        if (stat(data_path.c_str(), &st) != 0)
+            return false;
+        size = static_cast<uint64_t> (st.st_size);
+        mtime = static_cast<uint64_t> (st.st_mtim.tv_sec) * 1000000000 +
+                static_cast<uint64_t> (st.st_mtim.tv_nsec);
+        return true;
+    }
+
+    static uint8_t
+    feature_flags(const feature & f) {
+        return static_cast<uint8_t> ((f.half ? 1 : 0) | (f.asterics ? 2 : 0));
+    }
+
+    template<typename T>
+    static void
+    append_value(string & bytes, const T & value) {
+        bytes.append(reinterpret_cast<const char *> (&value), sizeof (value));
+    }
+
+    static void
+    write_at(int fd, uint64_t offset, const void * data, size_t size, const string & path) {
+        const char * from = static_cast<const char *> (data);
+        while (size > 0) {
+            ssize_t written = pwrite(fd, from, size, static_cast<off_t> (offset));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                throw runtime_error("Engine image " + path + " could not be written: " + strerror(errno) + ".");
+            from += written;
+            offset += static_cast<uint64_t> (written);
+            size -= static_cast<size_t> (written);
+        }
+    }
+
+    template<typename T>
+    static void
+    write_section(int fd, uint64_t offset, const vector<T> & values, const string & path) {
+        write_at(fd, offset, values.data(), values.size() * sizeof (T), path);
+    }
+
+    engine_image::builder::builder(const Database & db_, uint32_t tokenizer_) : db(db_),
+    tokenizer(tokenizer_), term_first{0} {
+    }
+
+    engine_image::builder::~builder() {
+    }
+
+    void
+    engine_image::builder::add(const Card & card, const set<string> & terms) {
+        cards.push_back(&card);
+        for (const string & term : terms) {
+            auto inserted = term_ids.emplace(term, static_cast<uint32_t> (dictionary.size()));
+            if (inserted.second)
+                dictionary.push_back(&(inserted.first->first));
+            card_terms.push_back(inserted.first->second);
+        }
+        term_first.push_back(card_terms.size());
+    }
+
+    void
+    engine_image::builder::write(const string & path, const string & data_path) const {
+        header head;
+        memset(&head, 0, sizeof (head));
+        memcpy(head.magic, image_magic, sizeof (image_magic));
+        head.format = image_format;
+        head.tokenizer = tokenizer;
+        head.card_size = sizeof (card_record);
+        if (!catalog_stamp(data_path, head.catalog_size, head.catalog_mtime))
+            throw runtime_error("File " + data_path + " cannot be read.");
+        head.card_count = cards.size();
+        head.term_count = dictionary.size();
+
+        // Discovered symbols of each table: known, count and keys.
+        string vocabulary_bytes;
+        for (symbol_table * table : tables_of(vocabulary::instance())) {
+            size_t known = table->known(), count = table->size();
+            append_value(vocabulary_bytes, static_cast<uint32_t> (known));
+            append_value(vocabulary_bytes, static_cast<uint32_t> (count - known));
+            for (size_t id = known; id < count; ++id) {
+                const string & key = (*table)[static_cast<symbol_id> (id)].key;
+                append_value(vocabulary_bytes, static_cast<uint32_t> (key.size()));
+                vocabulary_bytes += key;
+            }
+        }
+
+        string strings;
+        vector<card_record> records;
+        vector<name_record> names;
+        vector<uint32_t> symbols;
+        vector<uint32_t> mana;
+        records.reserve(cards.size());
+        auto && add_symbols = [&symbols](const symbol_list & list) {
+            symbols.insert(end(symbols), list.ids(), list.ids() + list.size());
+            return static_cast<uint16_t> (list.size());
+        };
+        for (const Card * card : cards) {
+            card_record r;
+            memset(&r, 0, sizeof (r));
+            r.name = strings.size();
+            r.name_size = static_cast<uint32_t> (card->get_name().size());
+            strings += card->get_name();
+            r.text = strings.size();
+            r.text_size = static_cast<uint32_t> (card->get_text().size());
+            strings += card->get_text();
+            r.names = static_cast<uint32_t> (names.size());
+            for (string_view name : card->get_names()) {
+                names.push_back(name_record{strings.size(), name.size()});
+                strings += name;
+            }
+            r.names_count = static_cast<uint16_t> (card->get_names().size());
+            r.mana = static_cast<uint32_t> (mana.size() / 2);
+            for (const manaCnt & m : card->get_manaCost()) {
+                mana.push_back(m.color);
+                mana.push_back(static_cast<uint32_t> (m.count));
+            }
+            r.mana_count = static_cast<uint16_t> (card->get_manaCost().size());
+            r.symbols = static_cast<uint32_t> (symbols.size());
+            r.colors = add_symbols(card->get_colors());
+            r.supertypes = add_symbols(card->get_supertypes());
+            r.types = add_symbols(card->get_types());
+            r.subtypes = add_symbols(card->get_subtypes());
+            r.power = card->get_power().whole_part;
+            r.power_flags = feature_flags(card->get_power());
+            r.toughness = card->get_toughness().whole_part;
+            r.toughness_flags = feature_flags(card->get_toughness());
+            r.loyalty = card->get_loyalty();
+            r.hand = card->get_hand();
+            r.life = card->get_life();
+            r.layout = card->get_layout_id();
+            records.push_back(r);
+        }
+
+        // Ids become ranks of terms in the sorted dictionary.
+        vector<uint32_t> order(dictionary.size());
+        iota(begin(order), end(order), 0);
+        sort(begin(order), end(order), [this](uint32_t a, uint32_t b) {
+            return *dictionary[a] < *dictionary[b];
+        });
+        vector<uint32_t> rank(dictionary.size());
+        for (size_t r = 0; r < order.size(); ++r)
+            rank[order[r]] = static_cast<uint32_t> (r);
+        vector<uint32_t> ids(card_terms.size());
+        for (size_t i = 0; i < card_terms.size(); ++i)
+            ids[i] = rank[card_terms[i]];
+        for (size_t pos = 0; pos < cards.size(); ++pos)
+            sort(begin(ids) + static_cast<ptrdiff_t> (term_first[pos]),
+                begin(ids) + static_cast<ptrdiff_t> (term_first[pos + 1]));
+        vector<uint64_t> dictionary_first;
+        string dictionary_bytes;
+        vector<uint8_t> keywords;
+        vector<uint64_t> hashes;
+        dictionary_first.reserve(order.size() + 1);
+        for (uint32_t id : order) {
+            const string & term = *dictionary[id];
+            dictionary_first.push_back(dictionary_bytes.size());
+            dictionary_bytes += term;
+            keywords.push_back(db.get_keyword_abilities().count(term) +
+                    db.get_keyword_actions().count(term) != 0);
+            hashes.push_back(hash<string>()(term));
+        }
+        dictionary_first.push_back(dictionary_bytes.size());
+
+        uint64_t at = sizeof (header);
+        auto && place = [&at](size_t size) {
+            at = (at + 7) & ~static_cast<uint64_t> (7);
+            uint64_t offset = at;
+            at += size;
+            return offset;
+        };
+        head.vocabulary = place(vocabulary_bytes.size());
+        head.strings = place(strings.size());
+        head.cards = place(records.size() * sizeof (card_record));
+        head.names = place(names.size() * sizeof (name_record));
+        head.symbols = place(symbols.size() * sizeof (uint32_t));
+        head.mana = place(mana.size() * sizeof (uint32_t));
+        head.term_first = place(term_first.size() * sizeof (uint64_t));
+        head.term_ids = place(ids.size() * sizeof (uint32_t));
+        head.dictionary_first = place(dictionary_first.size() * sizeof (uint64_t));
+        head.dictionary = place(dictionary_bytes.size());
+        head.keywords = place(keywords.size());
+        head.hashes = place(hashes.size() * sizeof (uint64_t));
+        head.bytes = at;
+
+        // Written aside and renamed, attached processes keep the former one.
+        // The file is new and only for this user, attach checks that.
+        string written = path + ".XXXXXX";
+        int fd = mkostemp(&(written[0]), O_CLOEXEC);
+        if (fd < 0)
+            throw runtime_error("Engine image " + path + " cannot be created: " + strerror(errno) + ".");
+        try {
+            // Shared memory may be short of space, which is found out now.
+            int error = posix_fallocate(fd, 0, static_cast<off_t> (head.bytes));
+            if (error != 0)
+                throw runtime_error("Engine image " + path + " could not be written: " + strerror(error) + ".");
+            write_at(fd, 0, &head, sizeof (head), path);
+            write_at(fd, head.vocabulary, vocabulary_bytes.data(), vocabulary_bytes.size(), path);
+            write_at(fd, head.strings, strings.data(), strings.size(), path);
+            write_section(fd, head.cards, records, path);
+            write_section(fd, head.names, names, path);
+            write_section(fd, head.symbols, symbols, path);
+            write_section(fd, head.mana, mana, path);
+            write_section(fd, head.term_first, term_first, path);
+            write_section(fd, head.term_ids, ids, path);
+            write_section(fd, head.dictionary_first, dictionary_first, path);
+            write_at(fd, head.dictionary, dictionary_bytes.data(), dictionary_bytes.size(), path);
+            write_section(fd, head.keywords, keywords, path);
+            write_section(fd, head.hashes, hashes, path);
+        }
+        catch (...) {
+            close(fd);
+            unlink(written.c_str());
+            throw;
+        }
+        close(fd);
+        if (rename(written.c_str(), path.c_str()) != 0) {
+            int error = errno;
+            unlink(written.c_str());
+            throw runtime_error("Engine image " + path + " could not be written: " + strerror(error) + ".");
+        }
+    }
+
+    engine_image::engine_image(const char * data_, size_t bytes_) : data(data_), bytes(bytes_) {
+    }
+
+    engine_image::~engine_image() {
+        munmap(const_cast<char *> (data), bytes);
+    }
+
+    const engine_image::header &
+    engine_image::head() const {
+        return *reinterpret_cast<const header *> (data);
+    }
+
+    bool
+    engine_image::fits(const string & data_path, uint32_t tokenizer) const {
+        if (bytes < sizeof (header))
+            return false;
+        const header & h = head();
+        uint64_t size, mtime;
+        return memcmp(h.magic, image_magic, sizeof (image_magic)) == 0 &&
+                h.format == image_format && h.tokenizer == tokenizer &&
+                h.card_size == sizeof (card_record) && h.bytes == bytes &&
+                catalog_stamp(data_path, size, mtime) &&
+                h.catalog_size == size && h.catalog_mtime == mtime;
+    }
+
+    /*
+     * Sections follow each other in the order of the header, aligned, and
+     * hold their counts of values. Sizes are compared by division, so that
+     * no count from the file overflows.
+     */
+    bool
+    engine_image::valid_sections() const {
+        const header & h = head();
+        const uint64_t offsets[] = {h.vocabulary, h.strings, h.cards, h.names, h.symbols, h.mana,
+            h.term_first, h.term_ids, h.dictionary_first, h.dictionary, h.keywords, h.hashes};
+        uint64_t previous = sizeof (header);
+        for (uint64_t offset : offsets) {
+            if (offset < previous || offset > h.bytes || offset % 8 != 0)
+                return false;
+            previous = offset;
+        }
+        auto && holds = [](uint64_t from, uint64_t to, uint64_t count, size_t size) {
+            return count <= (to - from) / size;
+        };
+        return holds(h.cards, h.names, h.card_count, sizeof (card_record)) &&
+                holds(h.term_first, h.term_ids, h.card_count + 1, sizeof (uint64_t)) &&
+                h.term_count < none && holds(h.keywords, h.hashes, h.term_count, sizeof (uint8_t)) &&
+                holds(h.dictionary_first, h.dictionary, h.term_count + 1, sizeof (uint64_t)) &&
+                holds(h.hashes, h.bytes, h.term_count, sizeof (uint64_t));
+    }
+
+    // Ranges of terms and of the dictionary ascend and stay in their sections.
+    bool
+    engine_image::valid_terms() const {
+        const header & h = head();
+        auto && ascending = [](const uint64_t * first, uint64_t count, uint64_t limit) {
+            if (first[0] != 0 || first[count] > limit)
+                return false;
+            for (uint64_t i = 0; i < count; ++i) {
+                if (first[i] > first[i + 1])
+                    return false;
+            }
+            return true;
+        };
+        const uint64_t * term_first = section<uint64_t>(h.term_first);
+        if (!ascending(term_first, h.card_count, (h.dictionary_first - h.term_ids) / sizeof (uint32_t)) ||
+                !ascending(section<uint64_t>(h.dictionary_first), h.term_count, h.keywords - h.dictionary))
+            return false;
+        const uint32_t * ids = section<uint32_t>(h.term_ids);
+        return all_of(ids, ids + term_first[h.card_count], [&h](uint32_t id) {
+            return id < h.term_count; });
+    }
+
+    /*
+     * Strings, names, symbols and mana of each card are in their sections
+     * and its symbols are ids of tables of sizes (in the order of
+     * tables_of).
+     */
+    bool
+    engine_image::valid_cards(const array<size_t, 6> & sizes) const {
+        const header & h = head();
+        uint64_t strings = h.cards - h.strings;
+        uint64_t name_count = (h.symbols - h.names) / sizeof (name_record);
+        uint64_t symbol_count = (h.mana - h.symbols) / sizeof (uint32_t);
+        uint64_t mana_count = (h.term_first - h.mana) / (2 * sizeof (uint32_t));
+        auto && within = [](uint64_t offset, uint64_t size, uint64_t limit) {
+            return offset <= limit && size <= limit - offset;
+        };
+        const card_record * records = section<card_record>(h.cards);
+        const name_record * names = section<name_record>(h.names);
+        const uint32_t * symbols = section<uint32_t>(h.symbols);
+        const uint32_t * mana = section<uint32_t>(h.mana);
+        auto && known = [&symbols](uint64_t & at, size_t count, size_t size) {
+            for (size_t i = 0; i < count; ++i) {
+                if (symbols[at++] >= size)
+                    return false;
+            }
+            return true;
+        };
+        for (size_t pos = 0; pos < h.card_count; ++pos) {
+            const card_record & r = records[pos];
+            if (!within(r.name, r.name_size, strings) || !within(r.text, r.text_size, strings) ||
+                    !within(r.names, r.names_count, name_count) ||
+                    !within(r.mana, r.mana_count, mana_count) || r.layout >= sizes[3])
+                return false;
+            for (size_t i = r.names; i < r.names + static_cast<size_t> (r.names_count); ++i) {
+                if (!within(names[i].offset, names[i].size, strings))
+                    return false;
+            }
+            for (size_t i = r.mana; i < r.mana + static_cast<size_t> (r.mana_count); ++i) {
+                if (mana[2 * i] >= sizes[5])
+                    return false;
+            }
+            uint64_t at = r.symbols;
+            if (!within(at, static_cast<uint64_t> (r.colors) + r.supertypes + r.types + r.subtypes, symbol_count) ||
+                    !known(at, r.colors, sizes[4]) || !known(at, r.supertypes, sizes[2]) ||
+                    !known(at, r.types, sizes[0]) || !known(at, r.subtypes, sizes[1]))
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * The vocabulary section is read and checked against the tables of the
+     * process and the cards checked against the tables it gives, all before
+     * anything is interned, so an image which is not used changes nothing.
+     */
+    bool
+    engine_image::intern_symbols() const {
+        const header & h = head();
+        const char * at = data + h.vocabulary;
+        const char * last = data + h.strings;
+        auto && read = [&at, last](uint32_t & value) {
+            if (static_cast<size_t> (last - at) < sizeof (value))
+                return false;
+            memcpy(&value, at, sizeof (value));
+            at += sizeof (value);
+            return true;
+        };
+        array<symbol_table *, 6> tables = tables_of(vocabulary::instance());
+        array<vector<string_view>, 6> discovered;
+        array<size_t, 6> sizes;
+        for (size_t t = 0; t < tables.size(); ++t) {
+            symbol_table & table = *tables[t];
+            uint32_t known, count;
+            if (!read(known) || !read(count) || known != table.known())
+                return false;
+            set<string_view> keys;
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t size;
+                if (!read(size) || static_cast<size_t> (last - at) < size)
+                    return false;
+                string_view key(at, size);
+                at += size;
+                // Ids taken by the process must be the same, others free.
+                size_t id = static_cast<size_t> (known) + i;
+                bool same = id < table.size() ? table[static_cast<symbol_id> (id)].key == key :
+                        table.find(key) == symbol_table::none;
+                if (!same || !keys.insert(key).second)
+                    return false;
+                discovered[t].push_back(key);
+            }
+            sizes[t] = max(table.size(), static_cast<size_t> (known) + count);
+        }
+        if (!valid_cards(sizes))
+            return false;
+        for (size_t t = 0; t < tables.size(); ++t) {
+            for (string_view key : discovered[t])
+                tables[t]->intern(key);
+        }
+        return true;
+    }
+
+    string
+    engine_image::path_of(const string & data_path) {
+        string catalog = data_path;
+        char * resolved = realpath(catalog.c_str(), nullptr);
+        if (resolved) {
+            catalog = resolved;
+            free(resolved);
+        }
+        ostringstream path;
+        path << "/dev/shm/MagicSearchEngine-" << hex << setw(16) << setfill('0')
+                << hash<string>()(catalog) << ".image";
+        return path.str();
+    }
+
+    shared_ptr<const engine_image>
+    engine_image::attach(const string & path, const string & data_path, uint32_t tokenizer) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0)
+            return nullptr;
+        // Only an image of this user which no one else can write is trusted.
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+                (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+                st.st_size < static_cast<off_t> (sizeof (header))) {
+            close(fd);
+            return nullptr;
+        }
+        size_t size = static_cast<size_t> (st.st_size);
+        void * mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (mapped == MAP_FAILED)
+            throw runtime_error("Engine image " + path + " cannot be mapped: " + strerror(error) + ".");
+        shared_ptr<const engine_image> res(new engine_image(static_cast<const char *> (mapped), size));
+        if (!res->fits(data_path, tokenizer) || !res->valid_sections() || !res->valid_terms() ||
+                !res->intern_symbols())
+            return nullptr;
+        return res;
+    }
+
+    vector<Card>
+    engine_image::cards() const {
+        const header & h = head();
+        const card_record * records = section<card_record>(h.cards);
+        const name_record * names = section<name_record>(h.names);
+        const uint32_t * symbols = section<uint32_t>(h.symbols);
+        const uint32_t * mana = section<uint32_t>(h.mana);
+        const char * strings = section<char>(h.strings);
+        auto && fill = [](Card::symbol_ids & list, const uint32_t * & from, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                list.push_back(*from++);
+        };
+        vector<Card> res;
+        res.reserve(h.card_count);
+        for (size_t pos = 0; pos < h.card_count; ++pos) {
+            const card_record & r = records[pos];
+            Card card;
+            card.name = string_view(strings + r.name, r.name_size);
+            card.text = string_view(strings + r.text, r.text_size);
+            for (size_t i = r.names; i < r.names + static_cast<size_t> (r.names_count); ++i)
+                card.names.push_back(string_view(strings + names[i].offset, names[i].size));
+            for (size_t i = r.mana; i < r.mana + static_cast<size_t> (r.mana_count); ++i)
+                card.manaCost.push_back(manaCnt(mana[2 * i], static_cast<short> (mana[2 * i + 1])));
+            const uint32_t * from = symbols + r.symbols;
+            fill(card.colors, from, r.colors);
+            fill(card.supertypes, from, r.supertypes);
+            fill(card.types, from, r.types);
+            fill(card.subtypes, from, r.subtypes);
+            card.power = feature(r.power, (r.power_flags & 1) != 0, (r.power_flags & 2) != 0);
+            card.toughness = feature(r.toughness, (r.toughness_flags & 1) != 0, (r.toughness_flags & 2) != 0);
+            card.loyalty = r.loyalty;
+            card.hand = r.hand;
+            card.life = r.life;
+            card.layout = r.layout;
+            res.push_back(move(card));
+        }
+        return res;
+    }
+
+    size_t
+    engine_image::size() const {
+        return head().card_count;
+    }
+
+    engine_image::term_range
+    engine_image::terms(size_t pos) const {
+        const uint64_t * first = section<uint64_t>(head().term_first);
+        const uint32_t * ids = section<uint32_t>(head().term_ids);
+        return term_range{ids + first[pos], ids + first[pos + 1]};
+    }
+
+    string_view
+    engine_image::term(uint32_t id) const {
+        const uint64_t * first = section<uint64_t>(head().dictionary_first);
+        return string_view(section<char>(head().dictionary) + first[id], first[id + 1] - first[id]);
+    }
+
+    bool
+    engine_image::is_keyword(uint32_t id) const {
+        return section<uint8_t>(head().keywords)[id] != 0;
+    }
+
+    uint64_t
+    engine_image::term_hash(uint32_t id) const {
+        return section<uint64_t>(head().hashes)[id];
+    }
+
+    uint32_t
+    engine_image::find_term(string_view term_) const {
+        uint32_t lo = 0, hi = static_cast<uint32_t> (head().term_count);
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (term(mid) < term_)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return (lo < head().term_count && term(lo) == term_) ? lo : none;
+    }
+
+    size_t
+    engine_image::mapped_bytes() const {
+        return bytes;
+    }
+}
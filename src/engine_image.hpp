@@ -0,0 +1,209 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   engine_image.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 20, 2026, 3:05 AM
+ */
+
+#ifndef ENGINE_IMAGE_HPP
+#define ENGINE_IMAGE_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "src/card.hpp"
+
+namespace magicSearchEngine {
+
+    class Database;
+
+    /*
+     * Cards of the catalog and the terms of their texts laid out in one file
+     * in shared memory (/dev/shm), so that processes serving the same catalog
+     * share a single copy: the first one loads the catalog and publishes the
+     * image, later ones map it read-only instead of loading and tokenizing.
+     * Everything in the image is linked by offsets, it is valid at any
+     * address. It is replaced by rename, processes keep the one they mapped.
+     *
+     * A term has the id of its rank in the sorted dictionary, so ids of terms
+     * of a card ascend in the order of its index entry (std::set). Card
+     * objects hold ids of symbols of the process and views, so each process
+     * makes its own from records of the image (their strings stay there);
+     * symbols discovered on cards are interned in the order of the image.
+     */
+    class engine_image {
+    public:
+        static constexpr uint32_t none = UINT32_MAX;
+
+        // Ids of terms of a card, ascending.
+        struct term_range {
+            const uint32_t * first;
+            const uint32_t * last;
+
+            const uint32_t *
+            begin() const {
+                return first;
+            }
+
+            const uint32_t *
+            end() const {
+                return last;
+            }
+        } ;
+
+        /*
+         * Collects cards with their terms and writes them as an image. Cards
+         * must not change until then, keywords of texts are those of db.
+         */
+        class builder {
+        private:
+            const Database & db;
+            uint32_t tokenizer;
+            std::vector<const Card *> cards;
+            // Ids in order of arrival, those of card_terms until write sorts them.
+            std::unordered_map<std::string, uint32_t> term_ids;
+            std::vector<const std::string *> dictionary;
+            std::vector<uint64_t> term_first;
+            std::vector<uint32_t> card_terms;
+
+        public:
+            // Terms are made by the tokenizer of the version.
+            builder(const Database & db_, uint32_t tokenizer_);
+
+            ~builder();
+
+            void
+            add(const Card & card, const std::set<std::string> & terms);
+
+            /*
+             * Writes the image of cards of the catalog at data_path to path.
+             * Throws std::runtime_error if it cannot be written.
+             */
+            void
+            write(const std::string & path, const std::string & data_path) const;
+        } ;
+
+    private:
+        struct header;
+        struct card_record;
+        struct name_record;
+
+        const char * data;
+        size_t bytes;
+
+        engine_image(const char * data_, size_t bytes_);
+
+        const header &
+        head() const;
+
+        template<typename T>
+        const T *
+        section(uint64_t offset) const {
+            return reinterpret_cast<const T *> (data + offset);
+        }
+
+        // Written by this build and tokenizer for the catalog as it is now.
+        bool
+        fits(const std::string & data_path, std::uint32_t tokenizer) const;
+
+        bool
+        valid_sections() const;
+
+        bool
+        valid_terms() const;
+
+        bool
+        valid_cards(const std::array<size_t, 6> & sizes) const;
+
+        /*
+         * Interns discovered symbols, false (and nothing interned) if the
+         * process has other ids or the vocabulary or cards are damaged.
+         */
+        bool
+        intern_symbols() const;
+
+    public:
+        engine_image(const engine_image &) = delete;
+
+        engine_image &
+        operator=(const engine_image &) = delete;
+
+        ~engine_image();
+
+        /*
+         * Where the image of the catalog at data_path (a path of the file
+         * read, see JSONDatabase::get_path) is published.
+         */
+        static std::string
+        path_of(const std::string & data_path);
+
+        /*
+         * Maps the image at path, nullptr if there is none or it cannot be
+         * used (it was published for other cards, by another build or
+         * tokenizer, by another user or it is damaged), it is then published
+         * again. Throws std::runtime_error if it cannot be mapped.
+         */
+        static std::shared_ptr<const engine_image>
+        attach(const std::string & path, const std::string & data_path, std::uint32_t tokenizer);
+
+        // Cards of the image in their order, views of its strings.
+        std::vector<Card>
+        cards() const;
+
+        size_t
+        size() const;
+
+        term_range
+        terms(size_t pos) const;
+
+        std::string_view
+        term(uint32_t id) const;
+
+        // Whether the term is a keyword ability or action.
+        bool
+        is_keyword(uint32_t id) const;
+
+        // std::hash<std::string> of the term.
+        uint64_t
+        term_hash(uint32_t id) const;
+
+        // Id of term, none if no card has it.
+        uint32_t
+        find_term(std::string_view term) const;
+
+        // Bytes mapped, shared with other processes.
+        size_t
+        mapped_bytes() const;
+    } ;
+}
+
+#endif /* ENGINE_IMAGE_HPP */
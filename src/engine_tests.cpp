@@ -0,0 +1,569 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Tests of properties the engine promises, run by make check. Each test
+ * prints its failures to the standard error; the exit status is non-zero
+ * when any test failed. The catalog is a small one written next to the
+ * program, so the tests need no AllCards.json; the card store, shards and
+ * the engine image tested are made there too and removed afterwards.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "searching.hpp"
+#include "arena.hpp"
+#include "card.hpp"
+#include "card_reader.hpp"
+#include "card_store.hpp"
+#include "engine_image.hpp"
+#include "json_index.hpp"
+#include "profiling.hpp"
+#include "shard.hpp"
+#include "string_pool.hpp"
+#include "src/json.hpp"
+
+using namespace magicSearchEngine;
+using namespace std;
+using json = nlohmann::json;
+
+static const char catalog_path[] = "engine_tests.json";
+
+static const char catalog[] = R"json({
+"Air Elemental": {"cmc": 5, "colors": ["Blue"], "layout": "normal", "manaCost": "{3}{U}{U}", "name": "Air Elemental", "power": "4", "subtypes": ["Elemental"], "text": "Flying", "toughness": "4", "type": "Creature — Elemental", "types": ["Creature"]},
+"Serra Angel": {"cmc": 5, "colors": ["White"], "layout": "normal", "manaCost": "{3}{W}{W}", "name": "Serra Angel", "power": "4", "subtypes": ["Angel"], "text": "Flying, vigilance", "toughness": "4", "type": "Creature — Angel", "types": ["Creature"]},
+"Grizzly Bears": {"cmc": 2, "colors": ["Green"], "layout": "normal", "manaCost": "{1}{G}", "name": "Grizzly Bears", "power": "2", "subtypes": ["Bear"], "toughness": "2", "type": "Creature — Bear", "types": ["Creature"]},
+"Tarmogoyf": {"cmc": 2, "colors": ["Green"], "layout": "normal", "manaCost": "{1}{G}", "name": "Tarmogoyf", "power": "*", "subtypes": ["Lhurgoyf"], "text": "Tarmogoyf's power is equal to the number of card types among cards in all graveyards and its toughness is equal to that number plus 1.", "toughness": "1+*", "type": "Creature — Lhurgoyf", "types": ["Creature"]},
+"Shock": {"cmc": 1, "colors": ["Red"], "layout": "normal", "manaCost": "{R}", "name": "Shock", "text": "Shock deals 2 damage to any target.", "type": "Instant", "types": ["Instant"]},
+"Lightning Bolt": {"cmc": 1, "colors": ["Red"], "layout": "normal", "manaCost": "{R}", "name": "Lightning Bolt", "text": "Lightning Bolt deals 3 damage to any target.", "type": "Instant", "types": ["Instant"]},
+"Fire // Ice": {"cmc": 4, "colors": ["Red", "Blue"], "layout": "split", "manaCost": "{1}{R}", "name": "Fire // Ice", "names": ["Fire", "Ice"], "text": "Fire deals 2 damage divided as you choose among one or two targets.\nTap target permanent.\nDraw a card.", "type": "Instant", "types": ["Instant"]},
+"Jace Beleren": {"cmc": 3, "colors": ["Blue"], "layout": "normal", "loyalty": 3, "manaCost": "{1}{U}{U}", "name": "Jace Beleren", "subtypes": ["Jace"], "text": "+2: Each player draws a card.\n−1: Target player draws a card.", "type": "Legendary Planeswalker — Jace", "supertypes": ["Legendary"], "types": ["Planeswalker"]},
+"Forest": {"layout": "normal", "name": "Forest", "subtypes": ["Forest"], "supertypes": ["Basic"], "text": "({T}: Add {G}.)", "type": "Basic Land — Forest", "types": ["Land"]},
+"Island": {"layout": "normal", "name": "Island", "subtypes": ["Island"], "supertypes": ["Basic"], "text": "({T}: Add {U}.)", "type": "Basic Land — Island", "types": ["Land"]}
+}
+)json";
+
+/*
+ * Queries in steady state, i.e. once the query arena has grown by the same
+ * queries run before, do not call the global allocator.
+ */
+static bool
+steady_state_queries_do_not_allocate(const JSONDatabase & database, search_engine & oraculum) {
+    const vector<Card> & cards = database.get_cards();
+    auto run = [&]() {
+        size_t found = 0;
+        for (const Card & card : cards) {
+            arena_scope scope;
+            found += oraculum.find_similar(card.get_name(), 3, scope.get()).size();
+        }
+        return found;
+    };
+    run();
+    size_t before = allocation_count();
+    size_t found = run();
+    size_t allocations = allocation_count() - before;
+    if (found == 0 || allocations != 0) {
+        cerr << "steady_state_queries_do_not_allocate: " << found << " cards found, "
+                << allocations << " allocations" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The catalog followed by texts full of escapes and structural characters
+ * at every position of a 64-byte block, where the SIMD index carries the
+ * state of quotes and backslashes over to the next block.
+ */
+static string
+parser_input() {
+    string res = catalog;
+    res.resize(res.rfind('}'));
+    for (size_t pad = 0; pad < 70; ++pad) {
+        string name = "Escapes " + to_string(pad);
+        res += ",\n\"" + name + "\": {\"layout\": \"normal\", \"name\": \"" + name +
+                "\", \"text\": \"" + string(pad, 'x') +
+                R"(\\\" {[,:]} \u00e9\n\\)" "\", \"type\": \"Instant\", \"types\": [\"Instant\"]}";
+    }
+    return res + "\n}\n";
+}
+
+/*
+ * card_reader reads the same cards as the nlohmann parser, with the SIMD
+ * and the scalar structural index alike, and both indexes are the same.
+ */
+static bool
+card_reader_matches_nlohmann() {
+    string input = parser_input();
+    vector<uint32_t> simd_positions, scalar_positions;
+    structural_index(input, simd_positions, scan_mode::simd);
+    structural_index(input, scalar_positions, scan_mode::scalar);
+    bool res = true;
+    if (simd_positions != scalar_positions) {
+        cerr << "card_reader_matches_nlohmann: SIMD (" << simd_name()
+                << ") and scalar indexes differ" << endl;
+        res = false;
+    }
+    string_pool strings;
+    json data = json::parse(input);
+    for (scan_mode mode : {scan_mode::simd, scan_mode::scalar}) {
+        map<string, Card> read;
+        card_reader reader(input, mode);
+        card_record record;
+        string_view key;
+        while (reader.next(key, record))
+            read.insert_or_assign(string(key), Card(record, strings));
+        const char * mode_name = mode == scan_mode::simd ? "SIMD" : "scalar";
+        if (read.size() != data.size()) {
+            cerr << "card_reader_matches_nlohmann: " << mode_name << " read " << read.size()
+                    << " cards of " << data.size() << endl;
+            res = false;
+            continue;
+        }
+        auto it = read.begin();
+        for (auto && entry : data.items()) {
+            if (it->first != entry.key() || !same_values(it->second, Card(entry.value(), strings))) {
+                cerr << "card_reader_matches_nlohmann: " << mode_name << " read other card "
+                        << entry.key() << endl;
+                res = false;
+            }
+            ++it;
+        }
+    }
+    return res;
+}
+
+static const char store_path[] = "engine_tests.store";
+
+static bool
+exists(const string & path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Files of a store are those named in card_store.hpp, with few ids in tests.
+static void
+remove_store() {
+    string dir = store_path;
+    for (const char * name : {"MANIFEST", "MANIFEST.tmp", "LOCK"})
+        unlink((dir + "/" + name).c_str());
+    for (size_t id = 0; id < 100; ++id) {
+        for (const char * name : {"log.", "segment."}) {
+            unlink((dir + "/" + name + to_string(id)).c_str());
+            unlink((dir + "/" + name + to_string(id) + ".tmp").c_str());
+        }
+    }
+    rmdir(dir.c_str());
+}
+
+// The record of a card named name of type, as put to a store.
+static string
+store_record(const string & name, const string & type, const string & text) {
+    return "\"" + name + "\": {\"layout\": \"normal\", \"name\": \"" + name +
+            "\", \"text\": \"" + text + "\", \"type\": \"" + type + "\", \"types\": [\"" + type + "\"]}";
+}
+
+// Names of cards of the store not deleted.
+static set<string>
+live_names(const card_store & cards) {
+    shared_ptr<const store_snapshot> snapshot = cards.snapshot();
+    set<string> res;
+    for (size_t pos = 0; pos < snapshot->cards.size(); ++pos) {
+        if (!snapshot->is_removed(pos))
+            res.insert(string(snapshot->cards[pos].get_name()));
+    }
+    return res;
+}
+
+/*
+ * A change torn by a crash while it was appended is cut off the log, changes
+ * before it are kept and later ones follow them.
+ */
+static bool
+store_recovers_torn_log() {
+    remove_store();
+    {
+        card_store cards(catalog_path, store_path);
+        cards.load_database();
+        cards.upsert("Kept", store_record("Kept", "Creature", "Flying"));
+        cards.upsert("Torn", store_record("Torn", "Creature", "Trample"));
+    }
+    string log = string(store_path) + "/log.1";
+    struct stat st;
+    if (stat(log.c_str(), &st) != 0 || truncate(log.c_str(), st.st_size - 3) != 0) {
+        cerr << "store_recovers_torn_log: log " << log << " could not be torn" << endl;
+        return false;
+    }
+    bool res = true;
+    {
+        card_store cards(catalog_path, store_path);
+        cards.load_database();
+        set<string> names = live_names(cards);
+        if (names.count("Kept") == 0 || names.count("Torn") != 0 || names.size() != 11) {
+            cerr << "store_recovers_torn_log: " << names.size() << " cards read of the torn log" << endl;
+            res = false;
+        }
+        cards.upsert("After", store_record("After", "Creature", "Haste"));
+    }
+    card_store cards(catalog_path, store_path);
+    cards.load_database();
+    set<string> names = live_names(cards);
+    if (names.count("Kept") == 0 || names.count("After") == 0 || names.count("Torn") != 0) {
+        cerr << "store_recovers_torn_log: changes after the repair are lost" << endl;
+        res = false;
+    }
+    remove_store();
+    return res;
+}
+
+/*
+ * Compaction writes the log to a segment and merges segments beyond
+ * max_segments; the manifest is replaced only once they are written, so
+ * files of a compaction a crash interrupted are ignored.
+ */
+static bool
+store_compacts_to_segments() {
+    remove_store();
+    bool res = true;
+    {
+        card_store cards(catalog_path, store_path);
+        cards.load_database();
+        for (size_t i = 0; i <= card_store::max_segments; ++i) {
+            string key = "Segment " + to_string(i);
+            cards.upsert(key, store_record(key, "Creature", "Flying"));
+            cards.compact();
+        }
+        cards.remove("Segment 0");
+        cards.remove("Forest");
+        cards.compact();
+    }
+    string dir = store_path;
+    size_t segments = 0;
+    for (size_t id = 0; id < 100; ++id)
+        segments += exists(dir + "/segment." + to_string(id));
+    if (segments == 0 || segments > card_store::max_segments || exists(dir + "/log.1")) {
+        cerr << "store_compacts_to_segments: " << segments << " segments left" << endl;
+        res = false;
+    }
+    // A crash before the manifest was replaced.
+    ofstream(dir + "/MANIFEST.tmp") << "torn";
+    ofstream(dir + "/segment.99") << "torn";
+    set<string> expected;
+    {
+        JSONDatabase database(catalog_path);
+        database.load_database();
+        for (const Card & card : database.get_cards())
+            expected.insert(string(card.get_name()));
+    }
+    expected.erase("Forest");
+    for (size_t i = 1; i <= card_store::max_segments; ++i)
+        expected.insert("Segment " + to_string(i));
+    try {
+        card_store cards(catalog_path, store_path);
+        cards.load_database();
+        if (live_names(cards) != expected) {
+            cerr << "store_compacts_to_segments: other cards read from segments" << endl;
+            res = false;
+        }
+    }
+    catch (const runtime_error & e) {
+        cerr << "store_compacts_to_segments: " << e.what() << endl;
+        res = false;
+    }
+    remove_store();
+    return res;
+}
+
+/*
+ * Distances of cnt cards similar to the card of name, sorted, with names of
+ * the cards if with_names (ties are broken by positions, which differ).
+ */
+static vector<pair<size_t, string> >
+similar_cards(search_engine & oraculum, const string & name, size_t cnt, bool with_names) {
+    vector<pair<size_t, string> > res;
+    const Card * base = oraculum.search_for(name);
+    if (base == nullptr)
+        return res;
+    for (const scored_card & found : oraculum.score_similar(*base, cnt))
+        res.emplace_back(found.first, with_names ? string(found.second->get_name()) : string());
+    sort(begin(res), end(res));
+    return res;
+}
+
+/*
+ * An index updated by update_index after puts and deletes answers as one
+ * created anew over the changed cards, in the exact and the lsh mode.
+ */
+static bool
+updated_index_matches_fresh_one() {
+    remove_store();
+    bool res = true;
+    {
+        card_store cards(catalog_path, store_path);
+        cards.load_database();
+        search_engine updated(cards);
+        updated.set_mode(similarity_mode::lsh);
+        updated.create_index();
+        string angel = store_record("Baneslayer Angel", "Creature", "Flying, first strike, lifelink");
+        string shock = store_record("Shock", "Instant", "Tap target permanent. Draw a card.");
+        updated.update_index(cards.upsert({{"Baneslayer Angel", angel}, {"Shock", shock}}));
+        updated.update_index(cards.remove("Forest"));
+
+        card_store fresh_cards(catalog_path, store_path);
+        fresh_cards.load_database();
+        search_engine fresh(fresh_cards);
+        fresh.set_mode(similarity_mode::lsh);
+        fresh.create_index();
+        set<string> names = live_names(fresh_cards);
+        if (live_names(cards) != names || names.count("Forest") != 0) {
+            cerr << "updated_index_matches_fresh_one: cards of the stores differ" << endl;
+            res = false;
+        }
+        for (similarity_mode mode : {similarity_mode::lsh, similarity_mode::exact}) {
+            updated.set_mode(mode);
+            fresh.set_mode(mode);
+            for (const string & name : names) {
+                if (similar_cards(updated, name, 3, false) != similar_cards(fresh, name, 3, false) ||
+                        similar_cards(updated, name, names.size(), true) !=
+                        similar_cards(fresh, name, names.size(), true)) {
+                    cerr << "updated_index_matches_fresh_one: other cards similar to " << name << endl;
+                    res = false;
+                }
+            }
+        }
+    }
+    remove_store();
+    return res;
+}
+
+static sockaddr_un
+socket_address(const string & path) {
+    sockaddr_un res;
+    memset(&res, 0, sizeof (res));
+    res.sun_family = AF_UNIX;
+    memcpy(res.sun_path, path.data(), min(path.size(), sizeof (res.sun_path) - 1));
+    return res;
+}
+
+// Whether a shard is served at path within two seconds.
+static bool
+wait_for_shard(const string & path) {
+    sockaddr_un address = socket_address(path);
+    for (size_t attempt = 0; attempt < 200; ++attempt) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 &&
+                connect(probe, reinterpret_cast<const sockaddr *> (&address), sizeof (address)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (live)
+            return true;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static bool
+same_cards(const shard_answer & a, const shard_answer & b) {
+    return equal(begin(a.found), end(a.found), begin(b.found), end(b.found),
+            [](const shard_card & x, const shard_card & y) {
+                return x.position == y.position && x.distance == y.distance && x.printed == y.printed; });
+}
+
+/*
+ * Shards of the catalog served on sockets answer through a coordinator as
+ * the whole catalog does. A shard not answering in time is reported
+ * missing, the others still answer.
+ */
+static bool
+shards_merge_to_whole(const JSONDatabase & database, search_engine & oraculum) {
+    vector<string> parts = {"engine_tests.shard0.json", "engine_tests.shard1.json"};
+    vector<string> sockets = {"engine_tests.shard0.sock", "engine_tests.shard1.sock"};
+    split_catalog(catalog_path, parts);
+    vector<const JSONDatabase *> shard_cards;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        // serve() does not return, so shards live until the program ends.
+        JSONDatabase * cards = new JSONDatabase(parts[i]);
+        cards->load_database();
+        search_engine * engine = new search_engine(*cards);
+        engine->create_index();
+        shard_server * server = new shard_server(sockets[i], *new engine_shard(*cards, *engine));
+        thread([server]() {
+            try {
+                server->serve();
+            }
+            catch (const runtime_error & e) {
+                cerr << "shards_merge_to_whole: " << e.what() << endl;
+            }
+        }).detach();
+        shard_cards.push_back(cards);
+    }
+    for (const string & socket : sockets) {
+        if (!wait_for_shard(socket)) {
+            cerr << "shards_merge_to_whole: no shard served at " << socket << endl;
+            return false;
+        }
+    }
+
+    bool res = true;
+    engine_shard whole(database, oraculum);
+    shard_coordinator coordinator(sockets, chrono::milliseconds(5000));
+    for (const Card & card : database.get_cards()) {
+        shard_answer merged = coordinator.find_similar(card.get_name(), 3);
+        if (!merged.missing.empty() || !same_cards(merged, whole.find_similar(card.get_name(), 3))) {
+            cerr << "shards_merge_to_whole: shards found other cards similar to " << card.get_name() << endl;
+            res = false;
+        }
+    }
+
+    // It accepts requests, but never answers them.
+    string silent = "engine_tests.silent.sock";
+    unlink(silent.c_str());
+    sockaddr_un address = socket_address(silent);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr *> (&address), sizeof (address)) != 0 ||
+            listen(listener, 4) != 0) {
+        cerr << "shards_merge_to_whole: " << silent << " could not be made" << endl;
+        return false;
+    }
+    shard_coordinator partial({sockets[0], silent}, chrono::milliseconds(200));
+    string_view name = shard_cards[0]->get_cards()[0].get_name();
+    auto start = chrono::steady_clock::now();
+    shard_answer answer = partial.find_similar(name, 3);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    bool within_shard = all_of(begin(answer.found), end(answer.found), [&](const shard_card & found) {
+        return found.position < shard_cards[0]->get_cards().size(); });
+    if (answer.missing != vector<string>{silent} || answer.found.empty() || !within_shard ||
+            elapsed > chrono::seconds(2)) {
+        cerr << "shards_merge_to_whole: " << answer.missing.size() << " shards missing, "
+                << answer.found.size() << " cards found in " << elapsed.count() << " s" << endl;
+        res = false;
+    }
+    close(listener);
+    for (const string & path : {parts[0], parts[1], sockets[0], sockets[1], silent})
+        unlink(path.c_str());
+    return res;
+}
+
+/*
+ * An engine over the attached image of the catalog answers as the one over
+ * the catalog. An image cut short, made by another tokenizer or writable
+ * by others is not attached.
+ */
+static bool
+image_matches_catalog(const JSONDatabase & database, search_engine & oraculum) {
+    const string path = "engine_tests.image";
+    const string & data_path = database.get_path();
+    const uint32_t tokenizer = search_engine::tokenizer_version;
+    bool res = true;
+    try {
+        oraculum.publish_image(path, data_path);
+        shared_ptr<const engine_image> image = engine_image::attach(path, data_path, tokenizer);
+        if (!image) {
+            cerr << "image_matches_catalog: the image was not attached" << endl;
+            unlink(path.c_str());
+            return false;
+        }
+        JSONDatabase shared(catalog_path);
+        shared.load_image(image);
+        search_engine engine(shared);
+        engine.create_index();
+        for (const Card & card : database.get_cards()) {
+            string name(card.get_name());
+            if (similar_cards(engine, name, 3, true) != similar_cards(oraculum, name, 3, true)) {
+                cerr << "image_matches_catalog: the image gives other cards similar to " << name << endl;
+                res = false;
+            }
+        }
+
+        if (engine_image::attach(path, data_path, tokenizer + 1)) {
+            cerr << "image_matches_catalog: an image of another tokenizer was attached" << endl;
+            res = false;
+        }
+        struct stat st;
+        stat(path.c_str(), &st);
+        if (truncate(path.c_str(), st.st_size / 2) != 0 || engine_image::attach(path, data_path, tokenizer)) {
+            cerr << "image_matches_catalog: an image cut short was attached" << endl;
+            res = false;
+        }
+        oraculum.publish_image(path, data_path);
+        if (chmod(path.c_str(), 0664) != 0 || engine_image::attach(path, data_path, tokenizer)) {
+            cerr << "image_matches_catalog: an image writable by others was attached" << endl;
+            res = false;
+        }
+    }
+    catch (const runtime_error & e) {
+        cerr << "image_matches_catalog: " << e.what() << endl;
+        res = false;
+    }
+    unlink(path.c_str());
+    return res;
+}
+
+int
+main() {
+    {
+        ofstream ofs(catalog_path);
+        ofs << catalog;
+        if (!ofs) {
+            cerr << "Catalog " << catalog_path << " could not be written." << endl;
+            return 1;
+        }
+    }
+    JSONDatabase database(catalog_path);
+    search_engine oraculum(database);
+    database.load_database();
+    oraculum.create_index();
+
+    size_t failed = 0;
+    if (!steady_state_queries_do_not_allocate(database, oraculum))
+        ++failed;
+    if (!card_reader_matches_nlohmann())
+        ++failed;
+    if (!store_recovers_torn_log())
+        ++failed;
+    if (!store_compacts_to_segments())
+        ++failed;
+    if (!updated_index_matches_fresh_one())
+        ++failed;
+    if (!shards_merge_to_whole(database, oraculum))
+        ++failed;
+    if (!image_matches_catalog(database, oraculum))
+        ++failed;
+    cerr << (failed == 0 ? "All tests passed." : to_string(failed) + " tests failed.") << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include "hnsw.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    static const char hnsw_magic[8] = {'M', 'S', 'E', 'H', 'N', 'S', 'W', '1'};
+    // Levels are drawn so that more than a few dozen never occur.
+    static const uint64_t max_levels = 64;
+
+    void
+    hnsw_index::add(const vector<float> & v) {
+        if (v.size() != dim)
+            throw invalid_argument("Vector added to HNSW index has a wrong dimension.");
+        uint32_t id = static_cast<uint32_t> (links.size());
+        vectors.insert(end(vectors), begin(v), end(v));
+        // Level is drawn from the exponential distribution with the mean
+        // 1 / ln(M), so each level has about M times fewer nodes.
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        double u = 1.0 - uniform(level_rng); // (0, 1]
+        size_t level = static_cast<size_t> (-log(u) / log(static_cast<double> (max<size_t>(params.M, 2))));
+        links.push_back(vector<vector<uint32_t> >(level + 1));
+        if (id == 0) {
+            entry = id;
+            max_level = level;
+            return;
+        }
+        link(id);
+        if (level > max_level) {
+            max_level = level;
+            entry = id;
+        }
+    }
+
+    /*
+     * The node keeps its level and the links of other nodes to it, which
+     * lead to it still. Its own links are chosen again as in add.
+     */
+    void
+    hnsw_index::update(uint32_t id, const vector<float> & v) {
+        if (v.size() != dim)
+            throw invalid_argument("Vector added to HNSW index has a wrong dimension.");
+        copy(begin(v), end(v), begin(vectors) + static_cast<ptrdiff_t> (id * dim));
+        if (links.size() > 1)
+            link(id);
+    }
+
+    void
+    hnsw_index::link(uint32_t id) {
+        size_t level = links[id].size() - 1;
+        const float * query = vector_of(id);
+        uint32_t ep = entry;
+        pmr::memory_resource * resource = pmr::get_default_resource();
+        for (size_t l = max_level; l > level; --l)
+            ep = search_layer(query, ep, 1, l, resource)[0].second;
+        for (size_t l = min(level, max_level) + 1; l-- > 0;) {
+            pmr::vector<result> found = search_layer(query, ep, params.ef_construction, l, resource);
+            // An updated node is found itself.
+            found.erase(remove_if(begin(found), end(found), [id](const result & r) {
+                return r.second == id; }), end(found));
+            if (found.empty())
+                continue;
+            links[id][l] = select_neighbours(found, params.M);
+            for (uint32_t n : links[id][l]) {
+                vector<uint32_t> & n_links = links[n][l];
+                if (find(begin(n_links), end(n_links), id) != end(n_links))
+                    continue;
+                n_links.push_back(id);
+                if (n_links.size() > max_links(l)) {
+                    pmr::vector<result> candidates(resource);
+                    for (uint32_t m : n_links)
+                        candidates.emplace_back(distance(vector_of(n), vector_of(m)), m);
+                    sort(begin(candidates), end(candidates));
+                    n_links = select_neighbours(candidates, max_links(l));
+                }
+            }
+            ep = found[0].second;
+        }
+    }
+
+    pmr::vector<hnsw_index::result>
+    hnsw_index::search(uint32_t id, size_t k, pmr::memory_resource * resource) const {
+        return search(vector_of(id), k, resource);
+    }
+
+    pmr::vector<hnsw_index::result>
+    hnsw_index::search(const float * query, size_t k, pmr::memory_resource * resource) const {
+        if (links.empty())
+            return pmr::vector<result>(resource);
+        uint32_t ep = entry;
+        for (size_t l = max_level; l > 0; --l)
+            ep = search_layer(query, ep, 1, l, resource)[0].second;
+        pmr::vector<result> res = search_layer(query, ep, max(params.ef_search, k), 0, resource);
+        if (res.size() > k)
+            res.resize(k);
+        return res;
+    }
+
+    void
+    hnsw_index::set_ef_search(size_t ef) {
+        params.ef_search = ef;
+    }
+
+    const hnsw_params &
+    hnsw_index::get_params() const {
+        return params;
+    }
+
+    size_t
+    hnsw_index::size() const {
+        return links.size();
+    }
+
+    size_t
+    hnsw_index::memory_usage() const {
+        size_t res = vectors.capacity() * sizeof (float);
+        res += links.capacity() * sizeof (links[0]);
+        for (auto && node : links) {
+            res += node.capacity() * sizeof (node[0]);
+            for (auto && level : node)
+                res += level.capacity() * sizeof (uint32_t);
+        }
+        return res;
+    }
+
+    /*
+     * The file is a binary dump in the native byte order: magic, header
+     * (fingerprint, count, dim, M, ef_construction, entry, max_level),
+     * vectors and for each node and its level the count and ids of links.
+     */
+    bool
+    hnsw_index::load(const string & path, uint64_t fingerprint, size_t count, size_t dim_) {
+        ifstream ifs(path, ios::binary | ios::ate);
+        if (!ifs)
+            return false;
+        uint64_t file_size = static_cast<uint64_t> (ifs.tellg());
+        ifs.seekg(0);
+        auto && get = [&ifs](auto * data, size_t cnt) {
+            ifs.read(reinterpret_cast<char *> (data), static_cast<streamsize> (cnt * sizeof (*data)));
+        };
+        auto && damaged = [&path]() {
+            return runtime_error("HNSW index " + path + " is damaged, rebuild it.");
+        };
+        char magic[sizeof (hnsw_magic)];
+        uint64_t header[7];
+        get(magic, sizeof (magic));
+        get(header, 7);
+        if (!ifs || !equal(begin(magic), end(magic), begin(hnsw_magic)))
+            throw damaged();
+        if (header[0] != fingerprint || header[1] != count || header[2] != dim_)
+            throw runtime_error("HNSW index " + path + " was built for other cards, rebuild it.");
+        // Every node has at least its vector and the count of its levels.
+        uint64_t rest = file_size - sizeof (hnsw_magic) - sizeof (header);
+        if (rest / (dim_ * sizeof (float) + sizeof (uint32_t)) < count)
+            throw damaged();
+        uint64_t M = header[3];
+        if (count != 0 && (M == 0 || header[5] >= count || header[6] > max_levels))
+            throw damaged();
+        vector<float> vectors_(count * dim_);
+        get(vectors_.data(), vectors_.size());
+        vector<vector<vector<uint32_t> > > links_(count);
+        for (auto && node : links_) {
+            uint32_t levels = 0;
+            get(&levels, 1);
+            if (!ifs || levels == 0 || levels > header[6] + 1)
+                throw damaged();
+            node.resize(levels);
+            for (size_t l = 0; l < levels; ++l) {
+                uint32_t cnt = 0;
+                get(&cnt, 1);
+                if (!ifs || cnt > (l == 0 ? 2 * M : M))
+                    throw damaged();
+                node[l].resize(cnt);
+                get(node[l].data(), cnt);
+                if (any_of(begin(node[l]), end(node[l]), [count](uint32_t id) {
+                        return id >= count; }))
+                    throw damaged();
+            }
+        }
+        if (!ifs || (count != 0 && links_[header[5]].size() != header[6] + 1))
+            throw damaged();
+        dim = dim_;
+        params.M = M;
+        params.ef_construction = header[4];
+        entry = static_cast<uint32_t> (header[5]);
+        max_level = header[6];
+        vectors = move(vectors_);
+        links = move(links_);
+        return true;
+    }
+
+    void
+    hnsw_index::save(const string & path, uint64_t fingerprint) const {
+        ofstream ofs(path, ios::binary | ios::trunc);
+        auto && put = [&ofs](const auto * data, size_t cnt) {
+            ofs.write(reinterpret_cast<const char *> (data), static_cast<streamsize> (cnt * sizeof (*data)));
+        };
+        uint64_t header[7] = {fingerprint, links.size(), dim, params.M,
+            params.ef_construction, entry, max_level};
+        put(hnsw_magic, sizeof (hnsw_magic));
+        put(header, 7);
+        put(vectors.data(), vectors.size());
+        for (auto && node : links) {
+            uint32_t levels = static_cast<uint32_t> (node.size());
+            put(&levels, 1);
+            for (auto && level : node) {
+                uint32_t cnt = static_cast<uint32_t> (level.size());
+                put(&cnt, 1);
+                put(level.data(), cnt);
+            }
+        }
+        if (!ofs)
+            throw runtime_error("HNSW index could not be written to " + path + ".");
+    }
+
+    float
+    hnsw_index::distance(const float * a, const float * b) const {
+        float res = 0;
+        for (size_t i = 0; i < dim; ++i) {
+            float d = a[i] - b[i];
+            res += d * d;
+        }
+        return res;
+    }
+
+    const float *
+    hnsw_index::vector_of(uint32_t id) const {
+        return &(vectors[id * dim]);
+    }
+
+    /*
+     * Best-first search on one level starting from ep, returns at most ef
+     * closest nodes found, sorted from the closest one.
+     */
+    pmr::vector<hnsw_index::result>
+    hnsw_index::search_layer(const float * query, uint32_t ep, size_t ef, size_t level,
+            pmr::memory_resource * resource) const {
+        // Visited nodes are marked by the number of the search, so that
+        // the marks need not be cleared for every search.
+        thread_local vector<uint32_t> visited;
+        thread_local uint32_t search_no = 0;
+        if (visited.size() < links.size())
+            visited.resize(links.size(), 0);
+        if (++search_no == 0) {
+            fill(begin(visited), end(visited), 0);
+            search_no = 1;
+        }
+
+        priority_queue<result, pmr::vector<result>, greater<result> > candidates{
+            greater<result>(), pmr::vector<result>(resource)};
+        priority_queue<result, pmr::vector<result> > found{
+            less<result>(), pmr::vector<result>(resource)};
+        float d = distance(query, vector_of(ep));
+        candidates.emplace(d, ep);
+        found.emplace(d, ep);
+        visited[ep] = search_no;
+        while (!candidates.empty()) {
+            result c = candidates.top();
+            if (c.first > found.top().first && found.size() >= ef)
+                break;
+            candidates.pop();
+            for (uint32_t n : links[c.second][level]) {
+                if (visited[n] == search_no)
+                    continue;
+                visited[n] = search_no;
+                float dn = distance(query, vector_of(n));
+                if (found.size() < ef || dn < found.top().first) {
+                    candidates.emplace(dn, n);
+                    found.emplace(dn, n);
+                    if (found.size() > ef)
+                        found.pop();
+                }
+            }
+        }
+        pmr::vector<result> res(found.size(), resource);
+        for (size_t i = res.size(); i-- > 0;) {
+            res[i] = found.top();
+            found.pop();
+        }
+        return res;
+    }
+
+    /*
+     * The heuristic from the paper: a candidate (sorted from the closest)
+     * is linked only if it is closer to the node than to any already
+     * linked one, which keeps links spread to all directions.
+     */
+    vector<uint32_t>
+    hnsw_index::select_neighbours(const pmr::vector<result> & candidates, size_t m) const {
+        vector<uint32_t> res;
+        for (const result & c : candidates) {
+            if (res.size() >= m)
+                break;
+            bool spread = all_of(begin(res), end(res), [&](uint32_t r) {
+                return distance(vector_of(c.second), vector_of(r)) >= c.first; });
+            if (spread)
+                res.push_back(c.second);
+        }
+        return res;
+    }
+
+    size_t
+    hnsw_index::max_links(size_t level) const {
+        return level == 0 ? 2 * params.M : params.M;
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   hnsw.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 11:40 AM
+ */
+
+#ifndef HNSW_HPP
+#define HNSW_HPP
+
+#include <cstdint>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    struct hnsw_params {
+        // Links per node on upper levels (twice as many on the lowest one).
+        size_t M = 16;
+        // Width of the search while inserting, better graph for higher.
+        size_t ef_construction = 200;
+        // Width of the search while querying, better recall for higher.
+        size_t ef_search = 64;
+    } ;
+
+    /*
+     * Hierarchical navigable small world graph (Malkov, Yashunin) over
+     * vectors of a fixed dimension with the euclidean distance. Nodes are
+     * identified by the order of adding, which is the position of the card
+     * in db.get_cards().
+     */
+    class hnsw_index {
+    public:
+        using result = std::pair<float, std::uint32_t>; // (squared distance, id)
+
+    private:
+        hnsw_params params;
+        size_t dim;
+        std::vector<float> vectors;
+        // links[id][level] are neighbours of id on the level.
+        std::vector<std::vector<std::vector<std::uint32_t> > > links;
+        std::uint32_t entry;
+        size_t max_level;
+        // Fixed seed, the same catalog always gives the same graph.
+        std::mt19937 level_rng;
+
+    public:
+
+        hnsw_index() : dim(0), entry(0), max_level(0) {
+        }
+
+        hnsw_index(size_t dim_, const hnsw_params & params_) : params(params_), dim(dim_),
+        entry(0), max_level(0) {
+        }
+
+        void
+        add(const std::vector<float> & v);
+
+        // The vector of the node id changed.
+        void
+        update(std::uint32_t id, const std::vector<float> & v);
+
+        /*
+         * Approximately k nearest nodes to the node id (itself included),
+         * sorted from the closest one. At least ef_search nodes are visited.
+         * The result and temporaries are allocated from resource.
+         */
+        std::pmr::vector<result>
+        search(std::uint32_t id, size_t k,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const;
+
+        std::pmr::vector<result>
+        search(const float * query, size_t k,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const;
+
+        void
+        set_ef_search(size_t ef);
+
+        const hnsw_params &
+        get_params() const;
+
+        size_t
+        size() const;
+
+        // Approximate heap bytes of vectors and links.
+        size_t
+        memory_usage() const;
+
+        /*
+         * Returns false when there is no index at path. Throws
+         * std::runtime_error for a damaged index or one built for another
+         * catalog (fingerprint, count of cards or dimension differs).
+         */
+        bool
+        load(const std::string & path, std::uint64_t fingerprint,
+                size_t count, size_t dim);
+
+        void
+        save(const std::string & path, std::uint64_t fingerprint) const;
+
+    private:
+        // Links the node id to its nearest nodes on each of its levels.
+        void
+        link(std::uint32_t id);
+
+        float
+        distance(const float * a, const float * b) const;
+
+        const float *
+        vector_of(std::uint32_t id) const;
+
+        std::pmr::vector<result>
+        search_layer(const float * query, std::uint32_t ep, size_t ef, size_t level,
+                std::pmr::memory_resource * resource) const;
+
+        std::vector<std::uint32_t>
+        select_neighbours(const std::pmr::vector<result> & candidates, size_t m) const;
+
+        size_t
+        max_links(size_t level) const;
+    } ;
+}
+
+#endif /* HNSW_HPP */
@@ -0,0 +1,225 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "src/json_index.hpp"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    // Characters of a 64 byte block as bitmasks, bit i for byte i.
+    struct block_masks {
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t op; // { } [ ] : ,
+    } ;
+
+    static block_masks
+    classify_scalar(const char * block) {
+        block_masks res = {0, 0, 0};
+        for (size_t i = 0; i < 64; ++i) {
+            uint64_t bit = uint64_t(1) << i;
+            switch (block[i]) {
+                case '"': res.quote |= bit;
+                    break;
+                case '\\': res.backslash |= bit;
+                    break;
+                case '{':
+                case '}':
+                case '[':
+                case ']':
+                case ':':
+                case ',': res.op |= bit;
+                    break;
+                default: break;
+            }
+        }
+        return res;
+    }
+
+#if defined(__AVX2__)
+
+    static block_masks
+    classify_simd(const char * block) {
+        block_masks res = {0, 0, 0};
+        for (size_t i = 0; i < 2; ++i) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *> (block + 32 * i));
+            __m256i op = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+                    _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')),
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']'))),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')))));
+            size_t shift = 32 * i;
+            res.quote |= uint64_t(static_cast<uint32_t> (_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))))) << shift;
+            res.backslash |= uint64_t(static_cast<uint32_t> (_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))))) << shift;
+            res.op |= uint64_t(static_cast<uint32_t> (_mm256_movemask_epi8(op))) << shift;
+        }
+        return res;
+    }
+
+    const char *
+    simd_name() {
+        return "AVX2";
+    }
+
+#elif defined(__SSE2__)
+
+    static block_masks
+    classify_simd(const char * block) {
+        block_masks res = {0, 0, 0};
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *> (block + 16 * i));
+            __m128i op = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                    _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8(']'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8(',')))));
+            size_t shift = 16 * i;
+            res.quote |= uint64_t(static_cast<uint16_t> (_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))))) << shift;
+            res.backslash |= uint64_t(static_cast<uint16_t> (_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))))) << shift;
+            res.op |= uint64_t(static_cast<uint16_t> (_mm_movemask_epi8(op))) << shift;
+        }
+        return res;
+    }
+
+    const char *
+    simd_name() {
+        return "SSE2";
+    }
+
+#else
+
+    static block_masks
+    classify_simd(const char * block) {
+        return classify_scalar(block);
+    }
+
+    const char *
+    simd_name() {
+        return "none";
+    }
+
+#endif
+
+    /*
+     * Bits of characters escaped by a backslash: each odd-length run of
+     * backslashes escapes the character after it. prev_escaped carries
+     * whether the first byte of the next block is escaped.
+     */
+    static uint64_t
+    escaped_bits(uint64_t backslash, uint64_t & prev_escaped) {
+        const uint64_t even_bits = 0x5555555555555555ULL;
+        backslash &= ~prev_escaped;
+        uint64_t follows_escape = (backslash << 1) | prev_escaped;
+        uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+        uint64_t sequences_starting_on_even_bits;
+        prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash,
+                &sequences_starting_on_even_bits) ? 1 : 0;
+        uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+        return (even_bits ^ invert_mask) & follows_escape;
+    }
+
+    // Bit i is xor of bits 0..i.
+    static uint64_t
+    prefix_xor(uint64_t x) {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    structural_indexer::structural_indexer(scan_mode mode_) : mode(mode_),
+    offset(0), prev_escaped(0), prev_in_string(0) {
+    }
+
+    void
+    structural_indexer::add(string_view part, vector<uint32_t> & positions) {
+        if (offset + part.size() >= UINT32_MAX)
+            throw length_error("JSON input over 4 GiB cannot be indexed.");
+        block_masks (* classify)(const char *) =
+                mode == scan_mode::simd ? classify_simd : classify_scalar;
+        char tail[64];
+        // The vector grows ahead by doubling, so that each block can write its
+        // positions without resizing it, and is cut to the count at the end.
+        size_t count = positions.size();
+        for (size_t base = 0; base < part.size(); base += 64) {
+            const char * block = part.data() + base;
+            // The last block is padded with spaces.
+            if (part.size() - base < 64) {
+                memset(tail, ' ', sizeof (tail));
+                memcpy(tail, block, part.size() - base);
+                block = tail;
+            }
+            block_masks m = classify(block);
+            uint64_t quote = m.quote & ~escaped_bits(m.backslash, prev_escaped);
+            // Opening quotes and string contents, not closing quotes.
+            uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+            prev_in_string = static_cast<uint64_t> (static_cast<int64_t> (in_string) >> 63);
+            uint64_t structural = (m.op & ~in_string) | quote;
+
+            if (positions.size() < count + 64)
+                positions.resize(max(2 * positions.size(), count + 64));
+            uint32_t * out = positions.data() + count;
+            count += static_cast<size_t> (__builtin_popcountll(structural));
+            uint32_t at = static_cast<uint32_t> (offset + base);
+            while (structural != 0) {
+                *out++ = at + static_cast<uint32_t> (__builtin_ctzll(structural));
+                structural &= structural - 1;
+            }
+        }
+        positions.resize(count);
+        offset += part.size();
+    }
+
+    bool
+    structural_indexer::closed() const {
+        return prev_in_string == 0;
+    }
+
+    bool
+    structural_index(string_view input, vector<uint32_t> & positions, scan_mode mode) {
+        structural_indexer indexer(mode);
+        indexer.add(input, positions);
+        return indexer.closed();
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   json_index.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 10:05 PM
+ */
+
+#ifndef JSON_INDEX_HPP
+#define JSON_INDEX_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    enum class scan_mode {
+        simd, scalar
+    } ;
+
+    /*
+     * First stage of parsing JSON: positions of its structural characters,
+     * i.e. of { } [ ] : , outside strings and of quotes delimiting strings.
+     * Blocks of 64 bytes are classified at once into bitmasks, with SSE2 or
+     * AVX2 compares for scan_mode::simd, byte by byte for scan_mode::scalar,
+     * both give the same positions. Input must be shorter than 4 GiB.
+     * Returns false if the input ends inside a string.
+     */
+    bool
+    structural_index(std::string_view input, std::vector<uint32_t> & positions,
+            scan_mode mode = scan_mode::simd);
+
+    /*
+     * structural_index of an input given in consecutive parts, e.g. while it
+     * is decompressed. Every part but the last one must be a multiple of 64
+     * bytes long, positions are offsets from the start of the first part.
+     */
+    class structural_indexer {
+    private:
+        scan_mode mode;
+        size_t offset;
+        uint64_t prev_escaped;
+        uint64_t prev_in_string; // All ones inside a string.
+
+    public:
+        explicit
+        structural_indexer(scan_mode mode_ = scan_mode::simd);
+
+        // Appends positions of the next part of the input.
+        void
+        add(std::string_view part, std::vector<uint32_t> & positions);
+
+        // False if the input given so far ends inside a string.
+        bool
+        closed() const;
+    } ;
+
+    // Instructions used by scan_mode::simd: "AVX2", "SSE2" or "none".
+    const char *
+    simd_name();
+}
+
+#endif /* JSON_INDEX_HPP */
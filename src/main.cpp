@@ -1,11 +1,31 @@
 #include <thread>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <utility>
 #include <istream>
 #include <map>
+#include <fstream>
+#include <memory>
+#include <iomanip>
+#include <sstream>
 
 #include "database.hpp"
 #include "ui.hpp"
 #include "searching.hpp"
+#include "neighbours.hpp"
+#include "profiling.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
+#include "sampler.hpp"
+#include "zip_input.hpp"
+#include "name_directory.hpp"
+#include "engine_image.hpp"
+#include "card_store.hpp"
+#include "card_reader.hpp"
+#include "mapped_file.hpp"
+#include "shard.hpp"
 #include "../docopt.cpp/docopt.h"
 
 using namespace magicSearchEngine;
@@ -16,30 +36,105 @@ static const char USAGE[] =
         R"(Magic Search Engine.
 
     Usage:
-      MagicSearchEngine find <name>
-      MagicSearchEngine similar <name> [<number>]
+      MagicSearchEngine find <name> [--data=<file> --shards=<sockets> --shard-timeout=<ms> --shared-image --startup-profile=<file> --trace-out=<file> --profile-out=<file> --memstats]
+      MagicSearchEngine similar <name> [<number>] [--data=<file> --shards=<sockets> --shard-timeout=<ms> --shared-image --mode=<mode> --lsh-bands=<b> --lsh-rows=<r> --ef-search=<e> --startup-profile=<file> --trace-out=<file> --profile-out=<file> --memstats]
+      MagicSearchEngine build-neighbours [<k>] [--data=<file> --threads=<n>]
+      MagicSearchEngine build-hnsw [--data=<file> --hnsw-m=<m> --ef-construction=<e>]
+      MagicSearchEngine build-directory [--data=<file>]
+      MagicSearchEngine put <cards> [--data=<file>]
+      MagicSearchEngine delete <name> [--data=<file>]
+      MagicSearchEngine compact [--data=<file>]
+      MagicSearchEngine split-shards <shards> [--data=<file>]
+      MagicSearchEngine drop-image [--data=<file>]
+      MagicSearchEngine serve-shard <socket> [--data=<file> --shards=<sockets> --shard-timeout=<ms> --shared-image --mode=<mode> --lsh-bands=<b> --lsh-rows=<r> --ef-search=<e>]
       MagicSearchEngine (-h | --help)
-      MagicSearchEngine --interactive
+      MagicSearchEngine --interactive [--data=<file> --shared-image --mode=<mode> --lsh-bands=<b> --lsh-rows=<r> --ef-search=<e> --startup-profile=<file> --trace-out=<file> --profile-out=<file> --metrics-file=<file> --metrics-interval=<s>]
       MagicSearchEngine --version
 
     Options:
       <number>          Number of cards returned [default: 3].
+      <k>               Number of similar cards precomputed per card [default: 20].
+      --data=<file>     Cards in the format of AllCards.json or a zip of it
+                        (read if the file is missing), precomputed
+                        neighbours, HNSW graph and the card store are
+                        stored next to it [default: ./src/AllCards.json].
+      <cards>           Custom cards in the format of AllCards.json, put to
+                        the card store over cards of --data.
+      <shards>          Number of shards the catalog is split into, they are
+                        written next to it (AllCards.shard-0.json...).
+      <socket>          Path of the local socket a shard is served on.
+      --shards=<sockets>  Comma-separated sockets of served shards, which are
+                        queried instead of cards of --data.
+      --shard-timeout=<ms>  Milliseconds to wait for answers of shards, those
+                        answering later are left out [default: 1000].
+      --shared-image    Share cards and their terms with other processes of
+                        the same --data through an image in /dev/shm, the
+                        first one publishes it, others map it instead of
+                        loading (drop-image removes it).
+      --threads=<n>     Number of threads, 0 for all cores [default: 0].
+      --mode=<mode>     Similar cards among all (exact), text-similar (lsh) or
+                        nearest in HNSW graph (hnsw) ones [default: exact].
+      --lsh-bands=<b>   LSH bands, more bands give better recall [default: 16].
+      --lsh-rows=<r>    MinHashes per LSH band, more rows give fewer candidates [default: 4].
+      --hnsw-m=<m>      Links per node of HNSW graph [default: 16].
+      --ef-construction=<e>  Width of search when building HNSW graph [default: 200].
+      --ef-search=<e>   Width of search in HNSW graph, better recall for higher [default: 64].
+      --startup-profile=<file>  Time loading and indexing phases, write the table
+                        to stderr (-) or JSON to <file>.
+      --trace-out=<file>  Write spans of loading and queries as Chrome trace
+                        JSON to <file> (needs ./configure --enable-tracing).
+      --profile-out=<file>  Sample stacks of loading and queries, write them
+                        folded for flamegraphs to <file>.
+      --memstats        Show heap bytes of cards, vocabulary and index on stderr.
+      --metrics-file=<file>  Write latency percentiles of queries in Prometheus
+                        text format to <file>.
+      --metrics-interval=<s>  Seconds between writes of metrics file [default: 10].
       -h --help         Show this screen.
       --interactive     Run interactive mode (type 'help' there).
       --version         Show version.
 )";
 
+/*
+ * Path of a file stored next to the cards, e.g. ./src/AllCards.neighbours
+ * for ./src/AllCards.json (or ./src/AllCards.json.zip) and extension
+ * .neighbours.
+ */
+static string
+stored_path(const string & data_path, const string & extension) {
+    string path = data_path;
+    if (zip_input::is_zip(path))
+        path.erase(path.size() - 4);
+    size_t dot = path.rfind('.');
+    if (dot != string::npos && path.find('/', dot) == string::npos)
+        path.erase(dot);
+    return path + extension;
+}
+
+static string
+stored_path(const JSONDatabase & database, const string & extension) {
+    return stored_path(database.get_path(), extension);
+}
+
 static const char USAGE_INTERACTIVE[] =
         R"(Magic Search Engine, interactive mode.
 
     Usage:
       find <name>
       similar <name> [<number>]
+      put <cards>
+      delete <name>
+      stats
+      memstats
       MagicSearchEngine (h | help)
 
 
     Options:
       <number>          Number of cards returned [default: 3].
+      put <cards>       Put cards of a file to the card store, the index is
+                        patched for them.
+      delete <name>     Delete a card from the card store and the index.
+      stats             Show latency percentiles of queries so far.
+      memstats          Show heap bytes of cards, vocabulary and index.
       -h --help         Show this screen.
 )";
 
@@ -51,7 +146,13 @@ find(const JSONDatabase & database,
     if (!database.is_ready()) {
         data_loading.join();
     }
+    latency_timer total(query_command::find, query_phase::total);
+    latency_timer resolving(query_command::find, query_phase::name_resolution);
     auto res = oraculum.search_for(name);
+    resolving.finish();
+    latency_timer output(query_command::find, query_phase::output);
+    TRACE_SPAN("output");
+    PROFILE_PHASE("output");
     if (res == nullptr) {
         cout << "Demanded card was not found." << endl;
     }
@@ -79,13 +180,17 @@ similar(const JSONDatabase & database,
         cout << USAGE << endl;
         return;
     }
-    // Is db loaded?
-    if (!database.is_ready()) {
+    // Are db and index loaded? The index is created after the db is ready.
+    if (data_loading.joinable()) {
         data_loading.join();
     }
     // Searching.
-    vector<const Card *> res;
-    res = oraculum.find_similar(name, cnt); // Here cnt is >= 1.
+    arena_scope scope;
+    latency_timer total(query_command::similar, query_phase::total);
+    card_list res = oraculum.find_similar(name, cnt, scope.get()); // Here cnt is >= 1.
+    latency_timer output(query_command::similar, query_phase::output);
+    TRACE_SPAN("output");
+    PROFILE_PHASE("output");
     if (res.size() == 0) {
         cout << "Demanded card was not found." << endl;
     }
@@ -96,8 +201,309 @@ similar(const JSONDatabase & database,
     }
 }
 
+/*
+ * Offline step run after each data update, its output is picked up by
+ * the next start of the engine.
+ */
+static void
+build_neighbours(const JSONDatabase & database,
+        search_engine & oraculum,
+        thread & data_loading,
+        const string & k,
+        const string & threads) {
+    size_t k_ = 0;
+    size_t threads_ = 0;
+    try {
+        k_ = stoul(k);
+        threads_ = stoul(threads);
+    }
+    catch (...) {
+        cout << USAGE << endl;
+        return;
+    }
+    if (data_loading.joinable()) {
+        data_loading.join();
+    }
+    neighbour_table table = build_neighbour_table(oraculum, database.get_cards(),
+            k_, threads_, cerr);
+    table.save(stored_path(database, ".neighbours"));
+}
+
+/*
+ * find without loading the catalog, its record is read through the name
+ * directory (see build-directory). False if there is no usable directory.
+ */
+static bool
+find_in_directory(const JSONDatabase & database, const string & name) {
+    try {
+        name_directory directory;
+        if (!directory.load(stored_path(database, ".names"), database.get_path()))
+            return false;
+        string_pool strings;
+        optional<Card> card = directory.find(name, strings);
+        if (card)
+            cout << *card << endl;
+        else
+            cout << "Demanded card was not found." << endl;
+        return true;
+    }
+    catch (const runtime_error & e) {
+        // Stale directory is ignored, the catalog is loaded instead.
+        cerr << e.what() << endl;
+        return false;
+    }
+}
+
+/*
+ * The image of cards of the catalog, nullptr if it must be published (see
+ * engine_image).
+ */
+static shared_ptr<const engine_image>
+attach_image(const JSONDatabase & database, const string & path) {
+    try {
+        return engine_image::attach(path, database.get_path(), search_engine::tokenizer_version);
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return nullptr;
+    }
+}
+
+static void
+publish_image(const JSONDatabase & database, const search_engine & oraculum, const string & path) {
+    try {
+        oraculum.publish_image(path, database.get_path());
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+    }
+}
+
+// Processes which attached the image keep it until they end.
+static int
+drop_image(const JSONDatabase & database) {
+    string path = engine_image::path_of(database.get_path());
+    if (remove(path.c_str()) != 0 && errno != ENOENT) {
+        cerr << "Engine image " << path << " could not be removed: " << strerror(errno) << "." << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Offline step like build-neighbours, the catalog is only scanned for
+ * names of cards.
+ */
+static int
+build_directory(const JSONDatabase & database) {
+    try {
+        auto start = chrono::steady_clock::now();
+        size_t names = name_directory::build(database.get_path(), stored_path(database, ".names"));
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cerr << "directory: " << names << " names in " << elapsed.count() << " s" << endl;
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Changes of the card store; cards of a file are synced to its log and
+ * published at once, see card_store. In interactive mode the index of
+ * oraculum follows them.
+ */
+static int
+put_cards(card_store & database, const string & path, search_engine * oraculum = nullptr) {
+    try {
+        auto start = chrono::steady_clock::now();
+        mapped_file input(path);
+        card_reader reader(input.view());
+        // Keys of all cards are passed on together.
+        reader.keep_unescaped();
+        string_view key;
+        card_record record;
+        vector<pair<string_view, string_view> > records;
+        while (reader.next(key, record))
+            records.emplace_back(key, reader.card_text());
+        vector<card_update> updates = database.upsert(records);
+        if (oraculum)
+            oraculum->update_index(updates);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cerr << "put: " << records.size() << " cards in " << elapsed.count() << " s" << endl;
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int
+delete_card(card_store & database, const string & name, search_engine * oraculum = nullptr) {
+    try {
+        vector<card_update> updates = database.remove(name);
+        if (oraculum && updates.empty())
+            cout << "Demanded card was not found." << endl;
+        if (oraculum)
+            oraculum->update_index(updates);
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int
+compact_store(card_store & database) {
+    try {
+        database.compact();
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Offline step like build-directory, each shard is then served by its own
+ * process (serve-shard --data=<shard>).
+ */
+static int
+split_shards(const JSONDatabase & database, const string & count) {
+    size_t count_ = 0;
+    try {
+        count_ = stoul(count);
+    }
+    catch (...) {
+    }
+    if (count_ == 0) {
+        cout << USAGE << endl;
+        return 1;
+    }
+    try {
+        vector<string> shards;
+        for (size_t i = 0; i < count_; ++i)
+            shards.push_back(stored_path(database, ".shard-" + to_string(i) + ".json"));
+        size_t cards = split_catalog(database.get_path(), shards);
+        cerr << "shards: " << cards << " cards in " << count_ << " shards" << endl;
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int
+serve_shard(shard & served, const string & socket) {
+    try {
+        shard_server(socket, served).serve();
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+    }
+    return 1;
+}
+
+static void
+report_missing(const shard_answer & answer) {
+    for (const string & socket : answer.missing)
+        cerr << "Shard " << socket << " did not answer in time, cards of it are left out." << endl;
+}
+
+/*
+ * find and similar over shards, see shard_coordinator. Their output is
+ * the same as of one engine.
+ */
+static void
+find_in_shards(shard & shards, const string & name) {
+    shard_answer res = shards.find(name);
+    report_missing(res);
+    if (res.found.empty())
+        cout << "Demanded card was not found." << endl;
+    else
+        cout << res.found[0].printed << endl;
+}
+
+static void
+similar_in_shards(shard & shards, const string & name, const string & count) {
+    int cnt = 1;
+    try {
+        cnt = stoi(count);
+        if (cnt < 1) {
+            cout << "Number must be a positive integer." << endl;
+            return;
+        }
+    }
+    catch (...) {
+        cout << USAGE << endl;
+        return;
+    }
+    latency_timer total(query_command::similar, query_phase::total);
+    shard_answer res = shards.find_similar(name, static_cast<size_t> (cnt));
+    report_missing(res);
+    if (res.found.size() == 0) {
+        cout << "Demanded card was not found." << endl;
+    }
+    else {
+        for (const shard_card & card : res.found) {
+            cout << card.printed << endl;
+        }
+    }
+}
+
+static void
+build_hnsw(const JSONDatabase & database,
+        search_engine & oraculum,
+        thread & data_loading,
+        const hnsw_params & params) {
+    if (data_loading.joinable()) {
+        data_loading.join();
+    }
+    auto start = chrono::steady_clock::now();
+    hnsw_index index = oraculum.build_hnsw(params);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cerr << "hnsw: " << index.size() << " cards in " << elapsed.count() << " s" << endl;
+    index.save(stored_path(database, ".hnsw"), neighbour_table::catalog_fingerprint(database.get_cards()));
+}
+
+/*
+ * Walks engine structures by component and compares them with the heap
+ * retained by startup phases, as counted by the global operator new.
+ */
+static void
+memstats(const JSONDatabase & database,
+        const search_engine & oraculum,
+        thread & data_loading,
+        ostream & os) {
+    if (data_loading.joinable()) {
+        data_loading.join();
+    }
+    memory_report report;
+    account_memory(database, report);
+    oraculum.account_memory(report);
+    size_t card_count = database.get_cards().size();
+    os << "Heap of engine structures, " << card_count << " cards:" << endl;
+    report.print(os, card_count);
+    os << "Heap retained by startup phases:" << endl;
+    for (const phase_record & phase : startup_profile::instance().get_phases()) {
+        os << left << setw(18) << phase.name << right << setw(14) << phase.heap_delta_bytes
+                << setw(14) << phase.allocations << endl;
+    }
+    heap_usage heap = current_heap_usage();
+    os << "Heap now: " << heap.live_bytes << " bytes in " << heap.live_blocks
+            << " blocks, " << heap.allocations << " allocations since start." << endl;
+    if (database.get_image())
+        os << "Engine image: " << database.get_image()->mapped_bytes()
+            << " bytes shared with other processes." << endl;
+}
+
 inline void
-interactive_mode(const JSONDatabase & database,
+interactive_mode(card_store & database,
         search_engine & oraculum,
         thread & data_loading) {
     console cmd_ui(cin);
@@ -129,6 +535,24 @@ interactive_mode(const JSONDatabase & database,
                     similar(database, oraculum, data_loading, c.second[1], c.second[2]);
                 break;
             }
+            case cmd::put:
+            case cmd::remove:
+            {
+                // Changes wait for the index they patch.
+                if (data_loading.joinable())
+                    data_loading.join();
+                if (c.first == cmd::put)
+                    put_cards(database, c.second[1], &oraculum);
+                else
+                    delete_card(database, c.second[1], &oraculum);
+                break;
+            }
+            case cmd::stats:
+                query_metrics::instance().report(cout);
+                break;
+            case cmd::memstats:
+                memstats(database, oraculum, data_loading, cout);
+                break;
             default:
                 this_thread::yield();
                 break;
@@ -136,23 +560,204 @@ interactive_mode(const JSONDatabase & database,
     }
 }
 
+static void
+load_neighbours(const JSONDatabase & database, search_engine & oraculum) {
+    try {
+        neighbour_table table;
+        if (table.load(stored_path(database, ".neighbours"), database.get_cards()))
+            oraculum.set_neighbours(move(table));
+    }
+    catch (const runtime_error & e) {
+        // Stale table is ignored, exact search is used instead.
+        cerr << e.what() << endl;
+    }
+}
+
+static void
+load_hnsw(const JSONDatabase & database, search_engine & oraculum, const hnsw_params & params) {
+    try {
+        hnsw_index index;
+        if (index.load(stored_path(database, ".hnsw"), neighbour_table::catalog_fingerprint(database.get_cards()),
+                database.get_cards().size(), search_engine::embedding_size())) {
+            index.set_ef_search(params.ef_search);
+            oraculum.set_hnsw(move(index));
+            return;
+        }
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+    }
+    // Without a stored graph it must be built now, which takes a while.
+    oraculum.set_hnsw(oraculum.build_hnsw(params));
+}
+
+static void
+write_startup_profile(const string & path) {
+    if (path == "-") {
+        startup_profile::instance().report(cerr);
+        return;
+    }
+    ofstream ofs(path);
+    startup_profile::instance().write_json(ofs);
+    if (!ofs)
+        cerr << "Startup profile could not be written to " << path << "." << endl;
+}
+
+/*
+ * Applies similarity options, returns false for invalid ones.
+ */
+static bool
+configure(search_engine & oraculum, hnsw_params & params, map<string, docopt::value> & args) {
+    try {
+        if (args["--hnsw-m"])
+            params.M = stoul(args["--hnsw-m"].asString());
+        if (args["--ef-construction"])
+            params.ef_construction = stoul(args["--ef-construction"].asString());
+        if (args["--ef-search"])
+            params.ef_search = stoul(args["--ef-search"].asString());
+        if (params.M == 0 || params.ef_construction == 0)
+            return false;
+        if (args["--lsh-bands"] || args["--lsh-rows"]) {
+            size_t bands = args["--lsh-bands"] ? stoul(args["--lsh-bands"].asString()) : 16;
+            size_t rows = args["--lsh-rows"] ? stoul(args["--lsh-rows"].asString()) : 4;
+            if (bands == 0 || rows == 0)
+                return false;
+            oraculum.configure_lsh(bands, rows);
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    if (!args["--mode"] || args["--mode"].asString() == "exact")
+        oraculum.set_mode(similarity_mode::exact);
+    else if (args["--mode"].asString() == "lsh")
+        oraculum.set_mode(similarity_mode::lsh);
+    else if (args["--mode"].asString() == "hnsw")
+        oraculum.set_mode(similarity_mode::hnsw);
+    else
+        return false;
+    return true;
+}
+
 int
 main(int argc, char * argv[]) {
-    JSONDatabase database;
+    map<string, docopt::value> args = docopt::docopt(USAGE,{argv + 1, argv + argc},
+    true, // show help if requested
+    "Magic Search Engine 1.0"); // version string
+
+    string data_path = args["--data"] ? args["--data"].asString() : JSONDatabase::default_path;
+    card_store database(data_path, stored_path(data_path, ".store"));
     search_engine oraculum(database);
+
+    // Index parameters must be known before the index is created.
+    hnsw_params params;
+    if (!configure(oraculum, params, args)) {
+        cout << USAGE << endl;
+        return 1;
+    }
+
+    // Cards are those of the shards, nothing is loaded here.
+    if (args["--shards"]) {
+        vector<string> sockets;
+        istringstream list(args["--shards"].asString());
+        for (string socket; getline(list, socket, ',');)
+            sockets.push_back(socket);
+        long timeout = 1000;
+        try {
+            if (args["--shard-timeout"])
+                timeout = stol(args["--shard-timeout"].asString());
+        }
+        catch (...) {
+        }
+        if (sockets.empty() || timeout < 1) {
+            cout << USAGE << endl;
+            return 1;
+        }
+        shard_coordinator coordinator(sockets, chrono::milliseconds(timeout));
+        if (args["find"].asBool())
+            find_in_shards(coordinator, args["<name>"].asString());
+        else if (args["similar"].asBool())
+            similar_in_shards(coordinator, args["<name>"].asString(),
+                args["<number>"] ? args["<number>"].asString() : "3");
+        else if (args["serve-shard"].asBool())
+            return serve_shard(coordinator, args["<socket>"].asString());
+        return 0;
+    }
+
+    // None of these needs the whole catalog loaded.
+    if (args["split-shards"].asBool())
+        return split_shards(database, args["<shards>"].asString());
+    if (args["build-directory"].asBool())
+        return build_directory(database);
+    if (args["put"].asBool())
+        return put_cards(database, args["<cards>"].asString());
+    if (args["delete"].asBool())
+        return delete_card(database, args["<name>"].asString());
+    if (args["compact"].asBool())
+        return compact_store(database);
+    if (args["drop-image"].asBool())
+        return drop_image(database);
+    // The directory knows only cards of the catalog.
+    if (args["find"].asBool() && !database.is_used() &&
+            !args["--startup-profile"] && !args["--memstats"].asBool() &&
+            !args["--trace-out"] && !args["--profile-out"] &&
+            find_in_directory(database, args["<name>"].asString()))
+        return 0;
+
+    // An image holds cards of the catalog, not those of the card store.
+    shared_ptr<const engine_image> image;
+    string image_path;
+    if (args["--shared-image"].asBool() && !database.is_used()) {
+        image_path = engine_image::path_of(database.get_path());
+        image = attach_image(database, image_path);
+    }
+
+    // A single query tokenizes only texts of cards it scores.
+    if (args["find"].asBool() || args["similar"].asBool())
+        oraculum.set_index_mode(index_mode::lazy);
+
+    // Memory statistics compare with heap retained by startup phases.
+    if (args["--startup-profile"] || args["--memstats"].asBool() || args["--interactive"].asBool())
+        startup_profile::instance().enable();
+    if (args["--trace-out"]) {
+#ifndef MSE_TRACING
+        cerr << "Tracing is not compiled in, configure with --enable-tracing." << endl;
+#endif
+        trace_log::instance().enable();
+    }
+    TRACE_THREAD("UI");
+    if (args["--profile-out"])
+        sampling_profiler::instance().start();
+
     // We expect enough space between running this program and writing the first
     // command in interactive mode. So for fluency, we run a new thread doing
     // expensive methods separately and after command processing we only check,
     // that the user was not too fast. In case, we join the thread and simply wait.
     thread data_loading([&]() {
-        database.load_database();
+        TRACE_THREAD("data_loading");
+        try {
+            if (image) {
+                database.load_image(image);
+            }
+            else {
+                // Cards are indexed as they are built, see load_stages.
+                oraculum.index_while_loading(database);
+                database.load_database();
+            }
+        }
+        catch (const runtime_error & e) {
+            // Missing or damaged cards, there is nothing to search in.
+            cerr << e.what() << endl;
+            exit(1);
+        }
         oraculum.create_index();
+        load_neighbours(database, oraculum);
+        if (oraculum.get_mode() == similarity_mode::hnsw)
+            load_hnsw(database, oraculum, params);
+        if (!image_path.empty() && !image)
+            publish_image(database, oraculum, image_path);
     });
 
-    map<string, docopt::value> args = docopt::docopt(USAGE,{argv + 1, argv + argc},
-    true, // show help if requested
-    "Magic Search Engine 1.0"); // version string
-
     if (args["find"].asBool()) {
         find(database, oraculum, data_loading, args["<name>"].asString());
     }
@@ -164,10 +769,70 @@ main(int argc, char * argv[]) {
             similar(database, oraculum, data_loading, args["<name>"].asString(), args["<number>"].asString());
         }
     }
+    else if (args["build-neighbours"].asBool()) {
+        build_neighbours(database, oraculum, data_loading,
+                args["<k>"] ? args["<k>"].asString() : "20",
+                args["--threads"] ? args["--threads"].asString() : "0");
+    }
+    else if (args["build-hnsw"].asBool()) {
+        build_hnsw(database, oraculum, data_loading, params);
+    }
+    else if (args["serve-shard"].asBool()) {
+        data_loading.join();
+        engine_shard served(database, oraculum);
+        return serve_shard(served, args["<socket>"].asString());
+    }
     else if (args["--interactive"].asBool()) {
+        unique_ptr<metrics_file_writer> metrics;
+        if (args["--metrics-file"]) {
+            long interval = 10;
+            try {
+                if (args["--metrics-interval"])
+                    interval = stol(args["--metrics-interval"].asString());
+            }
+            catch (...) {
+                interval = 0;
+            }
+            if (interval < 1) {
+                cout << USAGE << endl;
+                return 1;
+            }
+            metrics.reset(new metrics_file_writer(args["--metrics-file"].asString(),
+                    chrono::seconds(interval)));
+        }
         interactive_mode(database, oraculum, data_loading);
     }
-    
+
+    if (args["--startup-profile"]) {
+        // The profile is complete only after the loading thread ends.
+        if (data_loading.joinable())
+            data_loading.join();
+        write_startup_profile(args["--startup-profile"].asString());
+    }
+    if (args["--memstats"].asBool()) {
+        memstats(database, oraculum, data_loading, cerr);
+    }
+    if (args["--profile-out"]) {
+        if (data_loading.joinable())
+            data_loading.join();
+        ofstream ofs(args["--profile-out"].asString());
+        sampling_profiler::instance().write_folded(ofs);
+        if (!ofs)
+            cerr << "Profile could not be written to " << args["--profile-out"].asString() << "." << endl;
+    }
+    if (args["--trace-out"]) {
+        if (data_loading.joinable())
+            data_loading.join();
+        ofstream ofs(args["--trace-out"].asString());
+        trace_log::instance().write_json(ofs);
+        if (!ofs)
+            cerr << "Trace could not be written to " << args["--trace-out"].asString() << "." << endl;
+    }
+
+    // An image being published would be left half written.
+    if (!image_path.empty() && !image && data_loading.joinable())
+        data_loading.join();
+
     // Avoiding destruction of detachable thread in case of script mode with
     // wrong input parameters (i.g. negative number). In this way detached
     // thread is killed with main() instead of terminating program with thread
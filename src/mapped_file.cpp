@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "src/mapped_file.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    mapped_file::mapped_file(const string & path) : data(nullptr), size(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("File " + path + " cannot be opened: " + strerror(errno) + ".");
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int error = errno;
+            close(fd);
+            throw runtime_error("File " + path + " cannot be read: " + strerror(error) + ".");
+        }
+        size = static_cast<size_t> (st.st_size);
+        // An empty file cannot be mapped, it is an empty view.
+        if (size != 0) {
+            void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                int error = errno;
+                close(fd);
+                throw runtime_error("File " + path + " cannot be mapped: " + strerror(error) + ".");
+            }
+            // It is read once from the start to the end.
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            data = static_cast<const char *> (mapping);
+        }
+        close(fd);
+    }
+
+    mapped_file::~mapped_file() {
+        if (data != nullptr)
+            munmap(const_cast<char *> (data), size);
+    }
+
+    string_view
+    mapped_file::view() const {
+        return string_view(data, size);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   mapped_file.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 9:20 PM
+ */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <string_view>
+
+namespace magicSearchEngine {
+
+    /*
+     * Read only memory mapping of a whole file, unmapped on destruction.
+     */
+    class mapped_file {
+    private:
+        const char * data;
+        size_t size;
+
+    public:
+        // Throws runtime_error if the file cannot be opened or mapped.
+        explicit
+        mapped_file(const std::string & path);
+
+        mapped_file(const mapped_file &) = delete;
+
+        mapped_file &
+        operator=(const mapped_file &) = delete;
+
+        ~mapped_file();
+
+        std::string_view
+        view() const;
+    } ;
+}
+
+#endif /* MAPPED_FILE_HPP */
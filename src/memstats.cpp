@@ -0,0 +1,157 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iomanip>
+#include <malloc.h>
+#include <unordered_map>
+#include <unordered_set>
+#include "src/memstats.hpp"
+#include "src/card.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    memory_component &
+    memory_report::component(const string & name) {
+        for (memory_component & c : components) {
+            if (c.name == name)
+                return c;
+        }
+        components.push_back({name, 0, 0});
+        return components.back();
+    }
+
+    void
+    memory_report::add(const string & name, size_t bytes, size_t allocations) {
+        memory_component & c = component(name);
+        c.bytes += bytes;
+        if (allocations == unknown || c.allocations == unknown)
+            c.allocations = unknown;
+        else
+            c.allocations += allocations;
+    }
+
+    void
+    memory_report::add_block(const string & name, const void * block) {
+        add(name, malloc_usable_size(const_cast<void *> (block)), 1);
+    }
+
+    void
+    memory_report::add_string(const string & name, const string & s) {
+        const char * data = s.data();
+        const char * object = reinterpret_cast<const char *> (&s);
+        if (data < object || data >= object + sizeof (s))
+            add_block(name, data);
+    }
+
+    /*
+     * Usable size of glibc chunk for a request: 8 bytes of header, 16 byte
+     * alignment and 24 usable bytes at least.
+     */
+    static size_t
+    chunk_usable_size(size_t request) {
+        size_t chunk = (request + 8 + 15) & ~static_cast<size_t> (15);
+        return (chunk < 32 ? 32 : chunk) - 8;
+    }
+
+    void
+    memory_report::add_node(const string & name, size_t payload) {
+        add(name, chunk_usable_size(payload), 1);
+    }
+
+    void
+    memory_report::add_buckets(const string & name, size_t bucket_count) {
+        // A single bucket is stored inside the container.
+        if (bucket_count > 1)
+            add(name, chunk_usable_size(bucket_count * sizeof (void *)), 1);
+    }
+
+    const vector<memory_component> &
+    memory_report::get_components() const {
+        return components;
+    }
+
+    void
+    memory_report::print(ostream & os, size_t card_count) const {
+        size_t total_bytes = 0;
+        size_t total_allocations = 0;
+        os << left << setw(18) << "component" << right << setw(14) << "bytes"
+                << setw(14) << "allocations" << setw(14) << "bytes/card" << endl;
+        for (const memory_component & c : components) {
+            os << left << setw(18) << c.name << right << setw(14) << c.bytes << setw(14);
+            if (c.allocations == unknown)
+                os << "-";
+            else
+                os << c.allocations;
+            os << setw(14) << fixed << setprecision(1)
+                    << (card_count ? static_cast<double> (c.bytes) / static_cast<double> (card_count) : 0.0)
+                    << endl;
+            total_bytes += c.bytes;
+            if (c.allocations != unknown)
+                total_allocations += c.allocations;
+        }
+        os << left << setw(18) << "total" << right << setw(14) << total_bytes
+                << setw(14) << total_allocations << setw(14) << fixed << setprecision(1)
+                << (card_count ? static_cast<double> (total_bytes) / static_cast<double> (card_count) : 0.0)
+                << endl;
+    }
+
+    /*
+     * Node of unordered containers in libstdc++: next pointer, value and
+     * cached hash code.
+     */
+    template<typename Container>
+    static void
+    account_unordered(const string & name, const Container & container, memory_report & report) {
+        report.add_buckets(name, container.bucket_count());
+        for (auto && value : container)
+            report.add_node(name, 2 * sizeof (void *) + sizeof (value));
+    }
+
+    static void
+    account_strings(const string & name, const unordered_set<string> & set,
+            memory_report & report) {
+        account_unordered(name, set, report);
+        for (auto && entry : set)
+            report.add_string(name, entry);
+    }
+
+    void
+    account_memory(const Database & db, memory_report & report) {
+        const vector<Card> & cards = db.get_cards();
+        report.add_vector("card structs", cards);
+        db.get_strings().account_memory(report, "card strings");
+        for (const Card & card : cards)
+            card.account_memory(report);
+        db.get_types().account_memory(report, "vocabulary");
+        db.get_subtypes().account_memory(report, "vocabulary");
+        db.get_supertypes().account_memory(report, "vocabulary");
+        db.get_layout().account_memory(report, "vocabulary");
+        db.get_colors().account_memory(report, "vocabulary");
+        db.get_mana().account_memory(report, "vocabulary");
+        account_strings("vocabulary", db.get_keyword_abilities(), report);
+        account_strings("vocabulary", db.get_keyword_actions(), report);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   memstats.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 5:30 PM
+ */
+
+#ifndef MEMSTATS_HPP
+#define MEMSTATS_HPP
+
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "src/database.hpp"
+#include "src/small_vector.hpp"
+
+namespace magicSearchEngine {
+
+    struct memory_component {
+        std::string name;
+        size_t bytes;
+        // Heap blocks, unknown for components that only estimate bytes.
+        size_t allocations;
+    } ;
+
+    /*
+     * Heap usage of engine structures by component. Blocks with a known
+     * address are measured by malloc_usable_size(), nodes of std::set and
+     * unordered containers are estimated from libstdc++ node layout.
+     */
+    class memory_report {
+    private:
+        std::vector<memory_component> components;
+
+        memory_component &
+        component(const std::string & name);
+
+    public:
+        static const size_t unknown = std::numeric_limits<size_t>::max();
+
+        void
+        add(const std::string & name, size_t bytes, size_t allocations);
+
+        // Heap block of a container or string buffer.
+        void
+        add_block(const std::string & name, const void * block);
+
+        // Only strings longer than the small string buffer own a block.
+        void
+        add_string(const std::string & name, const std::string & s);
+
+        template<typename T>
+        void
+        add_vector(const std::string & name, const std::vector<T> & v) {
+            if (v.capacity() != 0)
+                add_block(name, v.data());
+        }
+
+        // Nothing unless the values did not fit inline.
+        template<typename T, size_t N>
+        void
+        add_vector(const std::string & name, const small_vector<T, N> & v) {
+            if (!v.is_inline())
+                add_block(name, v.data());
+        }
+
+        // Node of payload bytes in a node based container.
+        void
+        add_node(const std::string & name, size_t payload);
+
+        // Bucket array of an unordered container.
+        void
+        add_buckets(const std::string & name, size_t bucket_count);
+
+        const std::vector<memory_component> &
+        get_components() const;
+
+        void
+        print(std::ostream & os, size_t card_count) const;
+    } ;
+
+    // Cards and vocabulary of the database.
+    void
+    account_memory(const Database & db, memory_report & report);
+}
+
+#endif /* MEMSTATS_HPP */
@@ -0,0 +1,249 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include "metrics.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    latency_histogram::latency_histogram() : total(0), sum_ns(0), max_ns(0) {
+        for (auto & bucket : buckets)
+            bucket.store(0, memory_order_relaxed);
+    }
+
+    size_t
+    latency_histogram::bucket_of(uint64_t ns) {
+        if (ns < 32)
+            return ns;
+        unsigned shift = 63u - static_cast<unsigned> (__builtin_clzll(ns)) - 4u;
+        return 32 + (shift - 1) * 16 + ((ns >> shift) - 16);
+    }
+
+    uint64_t
+    latency_histogram::bucket_top(size_t bucket) {
+        if (bucket < 32)
+            return bucket;
+        uint64_t shift = (bucket - 32) / 16 + 1;
+        uint64_t sub = (bucket - 32) % 16 + 16;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    void
+    latency_histogram::record(uint64_t ns) {
+        buckets[bucket_of(ns)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sum_ns.fetch_add(ns, memory_order_relaxed);
+        uint64_t current = max_ns.load(memory_order_relaxed);
+        while (ns > current && !max_ns.compare_exchange_weak(current, ns, memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t
+    latency_histogram::percentile(double q) const {
+        uint64_t n = count();
+        if (n == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t> (ceil(q * static_cast<double> (n)));
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets[i].load(memory_order_relaxed);
+            if (seen >= rank)
+                return min(bucket_top(i), max());
+        }
+        // Concurrent records may make the total ahead of the buckets.
+        return max();
+    }
+
+    uint64_t
+    latency_histogram::count() const {
+        return total.load(memory_order_relaxed);
+    }
+
+    uint64_t
+    latency_histogram::sum() const {
+        return sum_ns.load(memory_order_relaxed);
+    }
+
+    uint64_t
+    latency_histogram::max() const {
+        return max_ns.load(memory_order_relaxed);
+    }
+
+    query_metrics &
+    query_metrics::instance() {
+        static query_metrics metrics;
+        return metrics;
+    }
+
+    latency_histogram &
+    query_metrics::get(query_command command, query_phase phase) {
+        return histograms[static_cast<size_t> (command)][static_cast<size_t> (phase)];
+    }
+
+    const latency_histogram &
+    query_metrics::get(query_command command, query_phase phase) const {
+        return histograms[static_cast<size_t> (command)][static_cast<size_t> (phase)];
+    }
+
+    const char *
+    query_metrics::command_name(query_command command) {
+        switch (command) {
+            case query_command::find:
+                return "find";
+            case query_command::similar:
+                return "similar";
+            default:
+                return "";
+        }
+    }
+
+    const char *
+    query_metrics::phase_name(query_phase phase) {
+        switch (phase) {
+            case query_phase::name_resolution:
+                return "name_resolution";
+            case query_phase::candidates:
+                return "candidates";
+            case query_phase::scoring:
+                return "scoring";
+            case query_phase::output:
+                return "output";
+            case query_phase::total:
+                return "total";
+            default:
+                return "";
+        }
+    }
+
+    static double
+    to_us(uint64_t ns) {
+        return static_cast<double> (ns) / 1e3;
+    }
+
+    void
+    query_metrics::report(ostream & os) const {
+        os << left << setw(9) << "command" << setw(17) << "phase" << right
+                << setw(8) << "count" << setw(12) << "p50 [us]" << setw(12) << "p99 [us]"
+                << setw(12) << "p999 [us]" << setw(12) << "max [us]" << endl;
+        for (size_t c = 0; c < command_count; ++c) {
+            for (size_t p = 0; p < phase_count; ++p) {
+                const latency_histogram & h = histograms[c][p];
+                if (h.count() == 0)
+                    continue;
+                os << left << setw(9) << command_name(static_cast<query_command> (c))
+                        << setw(17) << phase_name(static_cast<query_phase> (p)) << right
+                        << setw(8) << h.count() << fixed << setprecision(1)
+                        << setw(12) << to_us(h.percentile(0.5))
+                        << setw(12) << to_us(h.percentile(0.99))
+                        << setw(12) << to_us(h.percentile(0.999))
+                        << setw(12) << to_us(h.max()) << endl;
+            }
+        }
+    }
+
+    void
+    query_metrics::write_prometheus(ostream & os) const {
+        static const double quantiles[] = {0.5, 0.99, 0.999};
+        os << "# HELP magic_search_query_latency_seconds Latency of queries by command and phase." << endl
+                << "# TYPE magic_search_query_latency_seconds summary" << endl;
+        os << setprecision(9);
+        for (size_t c = 0; c < command_count; ++c) {
+            for (size_t p = 0; p < phase_count; ++p) {
+                const latency_histogram & h = histograms[c][p];
+                if (h.count() == 0)
+                    continue;
+                string labels = string("command=\"") + command_name(static_cast<query_command> (c))
+                        + "\",phase=\"" + phase_name(static_cast<query_phase> (p)) + "\"";
+                for (double q : quantiles) {
+                    os << "magic_search_query_latency_seconds{" << labels << ",quantile=\"" << q
+                            << "\"} " << static_cast<double> (h.percentile(q)) / 1e9 << endl;
+                }
+                os << "magic_search_query_latency_seconds_sum{" << labels << "} "
+                        << static_cast<double> (h.sum()) / 1e9 << endl
+                        << "magic_search_query_latency_seconds_count{" << labels << "} "
+                        << h.count() << endl;
+            }
+        }
+    }
+
+    bool
+    query_metrics::write_prometheus(const string & path) const {
+        string tmp = path + ".tmp";
+        {
+            ofstream ofs(tmp);
+            write_prometheus(ofs);
+            if (!ofs)
+                return false;
+        }
+        return rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    latency_timer::latency_timer(query_command command, query_phase phase) :
+    histogram(&query_metrics::instance().get(command, phase)), start(chrono::steady_clock::now()) {
+    }
+
+    void
+    latency_timer::finish() {
+        if (!histogram)
+            return;
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        histogram->record(static_cast<uint64_t> (elapsed.count()));
+        histogram = nullptr;
+    }
+
+    metrics_file_writer::metrics_file_writer(const string & path_, chrono::seconds interval_) :
+    path(path_), interval(interval_), stopping(false) {
+        writer = thread([this]() {
+            run();
+        });
+    }
+
+    void
+    metrics_file_writer::run() {
+        unique_lock<mutex> lock(mtx);
+        while (!stopping) {
+            stop_requested.wait_for(lock, interval, [this]() {
+                return stopping;
+            });
+            if (!query_metrics::instance().write_prometheus(path))
+                cerr << "Metrics could not be written to " << path << "." << endl;
+        }
+    }
+
+    metrics_file_writer::~metrics_file_writer() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        stop_requested.notify_one();
+        writer.join();
+    }
+}
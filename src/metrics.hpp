@@ -0,0 +1,199 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   metrics.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 3:05 PM
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace magicSearchEngine {
+
+    /*
+     * Histogram of latencies in nanoseconds with HDR-like buckets: exact
+     * below 32 ns, then 16 linear sub-buckets per power of two, so
+     * a reported percentile is at most 1/16 above the true one. Recording
+     * is lock free and can run concurrently with reading.
+     */
+    class latency_histogram {
+    public:
+        static const size_t bucket_count = 32 + 59 * 16;
+
+    private:
+        std::array<std::atomic<uint64_t>, bucket_count> buckets;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> sum_ns;
+        std::atomic<uint64_t> max_ns;
+
+        static size_t
+        bucket_of(uint64_t ns);
+
+        // Highest value falling into the bucket.
+        static uint64_t
+        bucket_top(size_t bucket);
+
+    public:
+        latency_histogram();
+
+        void
+        record(uint64_t ns);
+
+        // Percentile q from (0, 1] in nanoseconds, 0 for empty histogram.
+        uint64_t
+        percentile(double q) const;
+
+        uint64_t
+        count() const;
+
+        uint64_t
+        sum() const;
+
+        uint64_t
+        max() const;
+    } ;
+
+    enum class query_command {
+        find,
+        similar
+    } ;
+
+    enum class query_phase {
+        name_resolution,
+        candidates,
+        scoring,
+        output,
+        total
+    } ;
+
+    /*
+     * Latencies of queries of all commands and phases in this process.
+     */
+    class query_metrics {
+    public:
+        static const size_t command_count = 2;
+        static const size_t phase_count = 5;
+
+    private:
+        latency_histogram histograms[command_count][phase_count];
+
+        query_metrics() {
+        }
+
+    public:
+        static query_metrics &
+        instance();
+
+        latency_histogram &
+        get(query_command command, query_phase phase);
+
+        const latency_histogram &
+        get(query_command command, query_phase phase) const;
+
+        // Table of p50, p99, p999 and max for the stats command.
+        void
+        report(std::ostream & os) const;
+
+        // Prometheus text exposition format.
+        void
+        write_prometheus(std::ostream & os) const;
+
+        // Writes through a temporary file, so a scraper never reads half of it.
+        bool
+        write_prometheus(const std::string & path) const;
+
+        static const char *
+        command_name(query_command command);
+
+        static const char *
+        phase_name(query_phase phase);
+    } ;
+
+    /*
+     * Records the time from construction to finish() or destruction
+     * into the histogram of the given command and phase.
+     */
+    class latency_timer {
+    private:
+        latency_histogram * histogram;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        latency_timer(query_command command, query_phase phase);
+
+        latency_timer(const latency_timer &) = delete;
+
+        latency_timer &
+        operator=(const latency_timer &) = delete;
+
+        void
+        finish();
+
+        ~latency_timer() {
+            finish();
+        }
+    } ;
+
+    /*
+     * Rewrites the Prometheus file of query_metrics every interval and
+     * once more when destroyed.
+     */
+    class metrics_file_writer {
+    private:
+        std::string path;
+        std::chrono::seconds interval;
+        std::mutex mtx;
+        std::condition_variable stop_requested;
+        bool stopping;
+        std::thread writer;
+
+        void
+        run();
+
+    public:
+        metrics_file_writer(const std::string & path_, std::chrono::seconds interval_);
+
+        metrics_file_writer(const metrics_file_writer &) = delete;
+
+        metrics_file_writer &
+        operator=(const metrics_file_writer &) = delete;
+
+        ~metrics_file_writer();
+    } ;
+}
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,305 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <functional>
+#include "minhash.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    /*
+     * Finalizer of splitmix64, turns the term hash and a seed into
+     * independent hash functions.
+     */
+    static inline uint64_t
+    mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static const uint32_t empty = UINT32_MAX;
+
+    // Seeds of the n hash functions.
+    static vector<uint64_t>
+    seeds_of(size_t n) {
+        vector<uint64_t> seeds(n);
+        for (size_t i = 0; i < n; ++i)
+            seeds[i] = mix(i + 1);
+        return seeds;
+    }
+
+    // Signature of terms given by hash_of (minimal hashes), all empty for no terms.
+    template<typename Terms, typename Hash>
+    static void
+    signature_of(const Terms & terms, Hash && hash_of, uint32_t * signature,
+            const vector<uint64_t> & seeds, vector<uint64_t> & mins) {
+        const size_t n = seeds.size();
+        fill(signature, signature + n, empty);
+        if (terms.empty())
+            return;
+        mins.assign(n, UINT64_MAX);
+        for (auto && term : terms) {
+            uint64_t h = hash_of(term);
+            for (size_t i = 0; i < n; ++i)
+                mins[i] = min(mins[i], mix(h ^ seeds[i]));
+        }
+        for (size_t i = 0; i < n; ++i)
+            signature[i] = static_cast<uint32_t> (mins[i] >> 32);
+    }
+
+    static void
+    signature_of(const set<string> & terms, uint32_t * signature, const vector<uint64_t> & seeds,
+            vector<uint64_t> & mins) {
+        signature_of(terms, hash<string>(), signature, seeds, mins);
+    }
+
+    static uint64_t
+    band_hash_of(const vector<uint32_t> & signatures, size_t pos, size_t band, size_t bands, size_t rows) {
+        const uint32_t * row = &(signatures[(pos * bands + band) * rows]);
+        uint64_t h = band;
+        for (size_t i = 0; i < rows; ++i)
+            h = mix(h ^ row[i]);
+        return h;
+    }
+
+    static void
+    fill_buckets(minhash_index::bucket_table & buckets, const vector<uint32_t> & signatures,
+            size_t bands, size_t rows) {
+        const size_t n = bands * rows;
+        buckets.assign(bands, unordered_map<uint64_t, vector<uint32_t> >());
+        for (size_t pos = 0; pos < signatures.size() / n; ++pos) {
+            if (signatures[pos * n] == empty)
+                continue;
+            for (size_t band = 0; band < bands; ++band)
+                buckets[band][band_hash_of(signatures, pos, band, bands, rows)].push_back(static_cast<uint32_t> (pos));
+        }
+    }
+
+    void
+    minhash_index::build(const vector<set<string> > & index) {
+        const size_t n = bands * rows;
+        vector<uint64_t> seeds = seeds_of(n);
+        vector<uint64_t> mins(n);
+        signatures.assign(index.size() * n, empty);
+        for (size_t pos = 0; pos < index.size(); ++pos)
+            signature_of(index[pos], &(signatures[pos * n]), seeds, mins);
+        fill_buckets(buckets, signatures, bands, rows);
+        stale = 0;
+        compacting = false;
+        changed.clear();
+    }
+
+    void
+    minhash_index::build(size_t count, const function<void(size_t, vector<uint64_t> &)> & hashes_of) {
+        const size_t n = bands * rows;
+        vector<uint64_t> seeds = seeds_of(n);
+        vector<uint64_t> mins(n);
+        vector<uint64_t> hashes;
+        signatures.assign(count * n, empty);
+        for (size_t pos = 0; pos < count; ++pos) {
+            hashes_of(pos, hashes);
+            signature_of(hashes, [](uint64_t h) {
+                return h;
+            }, &(signatures[pos * n]), seeds, mins);
+        }
+        fill_buckets(buckets, signatures, bands, rows);
+        stale = 0;
+        compacting = false;
+        changed.clear();
+    }
+
+    void
+    minhash_index::sign(size_t pos, const set<string> & terms) {
+        vector<uint64_t> mins;
+        signature_of(terms, &(signatures[pos * bands * rows]), seeds_of(bands * rows), mins);
+    }
+
+    void
+    minhash_index::rebucket(size_t pos, const vector<uint64_t> & old) {
+        bool has = signatures[pos * bands * rows] != empty;
+        for (size_t band = 0; band < bands; ++band) {
+            uint64_t h = has ? band_hash(pos, band) : 0;
+            if (!old.empty() && has && old[band] == h)
+                continue;
+            if (!old.empty())
+                ++stale;
+            if (!has)
+                continue;
+            vector<uint32_t> & bucket = buckets[band][h];
+            // The card may come back to a bucket it left.
+            if (find(begin(bucket), end(bucket), pos) != end(bucket))
+                --stale;
+            else
+                bucket.push_back(static_cast<uint32_t> (pos));
+        }
+        if (compacting)
+            changed.push_back(static_cast<uint32_t> (pos));
+    }
+
+    void
+    minhash_index::add(const set<string> & terms) {
+        size_t pos = size();
+        signatures.resize(signatures.size() + bands * rows);
+        if (buckets.empty())
+            buckets.assign(bands, unordered_map<uint64_t, vector<uint32_t> >());
+        sign(pos, terms);
+        rebucket(pos, {});
+    }
+
+    void
+    minhash_index::update(size_t pos, const set<string> & terms) {
+        vector<uint64_t> old;
+        if (signatures[pos * bands * rows] != empty) {
+            for (size_t band = 0; band < bands; ++band)
+                old.push_back(band_hash(pos, band));
+        }
+        sign(pos, terms);
+        rebucket(pos, old);
+    }
+
+    size_t
+    minhash_index::size() const {
+        return signatures.size() / (bands * rows);
+    }
+
+    size_t
+    minhash_index::stale_entries() const {
+        return stale;
+    }
+
+    minhash_index::compaction
+    minhash_index::start_compaction() {
+        compaction res;
+        res.bands = bands;
+        res.rows = rows;
+        res.signatures = signatures;
+        compacting = true;
+        changed.clear();
+        return res;
+    }
+
+    void
+    minhash_index::compaction::build() {
+        fill_buckets(buckets, signatures, bands, rows);
+    }
+
+    void
+    minhash_index::finish_compaction(compaction && done) {
+        buckets = move(done.buckets);
+        stale = 0;
+        compacting = false;
+        sort(begin(changed), end(changed));
+        changed.erase(unique(begin(changed), end(changed)), end(changed));
+        const size_t n = bands * rows;
+        for (uint32_t pos : changed) {
+            // Buckets of done hold the card as it was when it started.
+            vector<uint64_t> old;
+            if (pos < done.signatures.size() / n && done.signatures[pos * n] != empty) {
+                for (size_t band = 0; band < bands; ++band)
+                    old.push_back(band_hash_of(done.signatures, pos, band, bands, rows));
+            }
+            rebucket(pos, old);
+        }
+        changed.clear();
+    }
+
+    pmr::vector<uint32_t>
+    minhash_index::candidates(size_t pos, pmr::memory_resource * resource) const {
+        if (signatures.empty() || signatures[pos * bands * rows] == empty)
+            return pmr::vector<uint32_t>(resource);
+        pmr::vector<uint32_t> res = in_buckets(signatures, pos, resource);
+        res.erase(remove(begin(res), end(res), pos), end(res));
+        return res;
+    }
+
+    pmr::vector<uint32_t>
+    minhash_index::candidates(const set<string> & terms, pmr::memory_resource * resource) const {
+        if (signatures.empty())
+            return pmr::vector<uint32_t>(resource);
+        vector<uint32_t> signature(bands * rows);
+        vector<uint64_t> mins;
+        signature_of(terms, signature.data(), seeds_of(bands * rows), mins);
+        if (signature[0] == empty)
+            return pmr::vector<uint32_t>(resource);
+        return in_buckets(signature, 0, resource);
+    }
+
+    pmr::vector<uint32_t>
+    minhash_index::in_buckets(const vector<uint32_t> & table, size_t pos,
+            pmr::memory_resource * resource) const {
+        pmr::vector<uint32_t> res(resource);
+        for (size_t band = 0; band < bands; ++band) {
+            uint64_t h = band_hash_of(table, pos, band, bands, rows);
+            auto it = buckets[band].find(h);
+            if (it == buckets[band].end())
+                continue;
+            const vector<uint32_t> & bucket = it->second;
+            if (stale == 0) {
+                res.insert(end(res), begin(bucket), end(bucket));
+                continue;
+            }
+            // Tombstones are cards which are in other buckets now.
+            for (uint32_t other : bucket) {
+                if (signatures[other * bands * rows] != empty && band_hash(other, band) == h)
+                    res.push_back(other);
+            }
+        }
+        sort(begin(res), end(res));
+        res.erase(unique(begin(res), end(res)), end(res));
+        return res;
+    }
+
+    size_t
+    minhash_index::get_bands() const {
+        return bands;
+    }
+
+    size_t
+    minhash_index::get_rows() const {
+        return rows;
+    }
+
+    size_t
+    minhash_index::memory_usage() const {
+        size_t res = signatures.capacity() * sizeof (uint32_t);
+        for (auto && band : buckets) {
+            res += band.bucket_count() * sizeof (void *);
+            for (auto && bucket : band) {
+                // Node: next pointer, key, vector and cached hash.
+                res += sizeof (void *) + sizeof (bucket) + sizeof (size_t);
+                res += bucket.second.capacity() * sizeof (uint32_t);
+            }
+        }
+        return res;
+    }
+
+    uint64_t
+    minhash_index::band_hash(size_t pos, size_t band) const {
+        return band_hash_of(signatures, pos, band, bands, rows);
+    }
+}
@@ -0,0 +1,183 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   minhash.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 10:05 AM
+ */
+
+#ifndef MINHASH_HPP
+#define MINHASH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    /*
+     * MinHash signatures of cards' term sets (rows of search_engine::index)
+     * split to bands; cards whose signatures agree on a whole band share
+     * a bucket. Two cards with Jaccard similarity s of their terms meet in
+     * some bucket with probability 1 - (1 - s^rows)^bands, so more bands
+     * (or fewer rows) mean better recall and more candidates to score.
+     *
+     * A changed card is put to the buckets of its new signature, its entries
+     * in the old ones are left there as tombstones, which candidates skips.
+     * A compaction rebuilds buckets without them.
+     */
+    class minhash_index {
+    public:
+        // For each band: band hash -> positions of cards.
+        using bucket_table = std::vector<std::unordered_map<std::uint64_t, std::vector<std::uint32_t> > >;
+
+        /*
+         * Buckets rebuilt from signatures of the moment it was started, so
+         * that build() may run on another thread while the index changes.
+         */
+        class compaction {
+        private:
+            friend class minhash_index;
+
+            size_t bands;
+            size_t rows;
+            std::vector<std::uint32_t> signatures;
+            bucket_table buckets;
+
+        public:
+            void
+            build();
+        } ;
+
+    private:
+        size_t bands;
+        size_t rows;
+        // card_count * bands * rows minimal hashes.
+        std::vector<std::uint32_t> signatures;
+        bucket_table buckets;
+        // Entries of buckets left by changed cards.
+        size_t stale;
+        // Cards changed since the compaction started.
+        bool compacting;
+        std::vector<std::uint32_t> changed;
+
+    public:
+
+        minhash_index(size_t bands_ = 16, size_t rows_ = 4) : bands(bands_), rows(rows_),
+        stale(0), compacting(false) {
+        }
+
+        void
+        build(const std::vector<std::set<std::string> > & index);
+
+        /*
+         * The same for count cards whose terms are given by their hashes
+         * (std::hash<std::string>), hashes_of puts those of the card at pos
+         * to its vector.
+         */
+        void
+        build(size_t count, const std::function<void(size_t, std::vector<std::uint64_t> &)> & hashes_of);
+
+        // A card of terms added after the others.
+        void
+        add(const std::set<std::string> & terms);
+
+        // Terms of the card at pos changed, none for a removed card.
+        void
+        update(size_t pos, const std::set<std::string> & terms);
+
+        // Number of cards.
+        size_t
+        size() const;
+
+        // Entries of buckets which are tombstones.
+        size_t
+        stale_entries() const;
+
+        compaction
+        start_compaction();
+
+        /*
+         * Takes buckets of done, a compaction started by this index. Cards
+         * changed since it started are put to them again.
+         */
+        void
+        finish_compaction(compaction && done);
+
+        /*
+         * Sorted positions of cards sharing at least one bucket with the
+         * card at pos (the card itself excluded). Cards without any terms
+         * have no candidates.
+         */
+        std::pmr::vector<std::uint32_t>
+        candidates(size_t pos,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const;
+
+        // The same for a card of terms which need not be in the index.
+        std::pmr::vector<std::uint32_t>
+        candidates(const std::set<std::string> & terms,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const;
+
+        size_t
+        get_bands() const;
+
+        size_t
+        get_rows() const;
+
+        // Approximate heap bytes of signatures and buckets.
+        size_t
+        memory_usage() const;
+
+    private:
+        std::uint64_t
+        band_hash(size_t pos, size_t band) const;
+
+        /*
+         * Sorted cards in buckets of the signature at pos of table (which
+         * may be of a card not in the index), tombstones skipped.
+         */
+        std::pmr::vector<std::uint32_t>
+        in_buckets(const std::vector<std::uint32_t> & table, size_t pos,
+                std::pmr::memory_resource * resource) const;
+
+        // Computes the signature of the card at pos.
+        void
+        sign(size_t pos, const std::set<std::string> & terms);
+
+        /*
+         * Puts the card at pos to buckets of its signature, old are band
+         * hashes of its previous one (none if it had no terms).
+         */
+        void
+        rebucket(size_t pos, const std::vector<std::uint64_t> & old);
+    } ;
+}
+
+#endif /* MINHASH_HPP */
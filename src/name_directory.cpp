@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "src/name_directory.hpp"
+#include "src/card_reader.hpp"
+#include "src/zip_input.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    static const char directory_magic[8] = {'M', 'S', 'E', 'N', 'D', 'I', 'R', '1'};
+
+    // Identifies the version of the catalog: its size and modification time.
+    static void
+    data_stamp(const string & data_path, uint64_t & size, uint64_t & mtime) {
+        struct stat st;
+        if (stat(data_path.c_str(), &st) != 0)
+            throw runtime_error("File " + data_path + " cannot be read.");
+        size = static_cast<uint64_t> (st.st_size);
+        mtime = static_cast<uint64_t> (st.st_mtim.tv_sec) * 1000000000 +
+                static_cast<uint64_t> (st.st_mtim.tv_nsec);
+    }
+
+    name_directory::~name_directory() {
+    }
+
+    string_view
+    name_directory::name_of(size_t i) const {
+        return string_view(names + entries[i].name, entries[i + 1].name - entries[i].name);
+    }
+
+    /*
+     * Layout: magic, {catalog size, catalog mtime, count, bytes of names},
+     * count + 1 entries (the last one ends names) and names.
+     */
+    bool
+    name_directory::load(const string & path, const string & data_path_) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        file.emplace(path);
+        string_view bytes = file->view();
+        const size_t header_size = sizeof (directory_magic) + 4 * sizeof (uint64_t);
+        uint64_t header[4];
+        if (bytes.size() < header_size ||
+                !equal(begin(directory_magic), end(directory_magic), bytes.data()))
+            throw runtime_error("Name directory " + path + " is damaged, rebuild it.");
+        memcpy(header, bytes.data() + sizeof (directory_magic), sizeof (header));
+        uint64_t size, mtime;
+        data_stamp(data_path_, size, mtime);
+        if (header[0] != size || header[1] != mtime)
+            throw runtime_error("Name directory " + path + " was built for other cards, rebuild it.");
+        // Sizes are checked by division, so huge counts do not overflow.
+        size_t rest = bytes.size() - header_size;
+        if (header[2] >= rest / sizeof (entry) || header[3] != rest - (header[2] + 1) * sizeof (entry))
+            throw runtime_error("Name directory " + path + " is damaged, rebuild it.");
+        const entry * entries_ = reinterpret_cast<const entry *> (bytes.data() + header_size);
+        // Names are laid one after another from the start to the end of names.
+        bool ordered = entries_[0].name == 0 && entries_[header[2]].name == header[3];
+        for (size_t i = 0; ordered && i < header[2]; ++i)
+            ordered = entries_[i].name <= entries_[i + 1].name;
+        if (!ordered)
+            throw runtime_error("Name directory " + path + " is damaged, rebuild it.");
+        data_path = data_path_;
+        entries = entries_;
+        count = header[2];
+        names = bytes.data() + header_size + (count + 1) * sizeof (entry);
+        return true;
+    }
+
+    optional<Card>
+    name_directory::find(string_view name, string_pool & strings) {
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (name_of(mid) < name)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == count || name_of(lo) != name)
+            return nullopt;
+        if (!data)
+            data.emplace(data_path);
+        const entry & e = entries[lo];
+        if (e.record > data->view().size() || e.record_size > data->view().size() - e.record)
+            throw runtime_error("Name directory does not match " + data_path + ", rebuild it.");
+        // The record is read as a catalog of one card.
+        string text = "{";
+        text.append(data->view().substr(e.record, e.record_size));
+        text += '}';
+        card_reader reader(text);
+        string_view key;
+        card_record record;
+        if (!reader.next(key, record))
+            throw runtime_error("Name directory does not match " + data_path + ", rebuild it.");
+        return Card(record, strings);
+    }
+
+    size_t
+    name_directory::build(const string & data_path, const string & path) {
+        if (zip_input::is_zip(data_path))
+            throw runtime_error("Name directory can be built only for an unzipped catalog.");
+        uint64_t size, mtime;
+        data_stamp(data_path, size, mtime);
+        mapped_file input(data_path);
+        card_reader reader(input.view());
+
+        struct read_card {
+            string key;
+            string name;
+            uint64_t record;
+            uint32_t record_size;
+        } ;
+        vector<read_card> read;
+        string_view key;
+        card_record record;
+        while (reader.next(key, record)) {
+            string_view text = reader.card_text();
+            read.push_back({string(key), record.name ? string(*record.name) : string(),
+                static_cast<uint64_t> (text.data() - input.view().data()),
+                static_cast<uint32_t> (text.size())});
+        }
+
+        // Cards as load_cards orders them, then the first card of each name.
+        vector<uint32_t> order(read.size());
+        iota(begin(order), end(order), 0);
+        stable_sort(begin(order), end(order), [&read](uint32_t a, uint32_t b) {
+            return read[a].key < read[b].key; });
+        vector<uint32_t> cards;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && read[order[i]].key == read[order[i + 1]].key)
+                continue;
+            cards.push_back(order[i]);
+        }
+        stable_sort(begin(cards), end(cards), [&read](uint32_t a, uint32_t b) {
+            return read[a].name < read[b].name; });
+        cards.erase(unique(begin(cards), end(cards), [&read](uint32_t a, uint32_t b) {
+            return read[a].name == read[b].name; }), end(cards));
+
+        vector<entry> entries_;
+        string names_;
+        for (uint32_t i : cards) {
+            entries_.push_back({read[i].record, read[i].record_size, static_cast<uint32_t> (names_.size())});
+            names_ += read[i].name;
+        }
+        entries_.push_back({0, 0, static_cast<uint32_t> (names_.size())});
+        uint64_t header[4] = {size, mtime, cards.size(), names_.size()};
+        // Written aside and renamed, so processes that mapped the former
+        // directory do not see it truncated.
+        string written = path + "." + to_string(getpid());
+        ofstream ofs(written, ios::binary | ios::trunc);
+        ofs.write(directory_magic, sizeof (directory_magic));
+        ofs.write(reinterpret_cast<const char *> (header), sizeof (header));
+        ofs.write(reinterpret_cast<const char *> (entries_.data()),
+                static_cast<streamsize> (entries_.size() * sizeof (entry)));
+        ofs.write(names_.data(), static_cast<streamsize> (names_.size()));
+        ofs.close();
+        if (!ofs || rename(written.c_str(), path.c_str()) != 0) {
+            unlink(written.c_str());
+            throw runtime_error("Name directory could not be written to " + path + ".");
+        }
+        return cards.size();
+    }
+}
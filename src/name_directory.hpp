@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   name_directory.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 20, 2026, 12:10 AM
+ */
+
+#ifndef NAME_DIRECTORY_HPP
+#define NAME_DIRECTORY_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "src/card.hpp"
+#include "src/mapped_file.hpp"
+#include "src/string_pool.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * Names of cards sorted, each with the position of its record in the
+     * catalog file, so that a single card is read without loading the rest.
+     * For a name it keeps the card search_engine::search_for finds (cards
+     * sorted by key, the last one of a repeated key). It is stored next to
+     * the catalog, which must not be zipped, and knows size and modification
+     * time of the catalog it was built for.
+     */
+    class name_directory {
+    private:
+        struct entry {
+            uint64_t record;
+            uint32_t record_size;
+            uint32_t name; // Offset in names, ends where the next one begins.
+        } ;
+
+        std::string data_path;
+        std::optional<mapped_file> file;
+        std::optional<mapped_file> data;
+        const entry * entries;
+        size_t count;
+        const char * names;
+
+        std::string_view
+        name_of(size_t i) const;
+
+    public:
+
+        name_directory() : entries(nullptr), count(0), names(nullptr) {
+        }
+
+        ~name_directory();
+
+        /*
+         * Returns false when there is no directory at path. Throws
+         * std::runtime_error if it is damaged or the catalog changed.
+         */
+        bool
+        load(const std::string & path, const std::string & data_path_);
+
+        /*
+         * The card named name, built into strings, none if there is no such
+         * card. Throws std::runtime_error if its record cannot be read.
+         */
+        std::optional<Card>
+        find(std::string_view name, string_pool & strings);
+
+        /*
+         * Scans the catalog at data_path and writes its directory to path,
+         * returns the number of names.
+         */
+        static size_t
+        build(const std::string & data_path, const std::string & path);
+    } ;
+}
+
+#endif /* NAME_DIRECTORY_HPP */
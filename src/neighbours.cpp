@@ -0,0 +1,322 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include "neighbours.hpp"
+#include "searching.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    static const char neighbours_magic[8] = {'M', 'S', 'E', 'N', 'N', 'T', '0', '1'};
+
+    neighbour_table::neighbour_table(size_t k_, const vector<Card> & cards) :
+    k(k_), card_count(cards.size()), fingerprint(catalog_fingerprint(cards)),
+    rows(cards.size() * k_, none) {
+    }
+
+    bool
+    neighbour_table::covers(size_t cnt) const {
+        return k != 0 && cnt <= k;
+    }
+
+    size_t
+    neighbour_table::get_k() const {
+        return k;
+    }
+
+    size_t
+    neighbour_table::memory_usage() const {
+        return rows.capacity() * sizeof (uint32_t);
+    }
+
+    pmr::vector<const Card *>
+    neighbour_table::read(const vector<Card> & cards, const Card * base_card, size_t cnt,
+            pmr::memory_resource * resource) const {
+        pmr::vector<const Card *> res(resource);
+        size_t row = static_cast<size_t>(base_card - &(cards[0])) * k;
+        for (size_t i = 0; i < cnt && rows[row + i] != none; ++i) {
+            res.push_back(&(cards[rows[row + i]]));
+        }
+        return res;
+    }
+
+    /*
+     * The file is a binary dump in the native byte order: magic, card count,
+     * k, catalog fingerprint and card_count * k positions.
+     */
+    bool
+    neighbour_table::load(const string & path, const vector<Card> & cards) {
+        ifstream ifs(path, ios::binary | ios::ate);
+        if (!ifs)
+            return false;
+        uint64_t file_size = static_cast<uint64_t> (ifs.tellg());
+        ifs.seekg(0);
+        char magic[sizeof (neighbours_magic)];
+        uint64_t header[3];
+        ifs.read(magic, sizeof (magic));
+        ifs.read(reinterpret_cast<char *> (header), sizeof (header));
+        if (!ifs || !equal(begin(magic), end(magic), begin(neighbours_magic)))
+            throw runtime_error("Neighbour table " + path + " is damaged, rebuild it.");
+        if (header[0] != cards.size() || header[2] != catalog_fingerprint(cards))
+            throw runtime_error("Neighbour table " + path + " was built for other cards, rebuild it.");
+        // Rows must fit the file, compared by division so nothing overflows.
+        uint64_t rest = (file_size - sizeof (magic) - sizeof (header)) / sizeof (uint32_t);
+        if (header[0] != 0 && header[1] > rest / header[0])
+            throw runtime_error("Neighbour table " + path + " is damaged, rebuild it.");
+        vector<uint32_t> rows_(header[0] * header[1]);
+        ifs.read(reinterpret_cast<char *> (rows_.data()),
+                static_cast<streamsize> (rows_.size() * sizeof (uint32_t)));
+        uint64_t count = header[0];
+        if (!ifs || any_of(begin(rows_), end(rows_), [count](uint32_t pos) {
+                return pos >= count && pos != none; }))
+            throw runtime_error("Neighbour table " + path + " is damaged, rebuild it.");
+        card_count = header[0];
+        k = header[1];
+        fingerprint = header[2];
+        rows = move(rows_);
+        return true;
+    }
+
+    void
+    neighbour_table::save(const string & path) const {
+        ofstream ofs(path, ios::binary | ios::trunc);
+        uint64_t header[3] = {card_count, k, fingerprint};
+        ofs.write(neighbours_magic, sizeof (neighbours_magic));
+        ofs.write(reinterpret_cast<const char *> (header), sizeof (header));
+        ofs.write(reinterpret_cast<const char *> (rows.data()),
+                static_cast<streamsize> (rows.size() * sizeof (uint32_t)));
+        if (!ofs)
+            throw runtime_error("Neighbour table could not be written to " + path + ".");
+    }
+
+    /*
+     * FNV-1a over all fields of cards in the catalog order. Positions in the
+     * table are only meaningful for the very same order of cards, distances
+     * only for the same contents of them, which a put to the card store may
+     * change keeping the name. Symbols are hashed by their keys, ids of
+     * discovered ones depend on the process.
+     */
+    uint64_t
+    neighbour_table::catalog_fingerprint(const vector<Card> & cards) {
+        uint64_t hash = 14695981039346656037ULL;
+        auto && add = [&hash](unsigned char c) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        };
+        auto && add_string = [&add](string_view s) {
+            for (char c : s)
+                add(static_cast<unsigned char> (c));
+            add(0);
+        };
+        auto && add_number = [&add](int n) {
+            uint32_t u = static_cast<uint32_t> (n);
+            for (int shift = 0; shift < 32; shift += 8)
+                add(static_cast<unsigned char> (u >> shift));
+        };
+        auto && add_feature = [&add, &add_number](const feature & f) {
+            add_number(f.whole_part);
+            add(static_cast<unsigned char> ((f.half ? 1 : 0) | (f.asterics ? 2 : 0)));
+        };
+        auto && add_symbols = [&add, &add_string](const symbol_list & symbols) {
+            for (const string * symbol : symbols)
+                add_string(*symbol);
+            add(0);
+        };
+        const symbol_table & mana = vocabulary::instance().mana;
+        for (const Card & card : cards) {
+            add_string(card.get_name());
+            add_string(card.get_text());
+            add_string(card.get_layout());
+            for (string_view name : card.get_names())
+                add_string(name);
+            add(0);
+            for (const manaCnt & m : card.get_manaCost()) {
+                add_string(mana[m.color].key);
+                add_number(m.count);
+            }
+            add(0);
+            add_symbols(card.get_colors());
+            add_symbols(card.get_supertypes());
+            add_symbols(card.get_types());
+            add_symbols(card.get_subtypes());
+            add_feature(card.get_power());
+            add_feature(card.get_toughness());
+            add_number(card.get_loyalty());
+            add_number(card.get_hand());
+            add_number(card.get_life());
+        }
+        return hash;
+    }
+
+    neighbour_table
+    build_neighbour_table(const search_engine & engine, const vector<Card> & cards,
+            size_t k, size_t threads, ostream & progress) {
+        // Sizes of blocks were chosen so that a block of candidates together
+        // with their index entries stays in the cache for all bases of a block.
+        const size_t base_block = 32;
+        const size_t candidate_block = 256;
+        using entry = pair<size_t, uint32_t>; // (distance, position)
+
+        if (threads == 0)
+            threads = max(1U, thread::hardware_concurrency());
+        neighbour_table table(k, cards);
+
+        // Grouping of cards by their (sorted) type sets.
+        map<vector<symbol_id>, vector<uint32_t> > by_types;
+        for (size_t i = 0; i < cards.size(); ++i) {
+            types_t card_types = cards[i].get_types();
+            vector<symbol_id> types(card_types.ids(), card_types.ids() + card_types.size());
+            sort(begin(types), end(types));
+            by_types[types].push_back(static_cast<uint32_t> (i));
+        }
+        vector<const vector<symbol_id> *> group_types;
+        vector<const vector<uint32_t> *> groups;
+        for (auto && group : by_types) {
+            group_types.push_back(&(group.first));
+            groups.push_back(&(group.second));
+        }
+        // Candidates of a base card are cards having all of its types. Cards
+        // without types have no candidates, as in find_similar.
+        vector<vector<size_t> > compatible(groups.size());
+        size_t total_pairs = 0;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            if (group_types[g]->empty())
+                continue;
+            for (size_t h = 0; h < groups.size(); ++h) {
+                if (includes(begin(*group_types[h]), end(*group_types[h]),
+                        begin(*group_types[g]), end(*group_types[g]))) {
+                    compatible[g].push_back(h);
+                    total_pairs += groups[g]->size() * groups[h]->size();
+                }
+            }
+        }
+
+        struct block {
+            size_t group;
+            size_t from;
+            size_t to;
+        } ;
+        vector<block> blocks;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            for (size_t from = 0; from < groups[g]->size(); from += base_block) {
+                blocks.push_back({g, from, min(from + base_block, groups[g]->size())});
+            }
+        }
+
+        atomic<size_t> next_block(0);
+        atomic<size_t> done_cards(0);
+        atomic<size_t> done_pairs(0);
+        mutex running_mtx;
+        condition_variable running_cv;
+        size_t running = threads;
+
+        auto && worker = [&]() {
+            vector<vector<entry> > heaps(base_block);
+            size_t b;
+            while ((b = next_block++) < blocks.size()) {
+                const block & bl = blocks[b];
+                const vector<uint32_t> & bases = *groups[bl.group];
+                size_t n = bl.to - bl.from;
+                size_t pairs = 0;
+                for (size_t i = 0; i < n; ++i)
+                    heaps[i].clear();
+                for (size_t h : compatible[bl.group]) {
+                    const vector<uint32_t> & candidates = *groups[h];
+                    for (size_t c0 = 0; c0 < candidates.size(); c0 += candidate_block) {
+                        size_t c1 = min(c0 + candidate_block, candidates.size());
+                        for (size_t i = 0; i < n; ++i) {
+                            uint32_t base = bases[bl.from + i];
+                            vector<entry> & heap = heaps[i];
+                            for (size_t c = c0; c < c1; ++c) {
+                                uint32_t pos = candidates[c];
+                                if (pos == base)
+                                    continue;
+                                entry e(engine.get_distance(&(cards[pos]), &(cards[base])), pos);
+                                ++pairs;
+                                // Max-heap of the k closest cards seen so far.
+                                if (heap.size() < k) {
+                                    heap.push_back(e);
+                                    push_heap(begin(heap), end(heap));
+                                }
+                                else if (k != 0 && e < heap.front()) {
+                                    pop_heap(begin(heap), end(heap));
+                                    heap.back() = e;
+                                    push_heap(begin(heap), end(heap));
+                                }
+                            }
+                        }
+                    }
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    sort_heap(begin(heaps[i]), end(heaps[i]));
+                    size_t row = bases[bl.from + i] * k;
+                    for (size_t j = 0; j < heaps[i].size(); ++j)
+                        table.rows[row + j] = heaps[i][j].second;
+                }
+                done_pairs += pairs;
+                done_cards += n;
+            }
+            lock_guard<mutex> lock(running_mtx);
+            --running;
+            running_cv.notify_one();
+        };
+
+        auto start = chrono::steady_clock::now();
+        auto && seconds = [&start]() {
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        };
+        vector<thread> pool;
+        for (size_t i = 0; i < threads; ++i)
+            pool.emplace_back(worker);
+        {
+            unique_lock<mutex> lock(running_mtx);
+            while (!running_cv.wait_for(lock, chrono::seconds(1), [&running]() {
+                    return running == 0; })) {
+                size_t pairs = done_pairs;
+                progress << "neighbours: " << done_cards << "/" << cards.size() << " cards, "
+                        << pairs << "/" << total_pairs << " pairs, "
+                        << static_cast<size_t> (pairs / seconds()) << " pairs/s" << endl;
+            }
+        }
+        for (thread & t : pool)
+            t.join();
+        double elapsed = seconds();
+        progress << "neighbours: top " << k << " for " << cards.size() << " cards, "
+                << done_pairs << " pairs in " << elapsed << " s ("
+                << static_cast<size_t> (done_pairs / max(elapsed, 1e-9)) << " pairs/s, "
+                << threads << " threads)" << endl;
+        return table;
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   neighbours.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 9:12 AM
+ */
+
+#ifndef NEIGHBOURS_HPP
+#define NEIGHBOURS_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include "card.hpp"
+
+namespace magicSearchEngine {
+
+    class search_engine;
+
+    /*
+     * Precomputed answers of find_similar. For every card the table keeps
+     * positions (within db.get_cards()) of its k most similar cards ordered
+     * from the closest one, so that a query for at most k cards is only
+     * a read of one row. The catalog changes only with set releases, hence
+     * the table is built offline and stored next to the data.
+     */
+    class neighbour_table {
+    public:
+        static constexpr std::uint32_t none = UINT32_MAX;
+
+    private:
+        std::size_t k;
+        std::size_t card_count;
+        // Identifies the catalog the table was built for.
+        std::uint64_t fingerprint;
+        // Row-major, card_count rows of k positions, padded by none.
+        std::vector<std::uint32_t> rows;
+
+    public:
+
+        neighbour_table() : k(0), card_count(0), fingerprint(0) {
+        }
+
+        neighbour_table(std::size_t k_, const std::vector<Card> & cards);
+
+        bool
+        covers(std::size_t cnt) const;
+
+        std::size_t
+        get_k() const;
+
+        std::size_t
+        memory_usage() const;
+
+        std::pmr::vector<const Card *>
+        read(const std::vector<Card> & cards, const Card * base_card, std::size_t cnt,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const;
+
+        /*
+         * Returns false when there is no table at path. Loading checks that
+         * the table was built for the same catalog and throws
+         * std::runtime_error otherwise (or for a damaged file).
+         */
+        bool
+        load(const std::string & path, const std::vector<Card> & cards);
+
+        void
+        save(const std::string & path) const;
+
+        // Changes with the order of cards and with any field of a card.
+        static std::uint64_t
+        catalog_fingerprint(const std::vector<Card> & cards);
+
+        friend neighbour_table
+        build_neighbour_table(const search_engine &, const std::vector<Card> &,
+                std::size_t k, std::size_t threads, std::ostream & progress);
+    } ;
+
+    /*
+     * Computes the table by scoring all pairs (base card, candidate) where
+     * the candidate has all types of the base card, i.e. exactly the pairs
+     * find_similar scores. Cards are grouped by their type sets, bases are
+     * processed in blocks by a pool of threads and candidates are streamed in
+     * blocks, so a block of candidates is reused for all bases of a block.
+     * Progress and throughput (pairs/s) are reported to the progress stream.
+     */
+    neighbour_table
+    build_neighbour_table(const search_engine & engine, const std::vector<Card> & cards,
+            std::size_t k, std::size_t threads, std::ostream & progress);
+}
+
+#endif /* NEIGHBOURS_HPP */
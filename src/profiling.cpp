@@ -0,0 +1,229 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <malloc.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "profiling.hpp"
+#include "src/json.hpp"
+
+using namespace std;
+
+/*
+ * The global allocation functions are replaced only to count calls and
+ * live heap blocks (usable size as malloc gives it). A few relaxed atomic
+ * updates per allocation are cheap enough to be always on.
+ */
+static atomic<size_t> allocations(0);
+static atomic<size_t> live_blocks(0);
+static atomic<size_t> live_bytes(0);
+
+static inline void *
+counted_malloc(size_t size) noexcept {
+    void * p = malloc(size == 0 ? 1 : size);
+    if (p) {
+        allocations.fetch_add(1, memory_order_relaxed);
+        live_blocks.fetch_add(1, memory_order_relaxed);
+        live_bytes.fetch_add(malloc_usable_size(p), memory_order_relaxed);
+    }
+    return p;
+}
+
+// Out of line, so that GCC does not see free() of pointers from operator new.
+__attribute__((noinline)) static void
+counted_free(void * p) noexcept {
+    if (p) {
+        live_blocks.fetch_sub(1, memory_order_relaxed);
+        live_bytes.fetch_sub(malloc_usable_size(p), memory_order_relaxed);
+    }
+    free(p);
+}
+
+void *
+operator new(size_t size) {
+    void * p = counted_malloc(size);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *
+operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *
+operator new(size_t size, const nothrow_t &) noexcept {
+    return counted_malloc(size);
+}
+
+void *
+operator new[](size_t size, const nothrow_t & nt) noexcept {
+    return operator new(size, nt);
+}
+
+void
+operator delete(void * p) noexcept {
+    counted_free(p);
+}
+
+void
+operator delete[](void * p) noexcept {
+    counted_free(p);
+}
+
+void
+operator delete(void * p, size_t) noexcept {
+    counted_free(p);
+}
+
+void
+operator delete[](void * p, size_t) noexcept {
+    counted_free(p);
+}
+
+namespace magicSearchEngine {
+
+    size_t
+    allocation_count() {
+        return allocations.load(memory_order_relaxed);
+    }
+
+    heap_usage
+    current_heap_usage() {
+        return {
+            allocations.load(memory_order_relaxed),
+            live_blocks.load(memory_order_relaxed),
+            live_bytes.load(memory_order_relaxed)
+        };
+    }
+
+    // Process-wide, phases such as load_database run on worker threads.
+    static double
+    cpu_ms() {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double> (ts.tv_sec) * 1e3 + static_cast<double> (ts.tv_nsec) / 1e6;
+    }
+
+    static long
+    peak_rss_kb() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    startup_profile &
+    startup_profile::instance() {
+        static startup_profile profile;
+        return profile;
+    }
+
+    void
+    startup_profile::enable() {
+        enabled = true;
+    }
+
+    bool
+    startup_profile::is_enabled() const {
+        return enabled;
+    }
+
+    void
+    startup_profile::add(phase_record && record) {
+        lock_guard<mutex> lock(mtx);
+        phases.push_back(move(record));
+    }
+
+    vector<phase_record>
+    startup_profile::get_phases() const {
+        lock_guard<mutex> lock(mtx);
+        return phases;
+    }
+
+    void
+    startup_profile::report(ostream & os) const {
+        lock_guard<mutex> lock(mtx);
+        os << "Startup profile:" << endl
+                << left << setw(16) << "phase" << right
+                << setw(12) << "wall [ms]" << setw(12) << "cpu [ms]"
+                << setw(18) << "peak RSS +[kB]" << setw(14) << "allocations"
+                << setw(16) << "heap +[kB]" << endl;
+        for (const phase_record & p : phases) {
+            os << left << setw(16) << p.name << right << fixed << setprecision(1)
+                    << setw(12) << p.wall_ms << setw(12) << p.cpu_ms
+                    << setw(18) << p.peak_rss_delta_kb << setw(14) << p.allocations
+                    << setw(16) << static_cast<double> (p.heap_delta_bytes) / 1024 << endl;
+        }
+    }
+
+    void
+    startup_profile::write_json(ostream & os) const {
+        lock_guard<mutex> lock(mtx);
+        nlohmann::json res = nlohmann::json::array();
+        for (const phase_record & p : phases) {
+            res.push_back({
+                {"phase", p.name},
+                {"wall_ms", p.wall_ms},
+                {"cpu_ms", p.cpu_ms},
+                {"peak_rss_delta_kb", p.peak_rss_delta_kb},
+                {"allocations", p.allocations},
+                {"heap_delta_bytes", p.heap_delta_bytes}
+            });
+        }
+        os << nlohmann::json({{"phases", res}}).dump(2) << endl;
+    }
+
+    startup_phase::startup_phase(const char * name_) : name(name_),
+    running(startup_profile::instance().is_enabled()), cpu_start(0), peak_rss_start(0),
+    allocations_start(0), heap_start(0) {
+        if (running) {
+            wall_start = chrono::steady_clock::now();
+            cpu_start = cpu_ms();
+            peak_rss_start = peak_rss_kb();
+            allocations_start = allocation_count();
+            heap_start = live_bytes.load(memory_order_relaxed);
+        }
+    }
+
+    void
+    startup_phase::finish() {
+        if (!running)
+            return;
+        running = false;
+        startup_profile::instance().add({
+            name,
+            chrono::duration<double, milli>(chrono::steady_clock::now() - wall_start).count(),
+            cpu_ms() - cpu_start,
+            peak_rss_kb() - peak_rss_start,
+            allocation_count() - allocations_start,
+            static_cast<long long> (live_bytes.load(memory_order_relaxed))
+            - static_cast<long long> (heap_start)
+        });
+    }
+}
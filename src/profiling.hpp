@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   profiling.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 2:20 PM
+ */
+
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    /*
+     * Number of calls of the global operator new so far (all threads).
+     */
+    size_t
+    allocation_count();
+
+    struct heap_usage {
+        size_t allocations;
+        size_t live_blocks;
+        size_t live_bytes;
+    } ;
+
+    /*
+     * Heap of the global operator new, i.e. of all standard containers.
+     */
+    heap_usage
+    current_heap_usage();
+
+    struct phase_record {
+        std::string name;
+        double wall_ms;
+        // CPU time of the whole process, so it includes workers of the
+        // phase and anything other threads do meanwhile.
+        double cpu_ms;
+        // Growth of the peak resident set size during the phase.
+        long peak_rss_delta_kb;
+        size_t allocations;
+        // Heap retained by the phase (live bytes at end minus at start).
+        long long heap_delta_bytes;
+    } ;
+
+    /*
+     * Startup profile, i.e. costs of loading and indexing phases. It is
+     * disabled by default and then phases record nothing.
+     */
+    class startup_profile {
+    private:
+        mutable std::mutex mtx;
+        std::vector<phase_record> phases;
+        bool enabled;
+
+        startup_profile() : enabled(false) {
+        }
+
+    public:
+        static startup_profile &
+        instance();
+
+        void
+        enable();
+
+        bool
+        is_enabled() const;
+
+        void
+        add(phase_record && record);
+
+        std::vector<phase_record>
+        get_phases() const;
+
+        // A table for humans.
+        void
+        report(std::ostream & os) const;
+
+        void
+        write_json(std::ostream & os) const;
+    } ;
+
+    /*
+     * Measures a phase from construction to finish() or destruction,
+     * whichever comes first.
+     */
+    class startup_phase {
+    private:
+        const char * name;
+        bool running;
+        std::chrono::steady_clock::time_point wall_start;
+        double cpu_start;
+        long peak_rss_start;
+        size_t allocations_start;
+        size_t heap_start;
+
+    public:
+        explicit
+        startup_phase(const char * name_);
+
+        startup_phase(const startup_phase &) = delete;
+
+        startup_phase &
+        operator=(const startup_phase &) = delete;
+
+        void
+        finish();
+
+        ~startup_phase() {
+            finish();
+        }
+    } ;
+}
+
+#endif /* PROFILING_HPP */
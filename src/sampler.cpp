@@ -0,0 +1,204 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "sampler.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    namespace {
+
+        // Plain data, so the signal handler reads it without initialization.
+        struct phase_stack {
+            const char * names[sampling_profiler::max_phases];
+            size_t depth;
+        } ;
+    }
+
+    static thread_local phase_stack current_phases;
+    // Read by the handler, so it must be lock-free to be signal safe.
+    static atomic<sampling_profiler *> active{nullptr};
+    static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "Profiler needs lock-free pointers.");
+    static struct sigaction previous_action;
+
+    profile_phase::profile_phase(const char * name) {
+        if (current_phases.depth < sampling_profiler::max_phases)
+            current_phases.names[current_phases.depth] = name;
+        // The handler runs on this thread, only the compiler must not reorder.
+        atomic_signal_fence(memory_order_release);
+        ++current_phases.depth;
+    }
+
+    profile_phase::~profile_phase() {
+        atomic_signal_fence(memory_order_release);
+        --current_phases.depth;
+    }
+
+    sampling_profiler::sampling_profiler() : capacity(0), taken(0), running(false) {
+    }
+
+    sampling_profiler &
+    sampling_profiler::instance() {
+        static sampling_profiler profiler;
+        return profiler;
+    }
+
+    void
+    sampling_profiler::on_signal(int) {
+        int saved_errno = errno;
+        sampling_profiler * profiler = active.load(memory_order_acquire);
+        if (profiler) {
+            size_t i = profiler->taken.fetch_add(1, memory_order_relaxed);
+            if (i < profiler->capacity) {
+                sample & s = profiler->samples[i];
+                s.frame_count = backtrace(s.frames, static_cast<int> (max_frames));
+                atomic_signal_fence(memory_order_acquire);
+                s.phase_count = current_phases.depth < max_phases ? current_phases.depth : max_phases;
+                for (size_t j = 0; j < s.phase_count; ++j)
+                    s.phases[j] = current_phases.names[j];
+                s.ready.store(true, memory_order_release);
+            }
+        }
+        errno = saved_errno;
+    }
+
+    void
+    sampling_profiler::start(unsigned frequency, size_t capacity_) {
+        if (running || frequency == 0)
+            return;
+        samples.reset(new sample[capacity_]);
+        for (size_t i = 0; i < capacity_; ++i)
+            samples[i].ready.store(false, memory_order_relaxed);
+        capacity = capacity_;
+        taken.store(0);
+        // The first backtrace() loads libgcc, which must not happen in the handler.
+        void * warm_up[1];
+        backtrace(warm_up, 1);
+        active.store(this, memory_order_release);
+
+        struct sigaction action;
+        action.sa_handler = on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previous_action);
+        itimerval timer;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_usec = static_cast<suseconds_t> (1000000 / frequency);
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        running = true;
+    }
+
+    void
+    sampling_profiler::stop() {
+        if (!running)
+            return;
+        itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        // Ignoring discards a signal still pending, which the previous
+        // action (by default termination) would get otherwise.
+        struct sigaction ignore;
+        ignore.sa_handler = SIG_IGN;
+        ignore.sa_flags = 0;
+        sigemptyset(&ignore.sa_mask);
+        sigaction(SIGPROF, &ignore, nullptr);
+        active.store(nullptr, memory_order_release);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        running = false;
+    }
+
+    /*
+     * Function name of a return address, or module name if the symbol
+     * is not exported (the engine is linked with -rdynamic).
+     */
+    static string
+    symbol_of(void * address) {
+        char ** symbols = backtrace_symbols(&address, 1);
+        if (!symbols)
+            return "??";
+        // Format is "module(mangled+offset) [address]".
+        string line = symbols[0];
+        free(symbols);
+        size_t open = line.find('(');
+        size_t plus = line.find_first_of("+)", open);
+        if (open == string::npos || plus == string::npos || plus == open + 1) {
+            size_t slash = line.rfind('/', open);
+            return line.substr(slash == string::npos ? 0 : slash + 1,
+                    open == string::npos ? string::npos : open - slash - 1);
+        }
+        string mangled = line.substr(open + 1, plus - open - 1);
+        int status = 0;
+        char * demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+        if (status != 0 || !demangled)
+            return mangled;
+        string res = demangled;
+        free(demangled);
+        return res;
+    }
+
+    void
+    sampling_profiler::write_folded(ostream & os) {
+        stop();
+        unordered_map<void *, string> symbols;
+        map<string, size_t> stacks;
+        size_t n = taken.load() < capacity ? taken.load() : capacity;
+        for (size_t i = 0; i < n; ++i) {
+            const sample & s = samples[i];
+            if (!s.ready.load(memory_order_acquire) || s.frame_count <= 2)
+                continue;
+            string stack;
+            for (size_t j = 0; j < s.phase_count; ++j) {
+                stack += '[';
+                stack += s.phases[j];
+                stack += "];";
+            }
+            // Frames 0 and 1 are the handler and the signal trampoline.
+            for (size_t j = static_cast<size_t> (s.frame_count); j-- > 2;) {
+                void * frame = s.frames[j];
+                auto it = symbols.find(frame);
+                if (it == symbols.end())
+                    it = symbols.emplace(frame, symbol_of(frame)).first;
+                stack += it->second;
+                if (j > 2)
+                    stack += ';';
+            }
+            ++stacks[stack];
+        }
+        for (auto && stack : stacks)
+            os << stack.first << ' ' << stack.second << endl;
+        if (taken.load() > capacity)
+            cerr << "Profiler: " << taken.load() - capacity << " samples dropped, buffer was full." << endl;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   sampler.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 4:40 PM
+ */
+
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+namespace magicSearchEngine {
+
+    /*
+     * Sampling profiler driven by SIGPROF of setitimer(ITIMER_PROF), so
+     * it samples whichever thread uses CPU. The signal handler only stores
+     * raw return addresses and the engine phases of the interrupted thread
+     * into preallocated slots, symbols are resolved when writing.
+     */
+    class sampling_profiler {
+    public:
+        static const size_t max_frames = 48;
+        static const size_t max_phases = 8;
+
+    private:
+        struct sample {
+            std::atomic<bool> ready;
+            int frame_count;
+            size_t phase_count;
+            void * frames[max_frames];
+            const char * phases[max_phases];
+        } ;
+
+        std::unique_ptr<sample[] > samples;
+        size_t capacity;
+        std::atomic<size_t> taken;
+        bool running;
+
+        sampling_profiler();
+
+        static void
+        on_signal(int);
+
+    public:
+        static sampling_profiler &
+        instance();
+
+        // Samples are taken until stop() or until capacity is exhausted.
+        void
+        start(unsigned frequency = 997, size_t capacity_ = 1 << 15);
+
+        void
+        stop();
+
+        /*
+         * Folded stacks for flamegraph.pl / inferno: phases as the outermost
+         * frames "[phase]", then functions from outermost to innermost and
+         * the number of samples.
+         */
+        void
+        write_folded(std::ostream & os);
+    } ;
+
+    /*
+     * Marks an engine phase of the current thread for the sampler, phases
+     * nest. It is cheap enough for inner loops.
+     */
+    class profile_phase {
+    public:
+        explicit
+        profile_phase(const char * name);
+
+        profile_phase(const profile_phase &) = delete;
+
+        profile_phase &
+        operator=(const profile_phase &) = delete;
+
+        ~profile_phase();
+    } ;
+}
+
+#define MSE_PHASE_CONCAT_(a, b) a ## b
+#define MSE_PHASE_CONCAT(a, b) MSE_PHASE_CONCAT_(a, b)
+#define PROFILE_PHASE(name) \
+    ::magicSearchEngine::profile_phase MSE_PHASE_CONCAT(profile_phase_, __LINE__)(name)
+
+#endif /* SAMPLER_HPP */
@@ -27,13 +27,185 @@
 #include <set>
 #include <sstream>
 #include <cmath>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include "searching.hpp"
 #include "database.hpp"
+#include "metrics.hpp"
+#include "profiling.hpp"
+#include "tracing.hpp"
+#include "sampler.hpp"
 
 using namespace std;
 
 namespace magicSearchEngine {
 
+    // Parts of the embedding of a card (see features).
+    static const size_t text_dim = 64;
+    static const size_t types_dim = 16;
+    static const size_t layout_dim = 4;
+
+    /*
+     * Entries of the index made by workers of load_database as cards are
+     * built, in the order of reading, then reordered as cards of the database.
+     */
+    class search_engine::loading_index : public card_observer {
+    private:
+        const search_engine & engine;
+        std::mutex parts_mtx;
+        map<size_t, vector<set<string> > > parts;
+        vector<set<string> > index;
+        bool complete;
+
+    public:
+
+        loading_index(const search_engine & engine_) : engine(engine_), complete(false) {
+        }
+
+        void
+        cards_built(size_t first, const vector<Card> & cards) override {
+            vector<set<string> > part;
+            part.reserve(cards.size());
+            for (const Card & card : cards)
+                part.push_back(engine.tokenize(card.get_text()));
+            lock_guard<std::mutex> lock(parts_mtx);
+            parts.emplace(first, move(part));
+        }
+
+        void
+        cards_loaded(const vector<uint32_t> & read_order) override {
+            vector<set<string> > read;
+            for (auto && part : parts)
+                move(begin(part.second), end(part.second), back_inserter(read));
+            parts.clear();
+            index.clear();
+            index.reserve(read_order.size());
+            for (uint32_t position : read_order)
+                index.push_back(move(read[position]));
+            complete = true;
+        }
+
+        bool
+        is_complete() const {
+            return complete;
+        }
+
+        // The index of the last load, the next one fills it again.
+        vector<set<string> >
+        take_index() {
+            complete = false;
+            return move(index);
+        }
+    } ;
+
+    /*
+     * Index entries of a lazy index, each made by the first query needing it.
+     * Queries of several threads may tokenize the same card at once, the
+     * first entry stored is kept.
+     */
+    class search_engine::lazy_terms {
+    private:
+        std::unique_ptr<std::atomic<const set<string> *>[] > slots;
+        size_t count;
+
+    public:
+
+        explicit
+        lazy_terms(size_t count_) : slots(new std::atomic<const set<string> *>[count_]),
+        count(count_) {
+            for (size_t pos = 0; pos < count; ++pos)
+                slots[pos].store(nullptr, memory_order_relaxed);
+        }
+
+        lazy_terms(const lazy_terms &) = delete;
+
+        lazy_terms &
+        operator=(const lazy_terms &) = delete;
+
+        ~lazy_terms() {
+            for (size_t pos = 0; pos < count; ++pos)
+                delete slots[pos].load(memory_order_relaxed);
+        }
+
+        const set<string> &
+        get(size_t pos, const search_engine & engine, const Card & card) {
+            const set<string> * stored = slots[pos].load(memory_order_acquire);
+            if (stored != nullptr)
+                return *stored;
+            unique_ptr<set<string> > made(new set<string>(engine.tokenize(card.get_text())));
+            if (slots[pos].compare_exchange_strong(stored, made.get(),
+                    memory_order_acq_rel, memory_order_acquire))
+                return *made.release();
+            return *stored;
+        }
+
+        size_t
+        size() const {
+            return count;
+        }
+
+        // Count of cards grew, entries made are kept.
+        void
+        resize(size_t count_) {
+            std::unique_ptr<std::atomic<const set<string> *>[] > grown(
+                    new std::atomic<const set<string> *>[count_]);
+            for (size_t pos = 0; pos < count_; ++pos)
+                grown[pos].store(pos < count ? slots[pos].load(memory_order_relaxed) : nullptr,
+                    memory_order_relaxed);
+            slots = move(grown);
+            count = count_;
+        }
+
+        // The card at pos changed, its entry is made again.
+        void
+        forget(size_t pos) {
+            delete slots[pos].exchange(nullptr, memory_order_acq_rel);
+        }
+
+        // Entries made so far, as the eager index is accounted.
+        void
+        account_memory(memory_report & report) const {
+            report.add_block("index vector", slots.get());
+            for (size_t pos = 0; pos < count; ++pos) {
+                const set<string> * stored = slots[pos].load(memory_order_acquire);
+                if (stored == nullptr)
+                    continue;
+                report.add_node("index sets", sizeof (set<string>));
+                for (const string & word : *stored) {
+                    report.add_node("index sets", 4 * sizeof (void *) + sizeof (string));
+                    report.add_string("index sets", word);
+                }
+            }
+        }
+    } ;
+
+    void
+    search_engine::index_while_loading(JSONDatabase & database) {
+        if (is_lazy())
+            return;
+        define_stop_words();
+        loading.reset(new loading_index(*this));
+        database.set_card_observer(loading.get());
+    }
+
+    search_engine::search_engine(const Database & db_) : db(db_), index_was_loaded(false),
+    mode(similarity_mode::exact), indexing(index_mode::eager), image(nullptr) {
+    }
+
+    search_engine::~search_engine() {
+    }
+
+    search_engine::base_terms::base_terms(base_terms &&) noexcept = default;
+
+    search_engine::base_terms::~base_terms() {
+    }
+
     /*
      * For each card reads its text, divides it to words, converts the word to
      * lowercase, exclude duplicities, stop words and stores set of resulting
@@ -41,7 +213,231 @@ namespace magicSearchEngine {
      */
     void
     search_engine::create_index() {
-        unordered_set<string> stop_words;
+        startup_phase phase("create_index");
+        TRACE_SPAN("create_index");
+        PROFILE_PHASE("create_index");
+        finish_compaction(true);
+        index.clear();
+        lazy.reset();
+        image = db.get_image();
+        if (image) {
+            // Only texts of cards from elsewhere are tokenized.
+            define_stop_words();
+            build_lsh();
+            index_was_loaded = true;
+            return;
+        }
+        if (loading && loading->is_complete()) {
+            index = loading->take_index();
+        }
+        else if (is_lazy()) {
+            define_stop_words();
+            lazy.reset(new lazy_terms(db.get_cards().size()));
+        }
+        else {
+            define_stop_words();
+            const vector<Card> & cards = db.get_cards();
+            for (const Card & card : cards) {
+                index.push_back(tokenize(card.get_text()));
+            }
+        }
+        build_lsh();
+        index_was_loaded = true;
+    }
+
+    void
+    search_engine::build_lsh() {
+        // Other modes do not read signatures, set_mode builds them when needed.
+        if (mode != similarity_mode::lsh) {
+            minhash = minhash_index(minhash.get_bands(), minhash.get_rows());
+            return;
+        }
+        if (!image) {
+            minhash.build(index);
+            return;
+        }
+        minhash.build(image->size(), [this](size_t pos, vector<uint64_t> & hashes) {
+            hashes.clear();
+            for (uint32_t id : image->terms(pos))
+                hashes.push_back(image->term_hash(id));
+        });
+    }
+
+    void
+    search_engine::publish_image(const string & path, const string & data_path) const {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        startup_phase phase("publish image");
+        engine_image::builder builder(db, tokenizer_version);
+        const vector<Card> & cards = db.get_cards();
+        for (size_t pos = 0; pos < cards.size(); ++pos) {
+            // Terms of a lazy index are not kept for all cards.
+            if (lazy)
+                builder.add(cards[pos], tokenize(cards[pos].get_text()));
+            else
+                builder.add(cards[pos], index[pos]);
+        }
+        builder.write(path, data_path);
+    }
+
+    void
+    search_engine::update_index(const vector<card_update> & updates) {
+        for (const card_update & update : updates) {
+            switch (update.kind) {
+                case update_kind::added:
+                    add_card(update.position);
+                    break;
+                case update_kind::replaced:
+                    update_card(update.position);
+                    break;
+                case update_kind::removed:
+                default:
+                    remove_card(update.position);
+                    break;
+            }
+        }
+        if (updates.empty())
+            return;
+        neighbours = neighbour_table();
+        finish_compaction(false);
+        // Tombstones are compacted once they are an eighth of the buckets.
+        size_t entries = minhash.size() * minhash.get_bands();
+        if (!lsh_compaction.valid() && minhash.stale_entries() > 0 &&
+                minhash.stale_entries() >= entries / 8) {
+            lsh_compaction = async(launch::async, [](minhash_index::compaction c) {
+                c.build();
+                return c;
+            }, minhash.start_compaction());
+        }
+    }
+
+    void
+    search_engine::add_card(size_t pos) {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        if (image)
+            throw runtime_error("Cards of an engine image cannot be changed.");
+        const Card & card = db.get_cards()[pos];
+        if (pos != (lazy ? lazy->size() : index.size()))
+            throw invalid_argument("Cards can be added to the index only at its end.");
+        if (lazy) {
+            lazy->resize(pos + 1);
+        }
+        else {
+            index.push_back(tokenize(card.get_text()));
+            if (minhash.size() == pos)
+                minhash.add(index[pos]);
+        }
+        if (hnsw.size() != 0 && hnsw.size() == pos)
+            hnsw.add(features(&card));
+    }
+
+    void
+    search_engine::update_card(size_t pos) {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        if (image)
+            throw runtime_error("Cards of an engine image cannot be changed.");
+        const Card & card = db.get_cards()[pos];
+        if (lazy) {
+            lazy->forget(pos);
+        }
+        else {
+            index[pos] = tokenize(card.get_text());
+            if (pos < minhash.size())
+                minhash.update(pos, index[pos]);
+        }
+        if (pos < hnsw.size())
+            hnsw.update(static_cast<uint32_t> (pos), features(&card));
+        if (pos < removed.size())
+            removed[pos] = false;
+    }
+
+    void
+    search_engine::remove_card(size_t pos) {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        if (image)
+            throw runtime_error("Cards of an engine image cannot be changed.");
+        if (removed.size() <= pos)
+            removed.resize(db.get_cards().size(), false);
+        removed[pos] = true;
+        if (lazy) {
+            lazy->forget(pos);
+        }
+        else {
+            index[pos].clear();
+            if (pos < minhash.size())
+                minhash.update(pos, index[pos]);
+        }
+        // Its node still links others in the HNSW graph, it is only skipped.
+    }
+
+    void
+    search_engine::compact_index() {
+        finish_compaction(true);
+    }
+
+    void
+    search_engine::finish_compaction(bool wait) {
+        if (!lsh_compaction.valid())
+            return;
+        if (!wait && lsh_compaction.wait_for(chrono::seconds(0)) != future_status::ready)
+            return;
+        minhash.finish_compaction(lsh_compaction.get());
+    }
+
+    bool
+    search_engine::is_removed(size_t pos) const {
+        return pos < removed.size() && removed[pos];
+    }
+
+    void
+    search_engine::set_index_mode(index_mode indexing_) {
+        indexing = indexing_;
+    }
+
+    bool
+    search_engine::is_lazy() const {
+        return indexing == index_mode::lazy && mode != similarity_mode::lsh;
+    }
+
+    const set<string> &
+    search_engine::terms(size_t pos) const {
+        if (lazy)
+            return lazy->get(pos, *this, db.get_cards()[pos]);
+        return index[pos];
+    }
+
+    search_engine::base_terms
+    search_engine::terms_of(const Card * card) const {
+        base_terms res;
+        if (owns(card)) {
+            size_t pos = static_cast<size_t> (card - &(db.get_cards()[0]));
+            if (image) {
+                res.in_image = true;
+                res.ids = image->terms(pos);
+            }
+            else
+                res.entry = &terms(pos);
+            return res;
+        }
+        res.tokenized = tokenize(card->get_text());
+        if (image) {
+            // Ids ascend as the terms do.
+            for (const string & word : res.tokenized) {
+                uint32_t id = image->find_term(word);
+                if (id != engine_image::none)
+                    res.found.push_back(id);
+            }
+        }
+        return res;
+    }
+
+    void
+    search_engine::define_stop_words() {
+        if (!stop_words.empty())
+            return;
         // <editor-fold defaultstate="collapsed" desc="stop_words instantiation">
         stop_words.insert("");
         stop_words.insert("a");
@@ -704,33 +1100,36 @@ namespace magicSearchEngine {
         stop_words.insert("z");
         stop_words.insert("zero");
         // </editor-fold>
+    }
 
-        const vector<Card> & cards = db.get_cards();
-        for (const Card & card : cards) {
-            istringstream text(card.get_text());
-            string word;
-            set<string> bucket;
-            while (text >> word) {
-                // We build index only for lowercase words.
-                transform(word.begin(), word.end(), word.begin(), ::tolower);
-                // Also we want to remove punctuation from whitespace-cut words.
-                word.erase(remove_if(word.begin(), word.end(), [](char x) {
-                    return ispunct(x); }), word.end());
-                // Stop words also do not contain punctuation (you'll).
-                if (stop_words.count(word) == 0) {
-                    bucket.insert(word);
-                }
+    /*
+     * Index entry of a text, stop words must be already instantiated.
+     */
+    set<string>
+    search_engine::tokenize(std::string_view card_text) const {
+        istringstream text{string(card_text)};
+        string word;
+        set<string> bucket;
+        while (text >> word) {
+            // We build index only for lowercase words.
+            transform(word.begin(), word.end(), word.begin(), ::tolower);
+            // Also we want to remove punctuation from whitespace-cut words.
+            word.erase(remove_if(word.begin(), word.end(), [](char x) {
+                return ispunct(x); }), word.end());
+            // Stop words also do not contain punctuation (you'll).
+            if (stop_words.count(word) == 0) {
+                bucket.insert(word);
             }
-            index.push_back(move(bucket));
         }
-        index_was_loaded = true;
+        return bucket;
     }
 
     const Card *
-    search_engine::search_for(const std::string & card_name) {
+    search_engine::search_for(std::string_view card_name) {
+        PROFILE_PHASE("search_for");
         auto & cards = db.get_cards();
         for (auto && card : cards) {
-            if (card.get_name() == card_name)
+            if (card.get_name() == card_name && !is_removed(static_cast<size_t> (&card - &(cards[0]))))
                 return &card;
         }
         return nullptr;
@@ -738,35 +1137,162 @@ namespace magicSearchEngine {
 
     struct {
 
+        // Ties are broken by position of cards, the same way as in
+        // build_neighbour_table, so both give the same answers.
         bool operator()(pair<size_t, const Card *> a, pair<size_t, const Card *> b) const {
-            return a.first < b.first;
+            return a.first < b.first || (a.first == b.first && a.second < b.second);
         }
     } customLess;
 
-    vector<const Card *>
-    search_engine::find_similar(const std::string & card_name, size_t cnt) {
+    card_list
+    search_engine::find_similar(std::string_view card_name, size_t cnt,
+            pmr::memory_resource * resource) {
         // Firstly we check if the search_engine is properly instantiated.
         if (!index_was_loaded)
             throw bad_optional_access("Firstly you must create_index().");
         // Then we linearly find the card to which we search for similar.
+        PROFILE_PHASE("find_similar");
+        latency_timer resolving(query_command::similar, query_phase::name_resolution);
         const Card * base_card = search_for(card_name);
+        resolving.finish();
         if (!base_card) {
-            return move(vector<const Card *>());
+            return card_list(resource);
         }
+        arena_scope scope;
+        // Precomputed answers are only read, it counts as candidate generation.
+        latency_timer generating(query_command::similar, query_phase::candidates);
+        if (neighbours.covers(cnt))
+            return neighbours.read(db.get_cards(), base_card, cnt, resource);
+        card_list scored = candidates(base_card, terms_of(base_card), cnt, scope.get());
+        generating.finish();
+        latency_timer scoring(query_command::similar, query_phase::scoring);
+        return rank(scored, base_card, cnt, resource);
+    }
+
+    scored_list
+    search_engine::score_similar(const Card & base_card, size_t cnt,
+            pmr::memory_resource * resource) {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        PROFILE_PHASE("score_similar");
+        const Card * base = &base_card;
+        arena_scope scope;
+        latency_timer generating(query_command::similar, query_phase::candidates);
+        base_terms terms_of_base = terms_of(base);
+        card_list scored(scope.get());
+        if (owns(base) && neighbours.covers(cnt))
+            scored = neighbours.read(db.get_cards(), base, cnt, scope.get());
+        else
+            scored = candidates(base, terms_of_base, cnt, scope.get());
+        generating.finish();
+        latency_timer scoring(query_command::similar, query_phase::scoring);
+        return score(scored, base, terms_of_base, cnt, resource);
+    }
+
+    bool
+    search_engine::owns(const Card * card) const {
+        const vector<Card> & cards = db.get_cards();
+        return !cards.empty() && !less<const Card *>()(card, &(cards[0])) &&
+                less<const Card *>()(card, &(cards[0]) + cards.size());
+    }
+
+    card_list
+    search_engine::candidates(const Card * base_card, const base_terms & base, size_t cnt,
+            pmr::memory_resource * resource) {
+        PROFILE_PHASE("candidates");
+        card_list res(resource);
+        if (mode == similarity_mode::lsh)
+            res = lsh_candidates(base_card, base, resource);
+        else if (mode == similarity_mode::hnsw)
+            res = hnsw_candidates(base_card, base, cnt, resource);
+        if (mode == similarity_mode::exact || res.size() < cnt)
+            res = type_candidates(base_card, resource);
+        return res;
+    }
+
+    void
+    search_engine::set_mode(similarity_mode mode_) {
+        mode = mode_;
+        // Signatures are built only once the lsh mode is chosen.
+        if (mode == similarity_mode::lsh && index_was_loaded && !lazy &&
+                minhash.size() != db.get_cards().size()) {
+            finish_compaction(true);
+            build_lsh();
+        }
+    }
+
+    similarity_mode
+    search_engine::get_mode() const {
+        return mode;
+    }
+
+    size_t
+    search_engine::mode_memory_usage(similarity_mode mode_) const {
+        switch (mode_) {
+            case similarity_mode::lsh:
+                return minhash.memory_usage();
+            case similarity_mode::hnsw:
+                return hnsw.memory_usage();
+            case similarity_mode::exact:
+            default:
+                return 0;
+        }
+    }
+
+    void
+    search_engine::account_memory(memory_report & report) const {
+        report.add_vector("index vector", index);
+        for (const set<string> & words : index) {
+            // Red-black tree node: colour, three links and the word.
+            for (const string & word : words) {
+                report.add_node("index sets", 4 * sizeof (void *) + sizeof (string));
+                report.add_string("index sets", word);
+            }
+        }
+        if (lazy)
+            lazy->account_memory(report);
+        report.add_buckets("stop words", stop_words.bucket_count());
+        for (const string & word : stop_words) {
+            report.add_node("stop words", 2 * sizeof (void *) + sizeof (string));
+            report.add_string("stop words", word);
+        }
+        // These estimate only bytes.
+        report.add("lsh index", minhash.memory_usage(), memory_report::unknown);
+        report.add("hnsw graph", hnsw.memory_usage(), memory_report::unknown);
+        report.add("neighbour table", neighbours.memory_usage(), memory_report::unknown);
+    }
+
+    void
+    search_engine::configure_lsh(size_t bands, size_t rows) {
+        // A compaction in progress belongs to the former index.
+        finish_compaction(true);
+        minhash = minhash_index(bands, rows);
+        if (index_was_loaded)
+            build_lsh();
+    }
+
+    /*
+     * All cards having all types of base_card except base_card itself,
+     * sorted by address.
+     */
+    card_list
+    search_engine::type_candidates(const Card * base_card, pmr::memory_resource * resource) {
+        if (base_card->get_types().empty())
+            return card_list(resource);
         // We find and sort subsets of all cards that share types of base_card.
-        using cards_with_type = vector<const Card *>;
-        vector<cards_with_type> base_sets;
+        pmr::vector<card_list> base_sets(resource);
+        base_sets.reserve(base_card->get_types().size());
         for (const string * type : base_card->get_types()) {
-            vector<const Card *> typeset = get_type(*type);
+            card_list typeset = get_type(*type, resource);
             sort(typeset.begin(), typeset.end());
-            base_sets.push_back(typeset);
+            base_sets.push_back(move(typeset));
         }
         // Now we find intersection of all typesets.
-        vector<const Card *> & intersection = base_sets[0];
+        card_list & intersection = base_sets[0];
         if (base_sets.size() != 1) {
             size_t j = base_sets.size();
             for (size_t i = 1; i < j; ++i) {
-                vector<const Card *> temp;
+                card_list temp(resource);
                 set_intersection(intersection.begin(), intersection.end(),
                         base_sets[i].begin(), base_sets[i].end(),
                         back_inserter(temp));
@@ -777,21 +1303,224 @@ namespace magicSearchEngine {
         auto && it = find(begin(intersection), end(intersection), base_card);
         if (it != end(intersection))
             intersection.erase(it);
+        return move(intersection);
+    }
+
+    /*
+     * Size of intersection of two sorted ranges, set_intersection without
+     * storing it.
+     */
+    template<typename Iterator>
+    static size_t
+    intersection_size(Iterator a, Iterator a_end, Iterator b, Iterator b_end) {
+        size_t res = 0;
+        while (a != a_end && b != b_end) {
+            if (*a < *b)
+                ++a;
+            else if (*b < *a)
+                ++b;
+            else {
+                ++res;
+                ++a;
+                ++b;
+            }
+        }
+        return res;
+    }
+
+    /*
+     * Whether card has all of types (of a base card).
+     */
+    static bool
+    has_types(const Card & card, const types_t & types) {
+        types_t card_types = card.get_types();
+        const symbol_id * card_ids = card_types.ids();
+        return all_of(types.ids(), types.ids() + types.size(), [&](symbol_id type) {
+            return find(card_ids, card_ids + card_types.size(), type) != card_ids + card_types.size(); });
+    }
+
+    /*
+     * Cards sharing a MinHash bucket with base_card filtered to those having
+     * all types of base_card, i.e. a subset of type_candidates.
+     */
+    card_list
+    search_engine::lsh_candidates(const Card * base_card, const base_terms & base,
+            pmr::memory_resource * resource) const {
+        const vector<Card> & cards = db.get_cards();
+        const types_t & base_types = base_card->get_types();
+        card_list res(resource);
+        if (base_types.empty())
+            return res;
+        pmr::vector<uint32_t> similar = owns(base_card) ?
+                minhash.candidates(static_cast<size_t> (base_card - &(cards[0])), resource) :
+                minhash.candidates(base.words(), resource);
+        for (uint32_t pos : similar) {
+            if (has_types(cards[pos], base_types) && !is_removed(pos))
+                res.push_back(&(cards[pos]));
+        }
+        return res;
+    }
+
+    /*
+     * Nearest cards to base_card in the HNSW graph (at least ef_search of
+     * them are looked up) filtered to those having all types of base_card.
+     */
+    card_list
+    search_engine::hnsw_candidates(const Card * base_card, const base_terms & base,
+            size_t cnt, pmr::memory_resource * resource) const {
+        const vector<Card> & cards = db.get_cards();
+        const types_t & base_types = base_card->get_types();
+        card_list res(resource);
+        if (base_types.empty() || hnsw.size() != cards.size())
+            return res;
+        size_t k = max(hnsw.get_params().ef_search, cnt + 1);
+        if (!owns(base_card)) {
+            // A card from elsewhere is looked up by its embedding.
+            for (const hnsw_index::result & r : hnsw.search(features(base_card, base).data(), k, resource)) {
+                if (has_types(cards[r.second], base_types) && !is_removed(r.second))
+                    res.push_back(&(cards[r.second]));
+            }
+            return res;
+        }
+        uint32_t base_pos = static_cast<uint32_t> (base_card - &(cards[0]));
+        for (const hnsw_index::result & r : hnsw.search(base_pos, k, resource)) {
+            if (r.second != base_pos && has_types(cards[r.second], base_types) && !is_removed(r.second))
+                res.push_back(&(cards[r.second]));
+        }
+        return res;
+    }
+
+    hnsw_index
+    search_engine::build_hnsw(const hnsw_params & params) const {
+        if (!index_was_loaded)
+            throw bad_optional_access("Firstly you must create_index().");
+        const vector<Card> & cards = db.get_cards();
+        hnsw_index res(embedding_size(), params);
+        for (const Card & card : cards)
+            res.add(features(&card));
+        return res;
+    }
+
+    size_t
+    search_engine::embedding_size() {
+        // Power and toughness take three values each, loyalty, hand and
+        // life one.
+        return 3 + 3 + 3 + layout_dim + types_dim + text_dim;
+    }
+
+    void
+    search_engine::set_hnsw(hnsw_index && graph) {
+        hnsw = move(graph);
+    }
+
+    /*
+     * Embedding of a card for the HNSW graph. The squared euclidean distance
+     * of two embeddings approximates get_distance: power, toughness, loyalty,
+     * hand and life are taken as they are (missing values far from all
+     * others), layout and types are hashed one-hot vectors, the latter
+     * weighted to keep cards of other types apart, and the text is a hashed
+     * bag of index terms (keywords count twice) normalized so that texts
+     * without common terms are 50 apart. That is half of what full_text
+     * gives, since a single common term does not make cards closer there.
+     */
+    vector<float>
+    search_engine::features(const Card * card) const {
+        return features(card, terms_of(card));
+    }
+
+    vector<float>
+    search_engine::features(const Card * card, const base_terms & card_terms) const {
+        const float missing = -1000;
+        const float type_weight = 50;
+        const float text_weight = 50 / sqrt(2.0f);
+
+        vector<float> res;
+        auto && add_feature = [&res, missing](const feature & f) {
+            res.push_back(f.whole_part == INT_MIN ? missing : static_cast<float> (f.whole_part));
+            res.push_back(f.half ? 0.5f : 0);
+            res.push_back(f.asterics ? 50.0f : 0);
+        };
+        auto && add_number = [&res, missing](int n) {
+            res.push_back(n == INT_MIN ? missing : static_cast<float> (n));
+        };
+        add_feature(card->get_power());
+        add_feature(card->get_toughness());
+        add_number(card->get_loyalty());
+        add_number(card->get_hand());
+        add_number(card->get_life());
+
+        vector<float> layout(layout_dim, 0);
+        layout[hash<string_view>()(card->get_layout()) % layout_dim] = 1 / sqrt(2.0f);
+        res.insert(end(res), begin(layout), end(layout));
+
+        vector<float> types(types_dim, 0);
+        for (const string * type : card->get_types())
+            types[hash<string>()(*type) % types_dim] = type_weight;
+        res.insert(end(res), begin(types), end(types));
+
+        vector<float> text(text_dim, 0);
+        auto && add_term = [&text](size_t h, bool keyword) {
+            float weight = keyword ? 2 : 1;
+            text[h % text_dim] += ((h >> 32) & 1) ? weight : -weight;
+        };
+        if (card_terms.in_image) {
+            for (uint32_t id : card_terms.ids)
+                add_term(image->term_hash(id), image->is_keyword(id));
+        }
+        else {
+            for (const string & word : card_terms.words())
+                add_term(hash<string>()(word), db.get_keyword_abilities().count(word) +
+                    db.get_keyword_actions().count(word) != 0);
+        }
+        float norm = 0;
+        for (float x : text)
+            norm += x * x;
+        if (norm > 0) {
+            norm = sqrt(norm);
+            for (float & x : text)
+                x *= text_weight / norm;
+        }
+        res.insert(end(res), begin(text), end(text));
+        return res;
+    }
+
+    /*
+     * Scores candidates and returns cnt of the closest ones.
+     */
+    card_list
+    search_engine::rank(const card_list & candidates, const Card * base_card, size_t cnt,
+            pmr::memory_resource * resource) const {
         // Now we define a vector space for fields of cards and turn all fields
         // to numeral values. For text fields we use method from full-text search.
         // The vector space has dimension of 9 for layout, manaCost, colors, text,
         // power, toughness, loyalty, hand, life.
-        vector<pair<size_t, const Card *> > distances;
-        for (const Card * card : intersection) {
-            distances.push_back(make_pair(get_distance(card, base_card), card));
+        arena_scope scope;
+        scored_list distances = score(candidates, base_card, terms_of(base_card), cnt, scope.get());
+        card_list res(resource);
+        res.reserve(distances.size());
+        for (const scored_card & scored : distances) {
+            res.push_back(scored.second);
+        }
+        return res;
+    }
+
+    /*
+     * rank with distances, base are terms of base_card.
+     */
+    scored_list
+    search_engine::score(const card_list & candidates, const Card * base_card,
+            const base_terms & base, size_t cnt, pmr::memory_resource * resource) const {
+        TRACE_SPAN("scoring");
+        PROFILE_PHASE("scoring");
+        arena_scope scope;
+        scored_list distances(scope.get());
+        distances.reserve(candidates.size());
+        for (const Card * card : candidates) {
+            distances.push_back(make_pair(get_distance(card, base_card, base), card));
         }
         sort(begin(distances), end(distances), customLess);
-        vector<const Card *> res;
         size_t j = (cnt < distances.size()) ? cnt : distances.size();
-        for (size_t i = 0; i < j; ++i) {
-            res.push_back(distances[i].second);
-        }
-        return move(res);
+        return scored_list(begin(distances), begin(distances) + static_cast<ptrdiff_t> (j), resource);
     }
 
     /*
@@ -801,11 +1530,15 @@ namespace magicSearchEngine {
      * db.get_cards(). Cards in json file are sorted, so as an assumption sorting
      * probably sorted vector will be cheaper than logarithmic adding to std::set.
      */
-    vector<const Card *>
-    search_engine::get_type(const string & type) {
-        vector<const Card *> res;
+    card_list
+    search_engine::get_type(const string & type, pmr::memory_resource * resource) {
+        TRACE_SPAN("get_type");
+        PROFILE_PHASE("get_type");
+        card_list res(resource);
         const vector<Card> & cards = db.get_cards();
         for (const Card & card : cards) {
+            if (is_removed(static_cast<size_t> (&card - &(cards[0]))))
+                continue;
             const types_t & card_types = card.get_types();
             // Typically, size of card_types is 1,2, only for one it's more.
             for (auto && type_ : card_types) {
@@ -813,7 +1546,12 @@ namespace magicSearchEngine {
                     res.push_back(&card);
             }
         }
-        return move(res);
+        return res;
+    }
+
+    void
+    search_engine::set_neighbours(neighbour_table && table) {
+        neighbours = move(table);
     }
 
     /*
@@ -822,7 +1560,14 @@ namespace magicSearchEngine {
      * multiplicative constants should be conducted.
      */
     size_t
-    search_engine::get_distance(const Card * card, const Card * base_card) {
+    search_engine::get_distance(const Card * card, const Card * base_card) const {
+        return get_distance(card, base_card, terms_of(base_card));
+    }
+
+    size_t
+    search_engine::get_distance(const Card * card, const Card * base_card,
+            const base_terms & base) const {
+        PROFILE_PHASE("get_distance");
         size_t layout_d = 0;
         float power_d = 0;
         float toughness_d = 0;
@@ -839,29 +1584,28 @@ namespace magicSearchEngine {
             res += 50 * abs((int) f1.asterics - (int) f2.asterics);
             return res;
         };
-        auto && dist_colors = [](const vector<const string *> & a,
-                const vector<const std::string *> & b) -> size_t {
-                    vector<const string *> intersection;
-                    set_intersection(begin(a), end(a), begin(b), end(b), back_inserter(intersection));
-                    if (intersection.size() == 0)
+        auto && dist_colors = [](const colors_t & a, const colors_t & b) -> size_t {
+                    size_t common = intersection_size(a.ids(), a.ids() + a.size(),
+                            b.ids(), b.ids() + b.size());
+                    if (common == 0)
                         return 50;
-                    if (intersection.size() == a.size() && intersection.size() == b.size())
+                    if (common == a.size() && common == b.size())
                         return 0;
-                    if (intersection.size() != a.size() && intersection.size() == b.size())
+                    if (common != a.size() && common == b.size())
                         return 10;
-                    if (intersection.size() == a.size() && intersection.size() != b.size())
+                    if (common == a.size() && common != b.size())
                         return 10;
                     else
                         return 40;
                 };
-        if (card->get_layout() != base_card->get_layout())
+        if (card->get_layout_id() != base_card->get_layout_id())
             layout_d = 1;
         power_d = to_float(card->get_power(), base_card->get_power());
         toughness_d = to_float(card->get_toughness(), base_card->get_toughness());
         loyalty_d = abs(card->get_loyalty() - base_card->get_loyalty());
         hand_d = abs(card->get_hand() - base_card->get_hand());
         life_d = abs(card->get_life() - base_card->get_life());
-        text_d = full_text(card, base_card);
+        text_d = full_text(card, base);
         colors_d = dist_colors(card->get_colors(), base_card->get_colors());
 
         // We don't need return actual distance with the square root, since we
@@ -884,17 +1628,50 @@ namespace magicSearchEngine {
      * cards means smaller distance in some dimension.
      */
     size_t
-    search_engine::full_text(const Card * card, const Card * base_card) {
+    search_engine::full_text(const Card * card, const Card * base_card) const {
+        return full_text(card, terms_of(base_card));
+    }
+
+    size_t
+    search_engine::full_text(const Card * card, const base_terms & base) const {
         size_t c_pos = card - &(db.get_cards()[0]);
-        size_t bc_pos = base_card - &(db.get_cards()[0]);
-        vector<string> intersection;
-        set<string> c_ind = index[c_pos];
-        set<string> bc_ind = index[bc_pos];
-        set_intersection(begin(c_ind), end(c_ind),
-                begin(bc_ind), end(bc_ind),
-                back_inserter(intersection));
         size_t res = 0;
-        for (const string & word : intersection) {
+        size_t common = 0;
+        if (image) {
+            // Ids of terms ascend as the terms do, the same merge of ids.
+            engine_image::term_range c_ids = image->terms(c_pos);
+            engine_image::term_range bc_ids = base.image_ids();
+            const uint32_t * c_id = c_ids.first;
+            const uint32_t * bc_id = bc_ids.first;
+            while (c_id != c_ids.last && bc_id != bc_ids.last) {
+                if (*c_id < *bc_id)
+                    ++c_id;
+                else if (*bc_id < *c_id)
+                    ++bc_id;
+                else {
+                    res += image->is_keyword(*c_id) ? 2u : 1u;
+                    ++common;
+                    ++c_id;
+                    ++bc_id;
+                }
+            }
+            return common == 0 ? 100 : 100 / res;
+        }
+        const set<string> & c_ind = terms(c_pos);
+        const set<string> & bc_ind = base.words();
+        // Both sets are sorted, so common words are found by merging them.
+        auto c_it = begin(c_ind);
+        auto bc_it = begin(bc_ind);
+        while (c_it != end(c_ind) && bc_it != end(bc_ind)) {
+            if (*c_it < *bc_it) {
+                ++c_it;
+                continue;
+            }
+            if (*bc_it < *c_it) {
+                ++bc_it;
+                continue;
+            }
+            const string & word = *c_it;
             if (db.get_keyword_abilities().count(word) +
                     db.get_keyword_actions().count(word) == 0) {
                 res++;
@@ -902,8 +1679,11 @@ namespace magicSearchEngine {
             else {
                 res += 2;
             }
+            ++common;
+            ++c_it;
+            ++bc_it;
         }
-        if (intersection.size() == 0)
+        if (common == 0)
             res = 100;
         else
             res = 100 / res;
@@ -32,41 +32,320 @@
 #ifndef SEARCHING_HPP
 #define SEARCHING_HPP
 
+#include <future>
+#include <memory>
 #include <set>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
 #include "database.hpp"
 #include "card.hpp"
+#include "engine_image.hpp"
+#include "neighbours.hpp"
+#include "minhash.hpp"
+#include "hnsw.hpp"
+#include "memstats.hpp"
+#include "arena.hpp"
 
 namespace magicSearchEngine {
 
+    /*
+     * How find_similar chooses cards to be scored by get_distance.
+     */
+    enum class similarity_mode {
+        // All cards sharing types of the base card.
+        exact,
+        // Only those of them sharing a MinHash bucket with the base card,
+        // exact when there are not enough of such cards.
+        lsh,
+        // Only those of them found among the nearest cards in the HNSW
+        // graph of card embeddings, exact when there are not enough of them.
+        hnsw
+    } ;
+
+    /*
+     * When create_index tokenizes texts of cards: all at once (eager), or
+     * each when its terms are needed first by a query (lazy), which suits
+     * processes answering a few queries. The lsh mode needs terms of all
+     * cards, so its index is always eager.
+     */
+    enum class index_mode {
+        eager, lazy
+    } ;
+
+    /*
+     * Cards of a query. Queries take memory from the query_arena of the
+     * thread, see find_similar.
+     */
+    using card_list = std::pmr::vector<const Card *>;
+
+    /*
+     * Cards of a query with their distances to its base card, see
+     * score_similar.
+     */
+    using scored_card = std::pair<size_t, const Card *>;
+    using scored_list = std::pmr::vector<scored_card>;
+
     class search_engine {
     private:
+        class loading_index;
+        class lazy_terms;
+
         const Database & db;
         std::vector<std::set<std::string> > index;
+        std::unordered_set<std::string> stop_words;
         bool index_was_loaded;
+        neighbour_table neighbours;
+        minhash_index minhash;
+        hnsw_index hnsw;
+        similarity_mode mode;
+        std::unique_ptr<loading_index> loading;
+        index_mode indexing;
+        std::unique_ptr<lazy_terms> lazy;
+        // Tombstones of cards removed after create_index, see update_index.
+        std::vector<bool> removed;
+        // LSH buckets rebuilt without tombstones on another thread.
+        std::future<minhash_index::compaction> lsh_compaction;
+        // Of db when its cards were taken from one, then terms are there.
+        const engine_image * image;
+
+        /*
+         * Terms of a base card: its index entry, terms of the text of a card
+         * from elsewhere, or ids of its terms in the image (for a card from
+         * elsewhere of those of its terms the image has).
+         */
+        struct base_terms {
+            const std::set<std::string> * entry = nullptr;
+            std::set<std::string> tokenized;
+            bool in_image = false;
+            engine_image::term_range ids{nullptr, nullptr};
+            std::vector<std::uint32_t> found;
+
+            base_terms() = default;
+            base_terms(base_terms &&) noexcept;
+            ~base_terms();
+
+            const std::set<std::string> &
+            words() const {
+                return entry ? *entry : tokenized;
+            }
+
+            engine_image::term_range
+            image_ids() const {
+                return in_image ? ids : engine_image::term_range{found.data(), found.data() + found.size()};
+            }
+        } ;
+
+        void
+        define_stop_words();
+
+        // Index entry of the card at pos, tokenized now in the lazy mode.
+        const std::set<std::string> &
+        terms(size_t pos) const;
+
+        base_terms
+        terms_of(const Card * card) const;
+
+        bool
+        is_lazy() const;
+
+        // Signatures of terms of all cards, only for the lsh mode.
+        void
+        build_lsh();
+
+        bool
+        is_removed(size_t pos) const;
+
+        // Takes the LSH compaction if it is done (or waits for it).
+        void
+        finish_compaction(bool wait);
 
     public:
+        // Raised whenever tokenize gives other terms, engine images hold them.
+        static constexpr uint32_t tokenizer_version = 1;
+
+        search_engine(const Database & db_);
 
-        search_engine(const Database & db_) : db(db_), index_was_loaded(false) {
-        }
+        ~search_engine();
 
+        /*
+         * Texts of cards are tokenized by workers of the next load_database
+         * of database while it builds the cards, create_index then only
+         * takes the result. Nothing is done for a lazy index.
+         */
+        void
+        index_while_loading(JSONDatabase & database);
+
+        /*
+         * With cards of an engine image only LSH signatures are computed (in
+         * the lsh mode), terms of cards are those of the image.
+         */
         void
         create_index();
 
+        /*
+         * Writes cards of db and their terms as the engine image at path for
+         * the catalog at data_path, see engine_image.
+         */
+        void
+        publish_image(const std::string & path, const std::string & data_path) const;
+
+        /*
+         * Patches the index after changes of cards of db (as a card_store
+         * reports them): terms, LSH signatures and the HNSW graph of a card
+         * added or replaced are computed, a removed card is tombstoned and
+         * no query finds it any more. Tombstones of LSH buckets are
+         * compacted on another thread once there are many of them.
+         * Precomputed neighbours are dropped, they may name changed cards.
+         * Like create_index, it must not run together with queries. Cards
+         * of an engine image do not change.
+         */
+        void
+        update_index(const std::vector<card_update> & updates);
+
+        // The card at pos was appended to cards of db.
+        void
+        add_card(size_t pos);
+
+        // The card at pos was replaced.
+        void
+        update_card(size_t pos);
+
+        // The card at pos was deleted, its position is kept.
+        void
+        remove_card(size_t pos);
+
+        // Waits for the compaction of tombstones started by update_index.
+        void
+        compact_index();
+
+        // Takes effect at the next create_index.
+        void
+        set_index_mode(index_mode indexing_);
+
+        std::set<std::string>
+        tokenize(std::string_view text) const;
+
         const Card *
-        search_for(const std::string &);
+        search_for(std::string_view);
+
+        /*
+         * Temporaries of the search live in the query arena of the thread,
+         * the result is allocated from resource. A caller within its own
+         * arena_scope can pass scope.get(), then the query does not touch
+         * the global allocator once the arena is big enough.
+         */
+        card_list
+        find_similar(std::string_view, size_t cnt,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource());
+
+        /*
+         * find_similar with distances, for a base card of db or for one
+         * which is not (e.g. a card of another shard, see shard_server), then
+         * its terms are made from its text. Sorted by distance, ties by
+         * position.
+         */
+        scored_list
+        score_similar(const Card & base_card, size_t cnt,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource());
+
+        card_list
+        get_type(const std::string &,
+                std::pmr::memory_resource * resource = std::pmr::get_default_resource());
+
+        /*
+         * Once set, find_similar answers from the table whenever it holds
+         * enough neighbours.
+         */
+        void
+        set_neighbours(neighbour_table && table);
+
+        void
+        set_mode(similarity_mode);
+
+        similarity_mode
+        get_mode() const;
+
+        /*
+         * Approximate heap bytes of structures used only by the mode.
+         */
+        size_t
+        mode_memory_usage(similarity_mode) const;
+
+        // Index, stop words and structures of similarity modes.
+        void
+        account_memory(memory_report & report) const;
 
-        std::vector<const Card *>
-        find_similar(const std::string &, size_t cnt);
+        /*
+         * Recall/speed knob of the lsh mode, see minhash_index. Signatures
+         * are rebuilt if the index already exists.
+         */
+        void
+        configure_lsh(size_t bands, size_t rows);
+
+        /*
+         * Builds the HNSW graph over embeddings of all cards (see features),
+         * needs the index. It is expensive, so it is meant to be built
+         * offline, stored and set by set_hnsw.
+         */
+        hnsw_index
+        build_hnsw(const hnsw_params & params) const;
 
-        std::vector<const Card *>
-        get_type(const std::string &);
+        // Dimension of embeddings in the HNSW graph.
+        static size_t
+        embedding_size();
+
+        void
+        set_hnsw(hnsw_index && graph);
+
+        size_t
+        get_distance(const Card *, const Card *) const;
+
+        size_t
+        full_text(const Card * card, const Card * base_card) const;
 
     private:
+        // Whether card is one of db, not a base card from elsewhere.
+        bool
+        owns(const Card * card) const;
+
         size_t
-        get_distance(const Card *, const Card *);
+        get_distance(const Card * card, const Card * base_card,
+                const base_terms & base) const;
 
         size_t
-        full_text(const Card * card, const Card * base_card);
+        full_text(const Card * card, const base_terms & base) const;
+
+        std::vector<float>
+        features(const Card * card) const;
+
+        std::vector<float>
+        features(const Card * card, const base_terms & card_terms) const;
+
+        // Cards scored by find_similar in the mode.
+        card_list
+        candidates(const Card * base_card, const base_terms & base, size_t cnt,
+                std::pmr::memory_resource * resource);
+
+        card_list
+        hnsw_candidates(const Card * base_card, const base_terms & base,
+                size_t cnt, std::pmr::memory_resource * resource) const;
+
+        card_list
+        type_candidates(const Card * base_card, std::pmr::memory_resource * resource);
+
+        card_list
+        lsh_candidates(const Card * base_card, const base_terms & base,
+                std::pmr::memory_resource * resource) const;
+
+        card_list
+        rank(const card_list & candidates, const Card * base_card, size_t cnt,
+                std::pmr::memory_resource * resource) const;
+
+        scored_list
+        score(const card_list & candidates, const Card * base_card,
+                const base_terms & base, size_t cnt,
+                std::pmr::memory_resource * resource) const;
     } ;
 }
 
@@ -0,0 +1,601 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "src/shard.hpp"
+#include "src/card_reader.hpp"
+#include "src/mapped_file.hpp"
+#include "src/zip_input.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    /*
+     * A message between a coordinator and a shard is its size (8 bytes)
+     * followed by fields, each of them its size (4 bytes) and its bytes.
+     * Both ends run on one machine, so sizes are in its byte order.
+     */
+    static string
+    encode(const vector<string> & fields) {
+        string res(sizeof (uint64_t), '\0');
+        for (const string & field : fields) {
+            uint32_t size = static_cast<uint32_t> (field.size());
+            res.append(reinterpret_cast<const char *> (&size), sizeof (size));
+            res += field;
+        }
+        uint64_t size = res.size() - sizeof (uint64_t);
+        memcpy(&(res[0]), &size, sizeof (size));
+        return res;
+    }
+
+    static vector<string>
+    decode(string_view message) {
+        vector<string> res;
+        while (!message.empty()) {
+            uint32_t size;
+            if (message.size() < sizeof (size))
+                throw runtime_error("Message of a shard is not valid.");
+            memcpy(&size, message.data(), sizeof (size));
+            message.remove_prefix(sizeof (size));
+            if (message.size() < size)
+                throw runtime_error("Message of a shard is not valid.");
+            res.emplace_back(message.substr(0, size));
+            message.remove_prefix(size);
+        }
+        return res;
+    }
+
+    static vector<string>
+    fields_of(const shard_answer & answer) {
+        vector<string> res = {"cards", to_string(answer.cards), to_string(answer.missing.size())};
+        res.insert(end(res), begin(answer.missing), end(answer.missing));
+        res.push_back(to_string(answer.found.size()));
+        for (const shard_card & card : answer.found) {
+            res.push_back(to_string(card.position));
+            res.push_back(to_string(card.distance));
+            res.push_back(card.record);
+            res.push_back(card.printed);
+        }
+        return res;
+    }
+
+    // Throws runtime_error for an error answered by the shard.
+    static shard_answer
+    answer_of(const vector<string> & fields) {
+        if (fields.size() == 2 && fields[0] == "error")
+            throw runtime_error(fields[1]);
+        shard_answer res;
+        try {
+            size_t field = 1;
+            auto && next = [&fields, &field]() -> const string & {
+                if (field >= fields.size())
+                    throw runtime_error("Answer of a shard is not valid.");
+                return fields[field++];
+            };
+            if (fields.empty() || fields[0] != "cards")
+                throw runtime_error("Answer of a shard is not valid.");
+            res.cards = stoull(next());
+            for (size_t i = stoul(next()); i > 0; --i)
+                res.missing.push_back(next());
+            for (size_t i = stoul(next()); i > 0; --i) {
+                shard_card card;
+                card.position = stoull(next());
+                card.distance = stoull(next());
+                card.record = next();
+                card.printed = next();
+                res.found.push_back(move(card));
+            }
+        }
+        catch (const logic_error &) {
+            throw runtime_error("Answer of a shard is not valid.");
+        }
+        return res;
+    }
+
+    shard_answer
+    shard::find_similar(string_view name, size_t cnt) {
+        shard_answer found = find(name);
+        if (found.found.empty())
+            return found;
+        shard_answer res = similar(found.found[0].record, found.found[0].position, cnt);
+        for (const string & socket : found.missing) {
+            if (std::find(begin(res.missing), end(res.missing), socket) == end(res.missing))
+                res.missing.push_back(socket);
+        }
+        return res;
+    }
+
+    engine_shard::engine_shard(const Database & db_, search_engine & engine_) : db(db_), engine(engine_) {
+    }
+
+    shard_answer
+    engine_shard::find(string_view name) {
+        const vector<Card> & cards = db.get_cards();
+        shard_answer res;
+        res.cards = cards.size();
+        const Card * card = engine.search_for(name);
+        if (card == nullptr)
+            return res;
+        shard_card found;
+        found.position = static_cast<uint64_t> (card - &(cards[0]));
+        ostringstream record;
+        card->write_record(record);
+        found.record = record.str();
+        ostringstream printed;
+        printed << *card;
+        found.printed = printed.str();
+        res.found.push_back(move(found));
+        return res;
+    }
+
+    shard_answer
+    engine_shard::similar(string_view record, optional<uint64_t> exclude, size_t cnt) {
+        const vector<Card> & cards = db.get_cards();
+        shard_answer res;
+        res.cards = cards.size();
+        // A card of another shard is read as a catalog of one card.
+        string_pool strings(1024);
+        optional<Card> foreign;
+        const Card * base_card = nullptr;
+        if (exclude && *exclude < cards.size()) {
+            base_card = &(cards[*exclude]);
+        }
+        else {
+            string text = "{";
+            text += record;
+            text += '}';
+            card_reader reader(text);
+            string_view key;
+            card_record base;
+            if (!reader.next(key, base))
+                throw runtime_error("Card of the request is not valid.");
+            foreign.emplace(base, strings);
+            base_card = &(*foreign);
+        }
+        arena_scope scope;
+        for (const scored_card & scored : engine.score_similar(*base_card, cnt, scope.get())) {
+            shard_card found;
+            found.position = static_cast<uint64_t> (scored.second - &(cards[0]));
+            found.distance = scored.first;
+            ostringstream printed;
+            printed << *(scored.second);
+            found.printed = printed.str();
+            res.found.push_back(move(found));
+        }
+        return res;
+    }
+
+    /*
+     * Non-blocking connection to a shard: the request is written, then the
+     * answer read as the socket is ready, see scatter.
+     */
+    class shard_coordinator::exchange {
+    private:
+        int fd;
+        string request;
+        size_t sent;
+        string answer;
+        bool failed;
+
+    public:
+
+        exchange(const string & socket_path, string request_) : fd(-1), request(move(request_)),
+        sent(0), failed(false) {
+            sockaddr_un address;
+            memset(&address, 0, sizeof (address));
+            address.sun_family = AF_UNIX;
+            if (socket_path.size() >= sizeof (address.sun_path)) {
+                failed = true;
+                return;
+            }
+            memcpy(address.sun_path, socket_path.data(), socket_path.size());
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr *> (&address), sizeof (address)) != 0)
+                failed = true;
+        }
+
+        exchange(const exchange &) = delete;
+
+        exchange &
+        operator=(const exchange &) = delete;
+
+        ~exchange() {
+            if (fd >= 0)
+                close(fd);
+        }
+
+        int
+        get_fd() const {
+            return fd;
+        }
+
+        short
+        events() const {
+            return sent < request.size() ? POLLOUT : POLLIN;
+        }
+
+        bool
+        done() const {
+            if (answer.size() < sizeof (uint64_t))
+                return false;
+            uint64_t size;
+            memcpy(&size, answer.data(), sizeof (size));
+            return answer.size() == sizeof (size) + size;
+        }
+
+        bool
+        pending() const {
+            return !failed && !done();
+        }
+
+        // Sends or receives what the socket takes now.
+        void
+        progress() {
+            if (sent < request.size()) {
+                ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EINTR)
+                    failed = true;
+                if (n > 0)
+                    sent += static_cast<size_t> (n);
+                return;
+            }
+            char buffer[1 << 16];
+            ssize_t n = recv(fd, buffer, sizeof (buffer), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+                failed = true;
+            if (n > 0)
+                answer.append(buffer, static_cast<size_t> (n));
+        }
+
+        // The answer, once done().
+        vector<string>
+        fields() const {
+            return decode(string_view(answer).substr(sizeof (uint64_t)));
+        }
+    } ;
+
+    shard_coordinator::shard_coordinator(const vector<string> & sockets_,
+            chrono::milliseconds timeout_) : sockets(sockets_), timeout(timeout_),
+    counts(sockets_.size(), 0) {
+    }
+
+    shard_coordinator::~shard_coordinator() {
+    }
+
+    vector<optional<shard_answer> >
+    shard_coordinator::scatter(const vector<vector<string> > & requests) {
+        auto deadline = chrono::steady_clock::now() + timeout;
+        vector<unique_ptr<exchange> > exchanges;
+        for (size_t i = 0; i < sockets.size(); ++i)
+            exchanges.emplace_back(new exchange(sockets[i], encode(requests[i])));
+        vector<pollfd> fds;
+        vector<exchange *> polled;
+        while (true) {
+            fds.clear();
+            polled.clear();
+            for (const unique_ptr<exchange> & e : exchanges) {
+                if (e->pending()) {
+                    fds.push_back({e->get_fd(), e->events(), 0});
+                    polled.push_back(e.get());
+                }
+            }
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+            if (fds.empty() || left.count() <= 0)
+                break;
+            if (poll(fds.data(), fds.size(), static_cast<int> (left.count()) + 1) < 0 && errno != EINTR)
+                break;
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (fds[i].revents != 0)
+                    polled[i]->progress();
+            }
+        }
+        // Connections are closed, so late answers are dropped.
+        vector<optional<shard_answer> > res(sockets.size());
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            if (!exchanges[i]->done())
+                continue;
+            try {
+                res[i] = answer_of(exchanges[i]->fields());
+            }
+            catch (const runtime_error &) {
+                // A shard which failed to answer counts as missing.
+            }
+        }
+        return res;
+    }
+
+    vector<uint64_t>
+    shard_coordinator::offsets(const vector<optional<shard_answer> > & answers) {
+        lock_guard<mutex> lock(counts_mtx);
+        for (size_t i = 0; i < answers.size(); ++i) {
+            if (answers[i])
+                counts[i] = answers[i]->cards;
+        }
+        vector<uint64_t> res(counts.size() + 1, 0);
+        partial_sum(begin(counts), end(counts), begin(res) + 1);
+        return res;
+    }
+
+    // Missing shards of answers, also those missing under the shards.
+    static vector<string>
+    missing_of(const vector<string> & sockets, const vector<optional<shard_answer> > & answers) {
+        vector<string> res;
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            if (!answers[i])
+                res.push_back(sockets[i]);
+            else
+                res.insert(end(res), begin(answers[i]->missing), end(answers[i]->missing));
+        }
+        return res;
+    }
+
+    shard_answer
+    shard_coordinator::find(string_view name) {
+        vector<optional<shard_answer> > answers = scatter(vector<vector<string> >(sockets.size(),
+        {"find", string(name)}));
+        vector<uint64_t> offset = offsets(answers);
+        shard_answer res;
+        res.cards = offset.back();
+        res.missing = missing_of(sockets, answers);
+        // The first card of the name in the whole.
+        for (size_t i = 0; i < answers.size(); ++i) {
+            if (answers[i] && !answers[i]->found.empty()) {
+                res.found.push_back(move(answers[i]->found[0]));
+                res.found[0].position += offset[i];
+                break;
+            }
+        }
+        return res;
+    }
+
+    shard_answer
+    shard_coordinator::similar(string_view record, optional<uint64_t> exclude, size_t cnt) {
+        // The shard of the base card uses it itself.
+        vector<uint64_t> offset = offsets({});
+        vector<vector<string> > requests;
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            bool owner = exclude && offset[i] <= *exclude && *exclude < offset[i + 1];
+            requests.push_back({"similar", to_string(cnt),
+                owner ? to_string(*exclude - offset[i]) : string(), string(record)});
+        }
+        vector<optional<shard_answer> > answers = scatter(requests);
+        offset = offsets(answers);
+        shard_answer res;
+        res.cards = offset.back();
+        res.missing = missing_of(sockets, answers);
+        for (size_t i = 0; i < answers.size(); ++i) {
+            if (!answers[i])
+                continue;
+            for (shard_card & card : answers[i]->found) {
+                card.position += offset[i];
+                res.found.push_back(move(card));
+            }
+        }
+        // Each shard gave its closest cnt, so the closest cnt of all are among them.
+        sort(begin(res.found), end(res.found), [](const shard_card & a, const shard_card & b) {
+            return a.distance < b.distance || (a.distance == b.distance && a.position < b.position);
+        });
+        if (res.found.size() > cnt)
+            res.found.resize(cnt);
+        return res;
+    }
+
+    shard_server::shard_server(const string & path_, shard & served_) : path(path_), served(served_),
+    connections(0) {
+    }
+
+    static bool
+    read_all(int fd, char * data, size_t size) {
+        while (size > 0) {
+            ssize_t n = recv(fd, data, size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= static_cast<size_t> (n);
+        }
+        return true;
+    }
+
+    static bool
+    write_all(int fd, const string & data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            sent += static_cast<size_t> (n);
+        }
+        return true;
+    }
+
+    /*
+     * Requests of a connection until the coordinator closes it (or is gone).
+     * A request too long or cut short closes the connection, as does
+     * anything thrown outside of answering it.
+     */
+    void
+    shard_server::answer(int connection) {
+        try {
+            while (true) {
+                uint64_t size;
+                string message;
+                if (!read_all(connection, reinterpret_cast<char *> (&size), sizeof (size)) ||
+                        size > max_request_size)
+                    break;
+                message.resize(size);
+                if (size != 0 && !read_all(connection, &(message[0]), size))
+                    break;
+                vector<string> fields;
+                try {
+                    vector<string> request = decode(message);
+                    if (request.size() == 2 && request[0] == "find") {
+                        fields = fields_of(served.find(request[1]));
+                    }
+                    else if (request.size() == 4 && request[0] == "similar") {
+                        optional<uint64_t> exclude;
+                        if (!request[2].empty())
+                            exclude = stoull(request[2]);
+                        fields = fields_of(served.similar(request[3], exclude, stoul(request[1])));
+                    }
+                    else {
+                        fields = {"error", "Request of a coordinator is not valid."};
+                    }
+                }
+                catch (const exception & e) {
+                    fields = {"error", e.what()};
+                }
+                if (!write_all(connection, encode(fields)))
+                    break;
+            }
+        }
+        catch (const exception & e) {
+            cerr << "Shard connection closed: " << e.what() << endl;
+        }
+        close(connection);
+    }
+
+    void
+    shard_server::serve() {
+        sockaddr_un address;
+        memset(&address, 0, sizeof (address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof (address.sun_path))
+            throw runtime_error("Shard cannot be served on " + path + ": the path is too long.");
+        memcpy(address.sun_path, path.data(), path.size());
+        int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0)
+            throw runtime_error("Shard cannot be served on " + path + ": " + strerror(errno) + ".");
+        // A socket left by a server before is replaced, a live one is not.
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool live = probe >= 0 &&
+                    connect(probe, reinterpret_cast<const sockaddr *> (&address), sizeof (address)) == 0;
+            if (probe >= 0)
+                close(probe);
+            if (live) {
+                close(listener);
+                throw runtime_error("Shard cannot be served on " + path + ": another shard is served there.");
+            }
+            unlink(path.c_str());
+        }
+        if (bind(listener, reinterpret_cast<const sockaddr *> (&address), sizeof (address)) != 0 ||
+                listen(listener, SOMAXCONN) != 0) {
+            int error = errno;
+            close(listener);
+            throw runtime_error("Shard cannot be served on " + path + ": " + strerror(error) + ".");
+        }
+        while (true) {
+            {
+                unique_lock<mutex> lock(connections_mtx);
+                connection_closed.wait(lock, [this]() {
+                    return connections < max_connections; });
+            }
+            int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection < 0) {
+                // A connection given up by its coordinator, or no descriptors left for now.
+                if (errno != EINTR && errno != ECONNABORTED)
+                    this_thread::sleep_for(chrono::milliseconds(10));
+                continue;
+            }
+            {
+                lock_guard<mutex> lock(connections_mtx);
+                ++connections;
+            }
+            try {
+                thread([this, connection]() {
+                    answer(connection);
+                    lock_guard<mutex> lock(connections_mtx);
+                    --connections;
+                    connection_closed.notify_one();
+                }).detach();
+            }
+            catch (const system_error &) {
+                // No thread for it now, the coordinator sees the shard missing.
+                close(connection);
+                lock_guard<mutex> lock(connections_mtx);
+                --connections;
+            }
+        }
+    }
+
+    size_t
+    split_catalog(const string & path, const vector<string> & shards) {
+        if (zip_input::is_zip(path))
+            throw runtime_error("Catalog can be split only when unzipped.");
+        mapped_file input(path);
+        card_reader reader(input.view());
+        // Texts are views of the input, a key may be unescaped by the reader.
+        vector<pair<string, string_view> > read;
+        string_view key;
+        card_record record;
+        while (reader.next(key, record))
+            read.push_back(make_pair(string(key), reader.card_text()));
+
+        // Cards as load_cards orders them, the last card of a key is kept.
+        vector<uint32_t> order(read.size());
+        iota(begin(order), end(order), 0);
+        stable_sort(begin(order), end(order), [&read](uint32_t a, uint32_t b) {
+            return read[a].first < read[b].first; });
+        vector<uint32_t> cards;
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (i + 1 < order.size() && read[order[i]].first == read[order[i + 1]].first)
+                continue;
+            cards.push_back(order[i]);
+        }
+
+        for (size_t s = 0; s < shards.size(); ++s) {
+            size_t first = cards.size() * s / shards.size();
+            size_t last = cards.size() * (s + 1) / shards.size();
+            ofstream ofs(shards[s], ios::binary | ios::trunc);
+            ofs << "{";
+            for (size_t i = first; i < last; ++i)
+                ofs << (i == first ? "\n" : ",\n") << read[cards[i]].second;
+            ofs << "\n}\n";
+            if (!ofs)
+                throw runtime_error("Shard could not be written to " + shards[s] + ".");
+        }
+        return cards.size();
+    }
+}
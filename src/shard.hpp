@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   shard.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 20, 2026, 2:15 AM
+ */
+
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "src/database.hpp"
+#include "src/searching.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * A card in an answer of a shard: its position among cards of the shard,
+     * the card as printed and, for find, its record (see Card::write_record)
+     * or, for similar, its distance to the base card.
+     */
+    struct shard_card {
+        uint64_t position = 0;
+        uint64_t distance = 0;
+        std::string record;
+        std::string printed;
+    } ;
+
+    struct shard_answer {
+        // Number of cards of the shard, as far as it knows.
+        uint64_t cards = 0;
+        // Sockets of shards which did not answer in time, so cards may be missing.
+        std::vector<std::string> missing;
+        std::vector<shard_card> found;
+    } ;
+
+    /*
+     * A part of the card space, a search_engine over its cards or
+     * a coordinator of other shards. Shards are contiguous parts of the
+     * catalog (see split_catalog) which are queried alike, so that their
+     * answers merge into the answer of the whole.
+     */
+    class shard {
+    public:
+        // The first card of name, nothing found if there is none.
+        virtual shard_answer
+        find(std::string_view name) = 0;
+
+        /*
+         * cnt cards closest to the card of record, sorted by distance and
+         * position. If the card is one of the shard, at position exclude,
+         * it is used itself and left out, as by find_similar.
+         */
+        virtual shard_answer
+        similar(std::string_view record, std::optional<uint64_t> exclude, size_t cnt) = 0;
+
+        // find, then similar for the card found, as search_engine::find_similar.
+        shard_answer
+        find_similar(std::string_view name, size_t cnt);
+
+        virtual
+        ~shard() {
+        };
+    } ;
+
+    // Cards of this process.
+    class engine_shard : public shard {
+    private:
+        const Database & db;
+        search_engine & engine;
+
+    public:
+        // db and engine must be loaded and indexed.
+        engine_shard(const Database & db_, search_engine & engine_);
+
+        shard_answer
+        find(std::string_view name) override;
+
+        shard_answer
+        similar(std::string_view record, std::optional<uint64_t> exclude, size_t cnt) override;
+    } ;
+
+    /*
+     * Shards served on local sockets (see shard_server), each request is
+     * sent to all of them at once and answers gathered until timeout, a shard
+     * answering later (or not at all) is left out and reported missing.
+     *
+     * A card at position p of shard i is at position p plus cards of shards
+     * before i of the whole, so merging top-k lists of shards by distance
+     * and that position gives the order of one engine over all cards. The
+     * counts are those last answered, so it may differ while a shard is
+     * missing. A coordinator is a shard itself and can be served too.
+     */
+    class shard_coordinator : public shard {
+    private:
+        // A request sent to a shard and its answer.
+        class exchange;
+
+        std::vector<std::string> sockets;
+        std::chrono::milliseconds timeout;
+        std::mutex counts_mtx;
+        std::vector<uint64_t> counts;
+
+        // Sends requests[i] to shard i, nullopt for a shard missing.
+        std::vector<std::optional<shard_answer> >
+        scatter(const std::vector<std::vector<std::string> > & requests);
+
+        // Position of shard i in the whole, counts of others updated by answers.
+        std::vector<uint64_t>
+        offsets(const std::vector<std::optional<shard_answer> > & answers);
+
+    public:
+        shard_coordinator(const std::vector<std::string> & sockets_,
+                std::chrono::milliseconds timeout_);
+
+        ~shard_coordinator() override;
+
+        shard_answer
+        find(std::string_view name) override;
+
+        shard_answer
+        similar(std::string_view record, std::optional<uint64_t> exclude, size_t cnt) override;
+    } ;
+
+    /*
+     * Serves a shard to coordinators on a local socket at path, each
+     * connection on its own thread, at most max_connections of them at
+     * once; further ones wait in the backlog of the socket. serve() does not
+     * return, it throws runtime_error if the socket cannot be made or
+     * another server answers on it.
+     */
+    class shard_server {
+    public:
+        static constexpr size_t max_connections = 64;
+        // A request holds a card record, anything longer is not one.
+        static constexpr uint64_t max_request_size = 1 << 20;
+
+    private:
+        std::string path;
+        shard & served;
+        std::mutex connections_mtx;
+        std::condition_variable connection_closed;
+        size_t connections;
+
+        void
+        answer(int connection);
+
+    public:
+        shard_server(const std::string & path_, shard & served_);
+
+        [[noreturn]] void
+        serve();
+    } ;
+
+    /*
+     * Writes cards of the (unzipped) catalog at path to the shards, about
+     * the same number to each, in order of get_cards() of the catalog, i.e.
+     * a shard gets a contiguous part of them. Returns the number of cards
+     * written, throws runtime_error if a shard cannot be written.
+     */
+    size_t
+    split_catalog(const std::string & path, const std::vector<std::string> & shards);
+}
+
+#endif /* SHARD_HPP */
@@ -0,0 +1,341 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Recall and latency of approximate similarity modes. A sample of base
+ * cards is searched by the exact find_similar and by every approximate
+ * mode; the JSON report is what enabling a mode is decided on.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/resource.h>
+
+#include "database.hpp"
+#include "searching.hpp"
+#include "neighbours.hpp"
+#include "hnsw.hpp"
+#include "src/json.hpp"
+#include "../docopt.cpp/docopt.h"
+
+using namespace magicSearchEngine;
+using namespace std;
+using json = nlohmann::json;
+
+static const char USAGE[] =
+        R"(Similarity evaluation of approximate modes against the exact search.
+
+    Usage:
+      similarity_eval [--data=<file>] [--sample=<n>] [--k=<k>] [--seed=<s>] [--lsh-bands=<b> --lsh-rows=<r>] [--hnsw=<file> --ef-search=<e>] [--neighbours=<file>]
+      similarity_eval (-h | --help)
+
+    Options:
+      --data=<file>       Cards in the format of AllCards.json or a zip of it
+                          [default: ./src/AllCards.json].
+      --sample=<n>        Number of base cards drawn from the catalog [default: 200].
+      --k=<k>             Number of similar cards compared [default: 10].
+      --seed=<s>          Seed of drawing the sample [default: 1].
+      --lsh-bands=<b>     LSH bands [default: 16].
+      --lsh-rows=<r>      MinHashes per LSH band [default: 4].
+      --hnsw=<file>       Stored HNSW graph, built in memory if not given.
+      --ef-search=<e>     Width of search in HNSW graph [default: 64].
+      --neighbours=<file> Stored neighbour table, the mode is skipped if not given.
+      -h --help           Show this screen.
+
+    Cards sharing their name with another card are never drawn, a query
+    by name would not tell them apart. The report is written to the
+    standard output, progress to the standard error.
+)";
+
+/*
+ * The exact answer for one base card.
+ */
+struct reference {
+    const Card * base;
+    std::vector<const Card *> top;
+    size_t kth_distance;
+} ;
+
+struct mode_stats {
+    std::vector<double> latencies_us;
+    double recall = 0;
+    double distance_recall = 0;
+    double rank_correlation = 0;
+    size_t recall_queries = 0;
+    size_t correlation_queries = 0;
+    size_t memory_bytes = 0;
+    double build_s = 0;
+} ;
+
+static double
+seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static size_t
+option(map<string, docopt::value> & args, const string & name, size_t default_) {
+    return args[name] ? stoul(args[name].asString()) : default_;
+}
+
+/*
+ * Spearman's coefficient between the exact top k and their positions in
+ * the approximate answer, missed cards share the last place. Answers are
+ * sorted by the exact distance, so comparing the order of the answered
+ * cards alone would always give 1.
+ */
+static double
+spearman(const card_list & answer, const reference & ref) {
+    size_t n = ref.top.size();
+    vector<size_t> position;
+    for (const Card * card : ref.top)
+        position.push_back(static_cast<size_t> (find(begin(answer), end(answer), card) - begin(answer)));
+    vector<size_t> order(n);
+    iota(begin(order), end(order), 0);
+    sort(begin(order), end(order), [&position](size_t a, size_t b) {
+        return position[a] < position[b]; });
+    // Tied cards get the mean of their ranks.
+    vector<double> rank(n);
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && position[order[j]] == position[order[i]])
+            ++j;
+        for (size_t t = i; t < j; ++t)
+            rank[order[t]] = static_cast<double> (i + j - 1) / 2;
+        i = j;
+    }
+    double mean = static_cast<double> (n - 1) / 2;
+    double cov = 0;
+    double var_exact = 0;
+    double var_answer = 0;
+    for (size_t r = 0; r < n; ++r) {
+        double d = static_cast<double> (r) - mean;
+        cov += d * (rank[r] - mean);
+        var_exact += d * d;
+        var_answer += (rank[r] - mean) * (rank[r] - mean);
+    }
+    // All of them missed, nothing agrees.
+    if (var_answer == 0)
+        return 0;
+    return cov / sqrt(var_exact * var_answer);
+}
+
+/*
+ * Runs the sample through the engine in its current mode. When refs are
+ * given, answers are compared with them.
+ */
+static mode_stats
+run_mode(search_engine & oraculum, const vector<reference> & refs, size_t k, bool compare) {
+    mode_stats stats;
+    for (const reference & ref : refs) {
+        auto start = chrono::steady_clock::now();
+        card_list answer = oraculum.find_similar(ref.base->get_name(), k);
+        stats.latencies_us.push_back(seconds_since(start) * 1e6);
+        if (!compare || ref.top.empty())
+            continue;
+        size_t hits = 0;
+        size_t close = 0;
+        for (const Card * card : answer) {
+            if (find(begin(ref.top), end(ref.top), card) != end(ref.top))
+                ++hits;
+            // Cards as close as the k-th exact one are equally good answers.
+            if (oraculum.get_distance(card, ref.base) <= ref.kth_distance)
+                ++close;
+        }
+        stats.recall += static_cast<double> (hits) / static_cast<double> (ref.top.size());
+        stats.distance_recall += static_cast<double> (min(close, ref.top.size())) /
+                static_cast<double> (ref.top.size());
+        ++stats.recall_queries;
+        if (ref.top.size() > 1) {
+            stats.rank_correlation += spearman(answer, ref);
+            ++stats.correlation_queries;
+        }
+    }
+    if (stats.recall_queries != 0) {
+        stats.recall /= static_cast<double> (stats.recall_queries);
+        stats.distance_recall /= static_cast<double> (stats.recall_queries);
+    }
+    if (stats.correlation_queries != 0)
+        stats.rank_correlation /= static_cast<double> (stats.correlation_queries);
+    return stats;
+}
+
+static json
+to_json(mode_stats & stats, bool compare) {
+    vector<double> & lat = stats.latencies_us;
+    sort(begin(lat), end(lat));
+    auto && percentile = [&lat](double p) {
+        return lat.empty() ? 0 : lat[static_cast<size_t> (p * static_cast<double> (lat.size() - 1))];
+    };
+    double mean = lat.empty() ? 0 : accumulate(begin(lat), end(lat), 0.0) / static_cast<double> (lat.size());
+    json res = {
+        {"latency_us",
+            {
+                {"mean", mean},
+                {"p50", percentile(0.5)},
+                {"p99", percentile(0.99)}
+            }},
+        {"memory_bytes", stats.memory_bytes},
+        {"build_s", stats.build_s}
+    };
+    if (compare) {
+        res["recall_at_k"] = stats.recall;
+        res["distance_recall_at_k"] = stats.distance_recall;
+        res["rank_correlation"] = stats.rank_correlation;
+        res["compared_queries"] = stats.recall_queries;
+    }
+    return res;
+}
+
+int
+main(int argc, char * argv[]) {
+    map<string, docopt::value> args = docopt::docopt(USAGE,{argv + 1, argv + argc}, true);
+    size_t sample, k, seed, bands, rows;
+    hnsw_params params;
+    try {
+        sample = option(args, "--sample", 200);
+        k = option(args, "--k", 10);
+        seed = option(args, "--seed", 1);
+        bands = option(args, "--lsh-bands", 16);
+        rows = option(args, "--lsh-rows", 4);
+        params.ef_search = option(args, "--ef-search", params.ef_search);
+    }
+    catch (...) {
+        cout << USAGE << endl;
+        return 1;
+    }
+    if (k == 0 || bands == 0 || rows == 0) {
+        cout << USAGE << endl;
+        return 1;
+    }
+
+    JSONDatabase database(args["--data"] ? args["--data"].asString() : JSONDatabase::default_path);
+    search_engine oraculum(database);
+    auto start = chrono::steady_clock::now();
+    database.load_database();
+    oraculum.create_index();
+    double load_s = seconds_since(start);
+    const vector<Card> & cards = database.get_cards();
+
+    map<string_view, size_t> name_counts;
+    for (const Card & card : cards)
+        ++name_counts[card.get_name()];
+    vector<size_t> positions;
+    for (size_t pos = 0; pos < cards.size(); ++pos)
+        if (name_counts[cards[pos].get_name()] == 1)
+            positions.push_back(pos);
+    size_t ambiguous = cards.size() - positions.size();
+    if (ambiguous != 0)
+        cerr << "eval: " << ambiguous << " cards with ambiguous names skipped" << endl;
+    shuffle(begin(positions), end(positions), mt19937(seed));
+    positions.resize(min(sample, positions.size()));
+
+    json report;
+    report["cards"] = cards.size();
+    report["ambiguous_cards"] = ambiguous;
+    report["sample"] = positions.size();
+    report["k"] = k;
+    report["load_s"] = load_s;
+
+    // The exact search gives both the reference and the baseline latency.
+    cerr << "eval: exact" << endl;
+    vector<reference> refs;
+    for (size_t pos : positions) {
+        reference ref;
+        ref.base = oraculum.search_for(cards[pos].get_name());
+        card_list top = oraculum.find_similar(ref.base->get_name(), k);
+        ref.top.assign(begin(top), end(top));
+        ref.kth_distance = ref.top.empty() ? 0 : oraculum.get_distance(ref.top.back(), ref.base);
+        refs.push_back(move(ref));
+    }
+    mode_stats exact = run_mode(oraculum, refs, k, false);
+    report["modes"]["exact"] = to_json(exact, false);
+
+    cerr << "eval: lsh" << endl;
+    start = chrono::steady_clock::now();
+    oraculum.set_mode(similarity_mode::lsh);
+    oraculum.configure_lsh(bands, rows);
+    double build_s = seconds_since(start);
+    mode_stats lsh = run_mode(oraculum, refs, k, true);
+    lsh.build_s = build_s;
+    lsh.memory_bytes = oraculum.mode_memory_usage(similarity_mode::lsh);
+    report["modes"]["lsh"] = to_json(lsh, true);
+    report["modes"]["lsh"]["bands"] = bands;
+    report["modes"]["lsh"]["rows"] = rows;
+
+    cerr << "eval: hnsw" << endl;
+    start = chrono::steady_clock::now();
+    hnsw_index graph;
+    bool loaded = false;
+    try {
+        loaded = args["--hnsw"] && graph.load(args["--hnsw"].asString(),
+                neighbour_table::catalog_fingerprint(cards), cards.size(), search_engine::embedding_size());
+    }
+    catch (const runtime_error & e) {
+        cerr << e.what() << endl;
+    }
+    if (!loaded)
+        graph = oraculum.build_hnsw(params);
+    graph.set_ef_search(params.ef_search);
+    oraculum.set_hnsw(move(graph));
+    build_s = seconds_since(start);
+    oraculum.set_mode(similarity_mode::hnsw);
+    mode_stats hnsw = run_mode(oraculum, refs, k, true);
+    hnsw.build_s = build_s;
+    hnsw.memory_bytes = oraculum.mode_memory_usage(similarity_mode::hnsw);
+    report["modes"]["hnsw"] = to_json(hnsw, true);
+    report["modes"]["hnsw"]["ef_search"] = params.ef_search;
+
+    if (args["--neighbours"]) {
+        cerr << "eval: neighbours" << endl;
+        neighbour_table table;
+        start = chrono::steady_clock::now();
+        if (table.load(args["--neighbours"].asString(), cards) && table.covers(k)) {
+            build_s = seconds_since(start);
+            size_t memory = table.memory_usage();
+            oraculum.set_mode(similarity_mode::exact);
+            oraculum.set_neighbours(move(table));
+            mode_stats neighbours = run_mode(oraculum, refs, k, true);
+            neighbours.build_s = build_s;
+            neighbours.memory_bytes = memory;
+            report["modes"]["neighbours"] = to_json(neighbours, true);
+        }
+        else {
+            cerr << "eval: neighbour table is missing or smaller than k, skipped" << endl;
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    report["peak_rss_kb"] = usage.ru_maxrss;
+    cout << report.dump(2) << endl;
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   small_vector.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 8:50 PM
+ */
+
+#ifndef SMALL_VECTOR_HPP
+#define SMALL_VECTOR_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace magicSearchEngine {
+
+    /*
+     * Vector of trivially copyable values with room for N of them inside the
+     * object. Lists of a card mostly have one or two elements, which then do
+     * not take a heap block. Only appending is supported, cards do not change.
+     */
+    template<typename T, size_t N>
+    class small_vector {
+        static_assert(std::is_trivially_copyable<T>::value,
+                "small_vector copies its values as bytes.");
+        static_assert(N > 0, "small_vector needs inline room.");
+
+    private:
+        union storage {
+            alignas(T) unsigned char local[N * sizeof (T)];
+            T * heap;
+        } values;
+        uint32_t count;
+        uint32_t capacity; // N while the values are inline.
+
+        static T *
+        allocate(size_t n) {
+            return static_cast<T *> (::operator new(n * sizeof (T)));
+        }
+
+        void
+        release() {
+            if (!is_inline())
+                ::operator delete(values.heap);
+        }
+
+    public:
+        small_vector() : count(0), capacity(N) {
+        }
+
+        small_vector(const small_vector & b) : count(b.count), capacity(N) {
+            if (b.count > N) {
+                values.heap = allocate(b.count);
+                capacity = b.count;
+            }
+            if (count != 0)
+                std::memcpy(data(), b.data(), count * sizeof (T));
+        }
+
+        small_vector(small_vector && b) noexcept : count(b.count), capacity(b.capacity) {
+            std::memcpy(&values, &b.values, sizeof (values));
+            b.count = 0;
+            b.capacity = N;
+        }
+
+        small_vector &
+        operator=(small_vector && b) noexcept {
+            if (this != &b) {
+                release();
+                count = b.count;
+                capacity = b.capacity;
+                std::memcpy(&values, &b.values, sizeof (values));
+                b.count = 0;
+                b.capacity = N;
+            }
+            return *this;
+        }
+
+        small_vector &
+        operator=(const small_vector & b) {
+            if (this != &b)
+                *this = small_vector(b);
+            return *this;
+        }
+
+        ~small_vector() {
+            release();
+        }
+
+        void
+        reserve(size_t n) {
+            if (n <= capacity)
+                return;
+            T * block = allocate(n);
+            if (count != 0)
+                std::memcpy(block, data(), count * sizeof (T));
+            release();
+            values.heap = block;
+            capacity = static_cast<uint32_t> (n);
+        }
+
+        void
+        push_back(const T & value) {
+            if (count == capacity)
+                reserve(2 * capacity);
+            new (data() + count) T(value);
+            ++count;
+        }
+
+        bool
+        is_inline() const {
+            return capacity == N;
+        }
+
+        T *
+        data() {
+            return is_inline() ? reinterpret_cast<T *> (values.local) : values.heap;
+        }
+
+        const T *
+        data() const {
+            return is_inline() ? reinterpret_cast<const T *> (values.local) : values.heap;
+        }
+
+        size_t
+        size() const {
+            return count;
+        }
+
+        bool
+        empty() const {
+            return count == 0;
+        }
+
+        T *
+        begin() {
+            return data();
+        }
+
+        T *
+        end() {
+            return data() + count;
+        }
+
+        const T *
+        begin() const {
+            return data();
+        }
+
+        const T *
+        end() const {
+            return data() + count;
+        }
+
+        const T &
+        operator[](size_t i) const {
+            return data()[i];
+        }
+
+        T &
+        operator[](size_t i) {
+            return data()[i];
+        }
+
+        const T &
+        back() const {
+            return data()[count - 1];
+        }
+
+        T &
+        back() {
+            return data()[count - 1];
+        }
+    } ;
+}
+
+#endif /* SMALL_VECTOR_HPP */
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "src/string_pool.hpp"
+#include "src/memstats.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    string_pool::string_pool(size_t block_size_) : cursor(nullptr), left(0),
+    block_size(block_size_), reserved(0), spare(0) {
+    }
+
+    string_pool::~string_pool() {
+    }
+
+    void
+    string_pool::reserve(size_t bytes_) {
+        if (bytes_ > left)
+            reserved = bytes_;
+    }
+
+    string_view
+    string_pool::intern(string_view s) {
+        if (s.empty())
+            return string_view();
+        auto it = strings.find(s);
+        if (it != strings.end())
+            return *it;
+        if (s.size() > left) {
+            size_t size = max({block_size, reserved, s.size()});
+            blocks.emplace_back(new char[size]);
+            block_sizes.push_back(size);
+            cursor = blocks.back().get();
+            left = size;
+            reserved = 0;
+        }
+        memcpy(cursor, s.data(), s.size());
+        string_view stored(cursor, s.size());
+        cursor += s.size();
+        left -= s.size();
+        strings.insert(stored);
+        return stored;
+    }
+
+    void
+    string_pool::absorb(string_pool && other) {
+        for (size_t i = 0; i < other.blocks.size(); ++i) {
+            blocks.push_back(move(other.blocks[i]));
+            block_sizes.push_back(other.block_sizes[i]);
+        }
+        spare += other.left + other.spare;
+        for (string_view stored : other.strings)
+            strings.insert(stored);
+        other.blocks.clear();
+        other.block_sizes.clear();
+        other.strings.clear();
+        other.cursor = nullptr;
+        other.left = 0;
+        other.spare = 0;
+    }
+
+    size_t
+    string_pool::size() const {
+        return strings.size();
+    }
+
+    size_t
+    string_pool::bytes() const {
+        size_t res = 0;
+        for (size_t size : block_sizes)
+            res += size;
+        return res - left - spare;
+    }
+
+    void
+    string_pool::account_memory(memory_report & report, const string & component) const {
+        for (const unique_ptr<char[] > & block : blocks)
+            report.add_block(component, block.get());
+        report.add_vector(component, blocks);
+        report.add_vector(component, block_sizes);
+        report.add_buckets(component, strings.bucket_count());
+        for (size_t i = 0; i < strings.size(); ++i)
+            report.add_node(component, 2 * sizeof (void *) + sizeof (string_view));
+    }
+}
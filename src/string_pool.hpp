@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   string_pool.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 7:10 PM
+ */
+
+#ifndef STRING_POOL_HPP
+#define STRING_POOL_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    class memory_report;
+
+    /*
+     * Deduplicated storage of strings of cards. Strings are packed one after
+     * another into large blocks, which never move, so the views returned by
+     * intern() stay valid for the life of the pool (also after moving it).
+     */
+    class string_pool {
+    private:
+        std::vector<std::unique_ptr<char[] > > blocks;
+        std::vector<size_t> block_sizes;
+        char * cursor;
+        size_t left;
+        size_t block_size;
+        size_t reserved;
+        size_t spare; // Unused ends of absorbed blocks.
+        std::unordered_set<std::string_view> strings;
+
+    public:
+        explicit
+        string_pool(size_t block_size_ = 1 << 16);
+
+        string_pool(const string_pool &) = delete;
+
+        string_pool &
+        operator=(const string_pool &) = delete;
+
+        string_pool(string_pool &&) = default;
+
+        string_pool &
+        operator=(string_pool &&) = default;
+
+        ~string_pool();
+
+        /*
+         * The next block holds at least bytes, so strings of a known total
+         * size end up in one contiguous block.
+         */
+        void
+        reserve(size_t bytes);
+
+        // The stored copy of s, the same view for equal strings.
+        std::string_view
+        intern(std::string_view s);
+
+        /*
+         * Takes over strings of other, e.g. of a pool filled by another
+         * thread. Its views stay valid, equal strings of both pools are not
+         * merged, but later intern() calls return one of them.
+         */
+        void
+        absorb(string_pool && other);
+
+        // Number of distinct strings.
+        size_t
+        size() const;
+
+        // Bytes of strings themselves, without deduplicated copies.
+        size_t
+        bytes() const;
+
+        void
+        account_memory(memory_report & report, const std::string & component) const;
+    } ;
+}
+
+#endif /* STRING_POOL_HPP */
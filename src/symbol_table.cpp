@@ -0,0 +1,162 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "src/symbol_table.hpp"
+#include "src/memstats.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    symbol_table::symbol_table() : count(0), sealed(false) {
+        for (auto && segment : segments)
+            segment.store(nullptr, memory_order_relaxed);
+    }
+
+    symbol_table::~symbol_table() {
+        for (auto && segment : segments)
+            delete[] segment.load(memory_order_relaxed);
+    }
+
+    /*
+     * Id + first_segment has its highest bit at position s + log2(first_segment)
+     * exactly for ids in segment s.
+     */
+    symbol_table::symbol &
+    symbol_table::slot(symbol_id id) const {
+        size_t biased = size_t(id) + first_segment;
+        size_t segment = static_cast<size_t> (63 - __builtin_clzll(biased)) - 4;
+        return segments[segment].load(memory_order_acquire)[biased - (first_segment << segment)];
+    }
+
+    symbol_id
+    symbol_table::append(string_view key, string_view name) {
+        lock_guard<mutex> lock(appending);
+        size_t id = count.load(memory_order_relaxed);
+        if (id >= none)
+            throw length_error("Symbol table is full.");
+        size_t biased = id + first_segment;
+        size_t segment = static_cast<size_t> (63 - __builtin_clzll(biased)) - 4;
+        if (segment >= segment_count)
+            throw length_error("Symbol table is full.");
+        if (segments[segment].load(memory_order_relaxed) == nullptr)
+            segments[segment].store(new symbol[first_segment << segment], memory_order_release);
+        symbol & s = slot(symbol_id(id));
+        s.key = string(key);
+        s.name = string(name);
+        count.store(id + 1, memory_order_release);
+        return symbol_id(id);
+    }
+
+    void
+    symbol_table::define(string_view key, string_view name) {
+        if (sealed)
+            throw logic_error("Symbol " + string(key) + " defined in a sealed table.");
+        if (known_ids.count(key) != 0)
+            return;
+        symbol_id id = append(key, name);
+        known_ids.emplace(slot(id).key, id);
+    }
+
+    void
+    symbol_table::define(string_view key) {
+        define(key, key);
+    }
+
+    void
+    symbol_table::seal() {
+        sealed = true;
+    }
+
+    symbol_id
+    symbol_table::intern(string_view key) {
+        auto known_it = known_ids.find(key);
+        if (known_it != known_ids.end())
+            return known_it->second;
+        shard & s = shards[hash<string_view>()(key) % shard_count];
+        {
+            shared_lock<shared_mutex> lock(s.lock);
+            auto it = s.ids.find(key);
+            if (it != s.ids.end())
+                return it->second;
+        }
+        unique_lock<shared_mutex> lock(s.lock);
+        auto it = s.ids.find(key);
+        if (it != s.ids.end())
+            return it->second;
+        symbol_id id = append(key, key);
+        s.ids.emplace(slot(id).key, id);
+        return id;
+    }
+
+    symbol_id
+    symbol_table::find(string_view key) const {
+        auto known_it = known_ids.find(key);
+        if (known_it != known_ids.end())
+            return known_it->second;
+        const shard & s = shards[hash<string_view>()(key) % shard_count];
+        shared_lock<shared_mutex> lock(s.lock);
+        auto it = s.ids.find(key);
+        return it != s.ids.end() ? it->second : none;
+    }
+
+    const symbol_table::symbol &
+    symbol_table::operator[](symbol_id id) const {
+        return slot(id);
+    }
+
+    size_t
+    symbol_table::size() const {
+        return count.load(memory_order_acquire);
+    }
+
+    size_t
+    symbol_table::known() const {
+        return known_ids.size();
+    }
+
+    void
+    symbol_table::account_memory(memory_report & report, const string & component) const {
+        size_t size_ = size();
+        // Array new of symbols stores the element count in front of them.
+        for (size_t segment = 0; segment < segment_count; ++segment) {
+            if (segments[segment].load(memory_order_acquire) != nullptr)
+                report.add_node(component, sizeof (size_t) +
+                    (first_segment << segment) * sizeof (symbol));
+        }
+        for (size_t id = 0; id < size_; ++id) {
+            report.add_string(component, slot(symbol_id(id)).key);
+            report.add_string(component, slot(symbol_id(id)).name);
+        }
+        report.add_buckets(component, known_ids.bucket_count());
+        for (size_t i = 0; i < known_ids.size(); ++i)
+            report.add_node(component, 2 * sizeof (void *) + sizeof (pair<string_view, symbol_id>));
+        for (const shard & s : shards) {
+            shared_lock<shared_mutex> lock(s.lock);
+            report.add_buckets(component, s.ids.bucket_count());
+            for (size_t i = 0; i < s.ids.size(); ++i)
+                report.add_node(component, 2 * sizeof (void *) + sizeof (pair<string_view, symbol_id>));
+        }
+    }
+}
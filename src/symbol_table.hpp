@@ -0,0 +1,226 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   symbol_table.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 7:55 PM
+ */
+
+#ifndef SYMBOL_TABLE_HPP
+#define SYMBOL_TABLE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace magicSearchEngine {
+
+    class memory_report;
+
+    using symbol_id = uint32_t;
+
+    /*
+     * Interner of a vocabulary (types, colors, mana symbols...), which assigns
+     * dense ids 0, 1, 2... to keys in order of their arrival. Keys known from
+     * rules are defined up front, then the table is sealed and keys found on
+     * cards which are not known are interned as they come, from any thread.
+     *
+     * Symbols never move, so references to them stay valid. Access by id is
+     * lock-free, so is lookup of a known key; lookup of a discovered key takes
+     * a shared lock of one of shards, interning a new key locks it exclusively.
+     */
+    class symbol_table {
+    public:
+        struct symbol {
+            std::string key;  // As in the JSON.
+            std::string name; // For printing, mostly the same as key.
+        } ;
+
+        static constexpr symbol_id none = UINT32_MAX;
+
+    private:
+        // Segment s holds first_segment << s symbols.
+        static const size_t first_segment = 16;
+        static const size_t segment_count = 24;
+        static const size_t shard_count = 16;
+
+        struct shard {
+            mutable std::shared_mutex lock;
+            std::unordered_map<std::string_view, symbol_id> ids;
+        } ;
+
+        std::array<std::atomic<symbol *>, segment_count> segments;
+        std::atomic<size_t> count;
+        std::mutex appending;
+        // Read only once sealed.
+        std::unordered_map<std::string_view, symbol_id> known_ids;
+        bool sealed;
+        std::array<shard, shard_count> shards;
+
+        symbol &
+        slot(symbol_id id) const;
+
+        symbol_id
+        append(std::string_view key, std::string_view name);
+
+    public:
+        symbol_table();
+
+        symbol_table(const symbol_table &) = delete;
+
+        symbol_table &
+        operator=(const symbol_table &) = delete;
+
+        ~symbol_table();
+
+        // Known symbols, single threaded and only before seal().
+        void
+        define(std::string_view key, std::string_view name);
+
+        void
+        define(std::string_view key);
+
+        void
+        seal();
+
+        // Id of key, a new one if the key was not seen yet. Thread safe.
+        symbol_id
+        intern(std::string_view key);
+
+        // Id of key or none.
+        symbol_id
+        find(std::string_view key) const;
+
+        const symbol &
+        operator[](symbol_id id) const;
+
+        size_t
+        size() const;
+
+        // Number of symbols defined before seal(), the rest was discovered.
+        size_t
+        known() const;
+
+        void
+        account_memory(memory_report & report, const std::string & component) const;
+    } ;
+
+    /*
+     * View of ids stored elsewhere (in a card) as names of their symbols,
+     * iterating gives pointers to names which are unique for a symbol.
+     */
+    class symbol_list {
+    private:
+        const symbol_id * first;
+        const symbol_id * last;
+        const symbol_table * table;
+
+    public:
+        class iterator {
+        private:
+            const symbol_id * pos;
+            const symbol_table * table;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = const std::string *;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type *;
+            using reference = value_type;
+
+            iterator(const symbol_id * pos_, const symbol_table * table_) :
+            pos(pos_), table(table_) {
+            }
+
+            value_type
+            operator*() const {
+                return &((*table)[*pos].name);
+            }
+
+            iterator &
+            operator++() {
+                ++pos;
+                return *this;
+            }
+
+            iterator
+            operator++(int) {
+                iterator res = *this;
+                ++pos;
+                return res;
+            }
+
+            bool
+            operator==(const iterator & b) const {
+                return pos == b.pos;
+            }
+
+            bool
+            operator!=(const iterator & b) const {
+                return pos != b.pos;
+            }
+        } ;
+
+        symbol_list(const symbol_id * first_, const symbol_id * last_,
+                const symbol_table & table_) : first(first_), last(last_), table(&table_) {
+        }
+
+        iterator
+        begin() const {
+            return iterator(first, table);
+        }
+
+        iterator
+        end() const {
+            return iterator(last, table);
+        }
+
+        size_t
+        size() const {
+            return static_cast<size_t> (last - first);
+        }
+
+        bool
+        empty() const {
+            return first == last;
+        }
+
+        // The ids themselves, for comparing lists without their names.
+        const symbol_id *
+        ids() const {
+            return first;
+        }
+    } ;
+}
+
+#endif /* SYMBOL_TABLE_HPP */
@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tracing.hpp"
+#include "src/json.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    trace_log::trace_log() : origin(chrono::steady_clock::now()), enabled(false) {
+    }
+
+    trace_log &
+    trace_log::instance() {
+        static trace_log log;
+        return log;
+    }
+
+    void
+    trace_log::enable() {
+        enabled = true;
+    }
+
+    bool
+    trace_log::is_enabled() const {
+        return enabled;
+    }
+
+    /*
+     * Buffers outlive their threads, the detached loading thread may still
+     * be running when the trace is written.
+     */
+    trace_log::thread_buffer &
+    trace_log::local_buffer() {
+        thread_local thread_buffer * buffer = nullptr;
+        if (!buffer) {
+            lock_guard<mutex> lock(mtx);
+            buffers.emplace_back();
+            buffer = &buffers.back();
+            buffer->tid = buffers.size();
+        }
+        return *buffer;
+    }
+
+    void
+    trace_log::name_thread(const string & name) {
+        thread_buffer & buffer = local_buffer();
+        lock_guard<mutex> lock(buffer.mtx);
+        buffer.name = name;
+    }
+
+    void
+    trace_log::add(const char * name,
+            chrono::steady_clock::time_point start,
+            chrono::steady_clock::time_point end) {
+        thread_buffer & buffer = local_buffer();
+        lock_guard<mutex> lock(buffer.mtx);
+        buffer.spans.push_back({
+            name,
+            chrono::duration_cast<chrono::microseconds>(start - origin).count(),
+            chrono::duration_cast<chrono::microseconds>(end - start).count()
+        });
+    }
+
+    void
+    trace_log::write_json(ostream & os) const {
+        nlohmann::json events = nlohmann::json::array();
+        lock_guard<mutex> lock(mtx);
+        for (const thread_buffer & buffer : buffers) {
+            lock_guard<mutex> buffer_lock(buffer.mtx);
+            if (!buffer.name.empty()) {
+                events.push_back({
+                    {"name", "thread_name"},
+                    {"ph", "M"},
+                    {"pid", 1},
+                    {"tid", buffer.tid},
+                    {"args", {{"name", buffer.name}}}
+                });
+            }
+            for (const span & s : buffer.spans) {
+                events.push_back({
+                    {"name", s.name},
+                    {"ph", "X"},
+                    {"pid", 1},
+                    {"tid", buffer.tid},
+                    {"ts", s.start_us},
+                    {"dur", s.duration_us}
+                });
+            }
+        }
+        os << nlohmann::json({{"traceEvents", events}, {"displayTimeUnit", "ms"}}) << endl;
+    }
+
+    trace_span::trace_span(const char * name_) : name(name_),
+    running(trace_log::instance().is_enabled()) {
+        if (running)
+            start = chrono::steady_clock::now();
+    }
+
+    trace_span::~trace_span() {
+        if (running)
+            trace_log::instance().add(name, start, chrono::steady_clock::now());
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   tracing.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 3:50 PM
+ */
+
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace magicSearchEngine {
+
+    /*
+     * Completed spans of all threads, written as Chrome trace-event JSON
+     * (chrome://tracing, Perfetto). Every thread appends to its own buffer,
+     * so spans of different threads do not contend.
+     */
+    class trace_log {
+    private:
+        struct span {
+            const char * name;
+            long long start_us;
+            long long duration_us;
+        } ;
+
+        struct thread_buffer {
+            mutable std::mutex mtx;
+            size_t tid;
+            std::string name;
+            std::vector<span> spans;
+        } ;
+
+        mutable std::mutex mtx;
+        std::list<thread_buffer> buffers;
+        std::chrono::steady_clock::time_point origin;
+        bool enabled;
+
+        trace_log();
+
+        thread_buffer &
+        local_buffer();
+
+    public:
+        static trace_log &
+        instance();
+
+        void
+        enable();
+
+        bool
+        is_enabled() const;
+
+        // Name of the calling thread shown in the timeline.
+        void
+        name_thread(const std::string & name);
+
+        void
+        add(const char * name,
+                std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+        void
+        write_json(std::ostream & os) const;
+    } ;
+
+    class trace_span {
+    private:
+        const char * name;
+        bool running;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit
+        trace_span(const char * name_);
+
+        trace_span(const trace_span &) = delete;
+
+        trace_span &
+        operator=(const trace_span &) = delete;
+
+        ~trace_span();
+    } ;
+}
+
+/*
+ * Spans are compiled in only with MSE_TRACING (./configure --enable-tracing),
+ * otherwise the macros expand to nothing.
+ */
+#define MSE_TRACE_CONCAT_(a, b) a ## b
+#define MSE_TRACE_CONCAT(a, b) MSE_TRACE_CONCAT_(a, b)
+#ifdef MSE_TRACING
+#define TRACE_SPAN(name) \
+    ::magicSearchEngine::trace_span MSE_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_THREAD(name) ::magicSearchEngine::trace_log::instance().name_thread(name)
+#else
+#define TRACE_SPAN(name) static_cast<void> (0)
+#define TRACE_THREAD(name) static_cast<void> (0)
+#endif
+
+#endif /* TRACING_HPP */
@@ -48,12 +48,20 @@ namespace magicSearchEngine {
             return make_pair(cmd::none, opts);
         if (opts[0] == "h" || opts[0] == "help")
             return make_pair(cmd::help, opts);
+        if (opts[0] == "stats")
+            return make_pair(cmd::stats, opts);
+        if (opts[0] == "memstats")
+            return make_pair(cmd::memstats, opts);
         if (opts.size() == 1)
             return make_pair(cmd::parse_error, opts);
         if (opts[0] == "find")
             return make_pair(cmd::find, opts);
         if (opts[0] == "similar")
             return make_pair(cmd::similar, opts);
+        if (opts[0] == "put")
+            return make_pair(cmd::put, opts);
+        if (opts[0] == "delete")
+            return make_pair(cmd::remove, opts);
 
         return make_pair(cmd::none, opts);
     }
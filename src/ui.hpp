@@ -47,6 +47,10 @@ namespace magicSearchEngine {
         parse_error,
         find,
         similar,
+        put,
+        remove,
+        stats,
+        memstats,
         help
     } ;
 
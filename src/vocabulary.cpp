@@ -0,0 +1,527 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "src/vocabulary.hpp"
+
+namespace magicSearchEngine {
+
+    vocabulary &
+    vocabulary::instance() {
+        static vocabulary vocab;
+        return vocab;
+    }
+
+    /*
+     * This defines symbol tables which serve as a databases of types,
+     * where all card members have ids of symbols in these tables.
+     * Motivation: space efficiency, fast lookup, simple outputting
+     * of type's string representation.
+     * 
+     * All know -types, colors etc. you can find in comprehensive rules at:
+     * http://magic.wizards.com/en/game-info/gameplay/rules-and-formats/rules
+     */
+    vocabulary::vocabulary() {
+        // <editor-fold defaultstate="collapsed" desc="types instantiation">
+        types.define("General");
+        types.define("Artifact");
+        types.define("Creature");
+        types.define("Eaturecray"); // not in rules, special card
+        types.define("Enchantment");
+        types.define("Enchant");
+        types.define("Instant");
+        types.define("Land");
+        types.define("Planeswalker");
+        types.define("Sorcery");
+        types.define("Tribal");
+        types.define("Plane");
+        types.define("Player");
+        types.define("Phenomenon");
+        types.define("Vanguard");
+        types.define("Scheme");
+        types.define("Conspiracy");
+        types.define("Scariest"); // Because of Big Furry Monster:
+        types.define("You'll");     // The Scariest Creature You'll Ever See
+        types.define("See");
+        types.define("Ever");
+        // </editor-fold>
+        // <editor-fold defaultstate="collapsed" desc="subtypes instantiation">
+        // eaturecray
+        subtypes.define("Igpay"); // not in rules, special card
+        // artifact
+        subtypes.define("Clue");
+        subtypes.define("Contraption");
+        subtypes.define("Equipment");
+        subtypes.define("Fortification");
+        subtypes.define("Vehicle");
+        // enchantements
+        subtypes.define("Aura");
+        subtypes.define("Curse");
+        subtypes.define("Shrine");
+        // land
+        subtypes.define("Desert");
+        subtypes.define("Forest");
+        subtypes.define("Gate");
+        subtypes.define("Island");
+        subtypes.define("Lair");
+        subtypes.define("Locus");
+        subtypes.define("Mine");
+        subtypes.define("Mountain");
+        subtypes.define("Plains");
+        subtypes.define("Power-Plant");
+        subtypes.define("Swamp");
+        subtypes.define("Tower");
+        subtypes.define("Urza’s");
+        // planeswolkers
+        subtypes.define("Ajani");
+        subtypes.define("Arlinn");
+        subtypes.define("Ashiok");
+        subtypes.define("Bolas");
+        subtypes.define("Chandra");
+        subtypes.define("Dack");
+        subtypes.define("Daretti");
+        subtypes.define("Domri");
+        subtypes.define("Dovin");
+        subtypes.define("Elspeth");
+        subtypes.define("Freyalise");
+        subtypes.define("Garruk");
+        subtypes.define("Gideon");
+        subtypes.define("Jace");
+        subtypes.define("Karn");
+        subtypes.define("Kaya");
+        subtypes.define("Kiora");
+        subtypes.define("Koth");
+        subtypes.define("Liliana");
+        subtypes.define("Nahiri");
+        subtypes.define("Narset");
+        subtypes.define("Nissa");
+        subtypes.define("Nixilis");
+        subtypes.define("Ral");
+        subtypes.define("Saheeli");
+        subtypes.define("Sarkhan");
+        subtypes.define("Sorin");
+        subtypes.define("Tamiyo");
+        subtypes.define("Teferi");
+        subtypes.define("Tezzeret");
+        subtypes.define("Tibalt");
+        subtypes.define("Ugin");
+        subtypes.define("Venser");
+        subtypes.define("Vraska");
+        subtypes.define("Xenagos");
+        // instants
+        subtypes.define("Arcane");
+        subtypes.define("Trap");
+        // creatures
+        subtypes.define("Advisor");
+        subtypes.define("Aetherborn");
+        subtypes.define("Ally");
+        subtypes.define("Angel");
+        subtypes.define("Antelope");
+        subtypes.define("Ape");
+        subtypes.define("Archer");
+        subtypes.define("Archon");
+        subtypes.define("Artificer");
+        subtypes.define("Assassin");
+        subtypes.define("Assembly-Worker", "Assembly worker");
+        subtypes.define("Atog");
+        subtypes.define("Aurochs");
+        subtypes.define("Avatar");
+        subtypes.define("Badger");
+        subtypes.define("Barbarian");
+        subtypes.define("Basilisk");
+        subtypes.define("Bat");
+        subtypes.define("Bear");
+        subtypes.define("Beast");
+        subtypes.define("Beeble");
+        subtypes.define("Berserker");
+        subtypes.define("Bird");
+        subtypes.define("Blinkmoth");
+        subtypes.define("Boar");
+        subtypes.define("Bringer");
+        subtypes.define("Brushwagg");
+        subtypes.define("Bureaucrat");
+        subtypes.define("Camarid");
+        subtypes.define("Camel");
+        subtypes.define("Caribou");
+        subtypes.define("Carrier");
+        subtypes.define("Cat");
+        subtypes.define("Centaur");
+        subtypes.define("Cephalid");
+        subtypes.define("Chicken");
+        subtypes.define("Child");
+        subtypes.define("Chimera");
+        subtypes.define("Citizen");
+        subtypes.define("Clamfolk");
+        subtypes.define("Cleric");
+        subtypes.define("Cockatrice");
+        subtypes.define("Construct");
+        subtypes.define("Coward");
+        subtypes.define("Cow");
+        subtypes.define("Crab");
+        subtypes.define("Crocodile");
+        subtypes.define("Cyclops");
+        subtypes.define("Dauthi");
+        subtypes.define("Dinosaur");
+        subtypes.define("Demon");
+        subtypes.define("Deserter");
+        subtypes.define("Designer");
+        subtypes.define("Devil");
+        subtypes.define("Djinn");
+        subtypes.define("Donkey");
+        subtypes.define("Dragon");
+        subtypes.define("Drake");
+        subtypes.define("Dreadnought");
+        subtypes.define("Drone");
+        subtypes.define("Druid");
+        subtypes.define("Dryad");
+        subtypes.define("Dwarf");
+        subtypes.define("Egg");
+        subtypes.define("Efreet");
+        subtypes.define("Elder");
+        subtypes.define("Eldrazi");
+        subtypes.define("Elemental");
+        subtypes.define("Elephant");
+        subtypes.define("Elf");
+        subtypes.define("Elk");
+        subtypes.define("Elves");
+        subtypes.define("Eye");
+        subtypes.define("Faerie");
+        subtypes.define("Ferret");
+        subtypes.define("Fish");
+        subtypes.define("Flagbearer");
+        subtypes.define("Fox");
+        subtypes.define("Frog");
+        subtypes.define("Fungus");
+        subtypes.define("Gamer");
+        subtypes.define("Gargoyle");
+        subtypes.define("Germ");
+        subtypes.define("Giant");
+        subtypes.define("Gnome");
+        subtypes.define("Goat");
+        subtypes.define("Goblin");
+        subtypes.define("Goblins");
+        subtypes.define("God");
+        subtypes.define("Golem");
+        subtypes.define("Gorgon");
+        subtypes.define("Graveborn");
+        subtypes.define("Gremlin");
+        subtypes.define("Griffin");
+        subtypes.define("Gus");
+        subtypes.define("Hag");
+        subtypes.define("Harpy");
+        subtypes.define("Hellion");
+        subtypes.define("Hero");
+        subtypes.define("Hippo");
+        subtypes.define("Hippogriff");
+        subtypes.define("Homarid");
+        subtypes.define("Homunculus");
+        subtypes.define("Horror");
+        subtypes.define("Horse");
+        subtypes.define("Hound");
+        subtypes.define("Human");
+        subtypes.define("Hydra");
+        subtypes.define("Hyena");
+        subtypes.define("Illusion");
+        subtypes.define("Imp");
+        subtypes.define("Incarnation");
+        subtypes.define("Insect");
+        subtypes.define("Jellyfish");
+        subtypes.define("Juggernaut");
+        subtypes.define("Kavu");
+        subtypes.define("Kirin");
+        subtypes.define("Kithkin");
+        subtypes.define("Knight");
+        subtypes.define("Kobold");
+        subtypes.define("Kor");
+        subtypes.define("Kraken");
+        subtypes.define("Lamia");
+        subtypes.define("Lammasu");
+        subtypes.define("Leech");
+        subtypes.define("Leviathan");
+        subtypes.define("Lhurgoyf");
+        subtypes.define("Licid");
+        subtypes.define("Lizard");
+        subtypes.define("Lord");
+        subtypes.define("Manticore");
+        subtypes.define("Masticore");
+        subtypes.define("Mercenary");
+        subtypes.define("Merfolk");
+        subtypes.define("Metathran");
+        subtypes.define("Minion");
+        subtypes.define("Minotaur");
+        subtypes.define("Mime");
+        subtypes.define("Mole");
+        subtypes.define("Monger");
+        subtypes.define("Mongoose");
+        subtypes.define("Monk");
+        subtypes.define("Monkey");
+        subtypes.define("Moonfolk");
+        subtypes.define("Mummy");
+        subtypes.define("Mutant");
+        subtypes.define("Myr");
+        subtypes.define("Mystic");
+        subtypes.define("Naga");
+        subtypes.define("Nautilus");
+        subtypes.define("Nephilim");
+        subtypes.define("Nightmare");
+        subtypes.define("Nightstalker");
+        subtypes.define("Ninja");
+        subtypes.define("Noggle");
+        subtypes.define("Nomad");
+        subtypes.define("Nymph");
+        subtypes.define("Octopus");
+        subtypes.define("Ogre");
+        subtypes.define("Ooze");
+        subtypes.define("Orb");
+        subtypes.define("Orc");
+        subtypes.define("Orgg");
+        subtypes.define("Ouphe");
+        subtypes.define("Ox");
+        subtypes.define("Oyster");
+        subtypes.define("Paratrooper");
+        subtypes.define("Pegasus");
+        subtypes.define("Pentavite");
+        subtypes.define("Pest");
+        subtypes.define("Phelddagrif");
+        subtypes.define("Phoenix");
+        subtypes.define("Pilot");
+        subtypes.define("Pincher");
+        subtypes.define("Pirate");
+        subtypes.define("Plant");
+        subtypes.define("Praetor");
+        subtypes.define("Prism");
+        subtypes.define("Processor");
+        subtypes.define("Rabbit");
+        subtypes.define("Rat");
+        subtypes.define("Rebel");
+        subtypes.define("Reflection");
+        subtypes.define("Rhino");
+        subtypes.define("Rigger");
+        subtypes.define("Rogue");
+        subtypes.define("Sable");
+        subtypes.define("Salamander");
+        subtypes.define("Samurai");
+        subtypes.define("Sand");
+        subtypes.define("Saproling");
+        subtypes.define("Satyr");
+        subtypes.define("Scarecrow");
+        subtypes.define("Scion");
+        subtypes.define("Scorpion");
+        subtypes.define("Scout");
+        subtypes.define("Serf");
+        subtypes.define("Serpent");
+        subtypes.define("Servo");
+        subtypes.define("Shade");
+        subtypes.define("Shaman");
+        subtypes.define("Shapeshifter");
+        subtypes.define("Sheep");
+        subtypes.define("Ship");
+        subtypes.define("Siren");
+        subtypes.define("Skeleton");
+        subtypes.define("Slith");
+        subtypes.define("Sliver");
+        subtypes.define("Slug");
+        subtypes.define("Snake");
+        subtypes.define("Soldier");
+        subtypes.define("Soltari");
+        subtypes.define("Spawn");
+        subtypes.define("Specter");
+        subtypes.define("Spellshaper");
+        subtypes.define("Sphinx");
+        subtypes.define("Spider");
+        subtypes.define("Spike");
+        subtypes.define("Spirit");
+        subtypes.define("Splinter");
+        subtypes.define("Sponge");
+        subtypes.define("Squid");
+        subtypes.define("Squirrel");
+        subtypes.define("Starfish");
+        subtypes.define("Surrakar");
+        subtypes.define("Survivor");
+        subtypes.define("Tetravite");
+        subtypes.define("Thalakos");
+        subtypes.define("Thopter");
+        subtypes.define("Thrull");
+        subtypes.define("Townsfolk"); // not in rules, special card
+        subtypes.define("Treefolk");
+        subtypes.define("Triskelavite");
+        subtypes.define("Troll");
+        subtypes.define("Turtle");
+        subtypes.define("Unicorn");
+        subtypes.define("Vampire");
+        subtypes.define("Vedalken");
+        subtypes.define("Viashino");
+        subtypes.define("Volver");
+        subtypes.define("Waiter");
+        subtypes.define("Wall");
+        subtypes.define("Warrior");
+        subtypes.define("Weird");
+        subtypes.define("Werewolf");
+        subtypes.define("Whale");
+        subtypes.define("Wizard");
+        subtypes.define("Wolf");
+        subtypes.define("Wolverine");
+        subtypes.define("Wombat");
+        subtypes.define("Worm");
+        subtypes.define("Wraith");
+        subtypes.define("Wurm");
+        subtypes.define("Yeti");
+        subtypes.define("Zombie");
+        subtypes.define("Zubera");
+        subtypes.define("Lady");
+        subtypes.define("of");
+        subtypes.define("Proper");
+        subtypes.define("Etiquette");
+        // planes
+        subtypes.define("Alara");
+        subtypes.define("Arkhos");
+        subtypes.define("Azgol");
+        subtypes.define("Belenon");
+        subtypes.define("Bolas’s Meditation Realm");
+        subtypes.define("Dominaria");
+        subtypes.define("Equilor");
+        subtypes.define("Ergamon");
+        subtypes.define("Fabacin");
+        subtypes.define("Innistrad");
+        subtypes.define("Iquatana");
+        subtypes.define("Ir");
+        subtypes.define("Kaldheim");
+        subtypes.define("Kamigawa");
+        subtypes.define("Karsus");
+        subtypes.define("Kephalai");
+        subtypes.define("Kinshala");
+        subtypes.define("Kolbahan");
+        subtypes.define("Kyneth");
+        subtypes.define("Lorwyn");
+        subtypes.define("Luvion");
+        subtypes.define("Mercadia");
+        subtypes.define("Mirrodin");
+        subtypes.define("Moag");
+        subtypes.define("Mongseng");
+        subtypes.define("Muraganda");
+        subtypes.define("New Phyrexia");
+        subtypes.define("Phyrexia");
+        subtypes.define("Pyrulea");
+        subtypes.define("Rabiah");
+        subtypes.define("Rath");
+        subtypes.define("Ravnica");
+        subtypes.define("Regatha");
+        subtypes.define("Segovia");
+        subtypes.define("Serra’s Realm");
+        subtypes.define("Shadowmoor");
+        subtypes.define("Shandalar");
+        subtypes.define("Ulgrotha");
+        subtypes.define("Valla");
+        subtypes.define("Vryn");
+        subtypes.define("Wildfire");
+        subtypes.define("Xerex");
+        subtypes.define("Zendikar");
+        subtypes.define("Legend", "Legend (obsolete)");
+        // </editor-fold>
+        // <editor-fold defaultstate="collapsed" desc="supertypes instantiation">
+        supertypes.define("Basic");
+        supertypes.define("Legendary");
+        supertypes.define("Ongoing");
+        supertypes.define("Snow");
+        supertypes.define("World");
+        // </editor-fold>
+        // <editor-fold defaultstate="collapsed" desc="layout instantiation">
+        layout.define("");
+        layout.define("normal");
+        layout.define("split");
+        layout.define("flip");
+        layout.define("double-faced");
+        layout.define("token");
+        layout.define("plane");
+        layout.define("scheme");
+        layout.define("phenomenon");
+        layout.define("leveler");
+        layout.define("vanguard");
+        layout.define("meld");
+        // </editor-fold>
+        // <editor-fold defaultstate="collapsed" desc="colors instantiation">
+        colors.define("Blue", "blue");
+        colors.define("White", "white");
+        colors.define("Green", "green");
+        colors.define("Red", "red");
+        colors.define("Black", "black");
+        // </editor-fold>
+        // <editor-fold defaultstate="collapsed" desc="mana instantiation">
+        mana.define("U", "blue");
+        mana.define("W", "white");
+        mana.define("G", "green");
+        mana.define("R", "red");
+        mana.define("B", "black");
+        mana.define("C", "colorless");
+        mana.define("0");
+        mana.define("1", "generic");
+        mana.define("2", "2 generic");
+        mana.define("3", "3 generic");
+        mana.define("4", "4 generic");
+        mana.define("5", "5 generic");
+        mana.define("6", "6 generic");
+        mana.define("7", "7 generic");
+        mana.define("8", "8 generic");
+        mana.define("9", "9 generic");
+        mana.define("10", "10 generic");
+        mana.define("11", "11 generic");
+        mana.define("12", "12 generic");
+        mana.define("13", "13 generic");
+        mana.define("14", "14 generic");
+        mana.define("15", "15 generic");
+        mana.define("16", "16 generic");
+        mana.define("17", "17 generic");
+        mana.define("18", "18 generic");
+        mana.define("19", "19 generic");
+        mana.define("20", "20 generic");
+        mana.define("1000000", "1000000 generic");
+        mana.define("X", "X generic");
+        mana.define("W/U", "white/blue");
+        mana.define("W/B", "white/black");
+        mana.define("U/B", "blue/black");
+        mana.define("U/R", "blue/red");
+        mana.define("B/R", "black/red");
+        mana.define("B/G", "black/green");
+        mana.define("R/G", "red/green");
+        mana.define("R/W", "red/white");
+        mana.define("G/W", "green/white");
+        mana.define("G/U", "green/blue");
+        mana.define("2/W", "generic/white");
+        mana.define("2/U", "generic/blue");
+        mana.define("2/B", "generic/black");
+        mana.define("2/R", "generic/red");
+        mana.define("2/G", "generic/green");
+        mana.define("W/P", "white/-2life");
+        mana.define("U/P", "blue/-2life");
+        mana.define("B/P", "black/-2life");
+        mana.define("R/P", "red/-2life");
+        mana.define("G/P", "green/-2life");
+        mana.define("S", "snow generic");
+        mana.define("hw", "half white");
+        mana.define("Y");
+        mana.define("Z");
+        // </editor-fold>
+        for (symbol_table * table : {&types, &subtypes, &supertypes, &layout, &colors, &mana})
+            table->seal();
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   vocabulary.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 8:40 PM
+ */
+
+#ifndef VOCABULARY_HPP
+#define VOCABULARY_HPP
+
+#include "src/symbol_table.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * All vocabularies of cards. There is one for the process, so that a card
+     * can keep 32-bit ids of its types, colors etc. and still get their names
+     * without knowing its database.
+     */
+    class vocabulary {
+    public:
+        symbol_table types;
+        symbol_table subtypes;
+        symbol_table supertypes;
+        symbol_table layout;
+        symbol_table colors;
+        symbol_table mana;
+
+        vocabulary(const vocabulary &) = delete;
+
+        vocabulary &
+        operator=(const vocabulary &) = delete;
+
+        // Created at the first call, with values from rules defined.
+        static vocabulary &
+        instance();
+
+    private:
+        vocabulary();
+    } ;
+}
+
+#endif /* VOCABULARY_HPP */
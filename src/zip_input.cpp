@@ -0,0 +1,202 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+#include "src/zip_input.hpp"
+
+using namespace std;
+
+namespace magicSearchEngine {
+
+    // Fields of zip headers are little endian.
+    static uint32_t
+    read_le(const char * at, size_t bytes) {
+        uint32_t res = 0;
+        for (size_t i = bytes; i-- > 0;)
+            res = (res << 8) | static_cast<unsigned char> (at[i]);
+        return res;
+    }
+
+    zip_input::zip_input(const string & path) : archive(path), method(0), crc(0),
+    size(0), ready(0), stopping(false) {
+        string_view zip = archive.view();
+        auto && corrupt = [&path](const char * what) {
+            return runtime_error("Archive " + path + " cannot be read: " + what + ".");
+        };
+        // The end of central directory record, followed by a comment.
+        const size_t end_size = 22;
+        if (zip.size() < end_size)
+            throw corrupt("no end of central directory");
+        size_t end = zip.size() - end_size;
+        size_t lowest = zip.size() > end_size + 0xFFFF ? zip.size() - end_size - 0xFFFF : 0;
+        while (read_le(zip.data() + end, 4) != 0x06054b50) {
+            if (end == lowest)
+                throw corrupt("no end of central directory");
+            --end;
+        }
+        size_t entries = read_le(zip.data() + end + 10, 2);
+        size_t entry = read_le(zip.data() + end + 16, 4);
+        for (; entries > 0; --entries) {
+            if (entry + 46 > zip.size() || read_le(zip.data() + entry, 4) != 0x02014b50)
+                throw corrupt("invalid central directory");
+            const char * header = zip.data() + entry;
+            size_t name_size = read_le(header + 28, 2);
+            if (entry + 46 + name_size > zip.size())
+                throw corrupt("invalid central directory");
+            string_view name(header + 46, name_size);
+            entry += 46 + name_size + read_le(header + 30, 2) + read_le(header + 32, 2);
+            if (name.size() < 5 || name.substr(name.size() - 5) != ".json")
+                continue;
+
+            if (read_le(header + 8, 2) & 1)
+                throw corrupt("encrypted member");
+            method = static_cast<int> (read_le(header + 10, 2));
+            if (method != 0 && method != Z_DEFLATED)
+                throw corrupt("unsupported compression method");
+            crc = read_le(header + 16, 4);
+            size_t compressed_size = read_le(header + 20, 4);
+            size = read_le(header + 24, 4);
+            size_t local = read_le(header + 42, 4);
+            if (compressed_size == 0xFFFFFFFF || size == 0xFFFFFFFF || local == 0xFFFFFFFF)
+                throw corrupt("ZIP64 members are not supported");
+            if (local + 30 > zip.size() || read_le(zip.data() + local, 4) != 0x04034b50)
+                throw corrupt("invalid local header");
+            size_t data = local + 30 + read_le(zip.data() + local + 26, 2) +
+                    read_le(zip.data() + local + 28, 2);
+            if (data + compressed_size > zip.size())
+                throw corrupt("truncated member");
+            compressed = zip.substr(data, compressed_size);
+            text.reset(new char[size]);
+            inflating = thread(&zip_input::inflate_all, this);
+            return;
+        }
+        throw corrupt("no .json member");
+    }
+
+    zip_input::~zip_input() {
+        stopping = true;
+        if (inflating.joinable())
+            inflating.join();
+    }
+
+    void
+    zip_input::publish(size_t bytes) {
+        {
+            lock_guard<mutex> lock(guard);
+            ready = bytes;
+        }
+        progress.notify_all();
+    }
+
+    /*
+     * Runs on the inflating thread and publishes the text by chunks, errors
+     * are passed to wait_beyond.
+     */
+    void
+    zip_input::inflate_all() {
+        const size_t chunk = 1 << 20;
+        try {
+            uLong sum = crc32(0, nullptr, 0);
+            size_t done = 0;
+            if (method == 0) {
+                if (compressed.size() != size)
+                    throw runtime_error("Archive member is corrupt: sizes of a stored member differ.");
+                while (done < size && !stopping) {
+                    size_t part = min(chunk, size - done);
+                    memcpy(text.get() + done, compressed.data() + done, part);
+                    sum = crc32(sum, reinterpret_cast<const Bytef *> (text.get() + done),
+                            static_cast<uInt> (part));
+                    done += part;
+                    if (done < size)
+                        publish(done);
+                }
+            }
+            else {
+                z_stream stream;
+                memset(&stream, 0, sizeof (stream));
+                // Raw deflate data, zip headers are read by the constructor.
+                if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                    throw runtime_error("Inflating could not be started.");
+                stream.next_in = reinterpret_cast<Bytef *> (const_cast<char *> (compressed.data()));
+                stream.avail_in = static_cast<uInt> (compressed.size());
+                int status = Z_OK;
+                while (status != Z_STREAM_END && done < size && !stopping) {
+                    size_t part = min(chunk, size - done);
+                    stream.next_out = reinterpret_cast<Bytef *> (text.get() + done);
+                    stream.avail_out = static_cast<uInt> (part);
+                    status = inflate(&stream, Z_NO_FLUSH);
+                    if (status != Z_OK && status != Z_STREAM_END) {
+                        inflateEnd(&stream);
+                        throw runtime_error("Archive member is corrupt: inflating failed.");
+                    }
+                    size_t written = part - stream.avail_out;
+                    sum = crc32(sum, reinterpret_cast<const Bytef *> (text.get() + done),
+                            static_cast<uInt> (written));
+                    done += written;
+                    // The last chunk is published after the checksum is checked.
+                    if (done < size)
+                        publish(done);
+                }
+                inflateEnd(&stream);
+            }
+            if (stopping)
+                return;
+            if (done != size)
+                throw runtime_error("Archive member is corrupt: it is shorter than its size.");
+            if (sum != crc)
+                throw runtime_error("Archive member is corrupt: checksum does not match.");
+            publish(size);
+        }
+        catch (...) {
+            {
+                lock_guard<mutex> lock(guard);
+                error = current_exception();
+            }
+            progress.notify_all();
+        }
+    }
+
+    string_view
+    zip_input::view() const {
+        return string_view(text.get(), size);
+    }
+
+    size_t
+    zip_input::wait_beyond(size_t from) {
+        unique_lock<mutex> lock(guard);
+        progress.wait(lock, [this, from]() {
+            return ready > from || ready == size || error; });
+        if (error)
+            rethrow_exception(error);
+        return ready;
+    }
+
+    bool
+    zip_input::is_zip(const string & path) {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".zip") == 0;
+    }
+}
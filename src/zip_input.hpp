@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2017 Thomas Kremel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* 
+ * File:   zip_input.hpp
+ * Author: Thomas Kremel
+ *
+ * Created on October 19, 2026, 10:40 PM
+ */
+
+#ifndef ZIP_INPUT_HPP
+#define ZIP_INPUT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "src/mapped_file.hpp"
+
+namespace magicSearchEngine {
+
+    /*
+     * The first .json member of a zip archive (e.g. AllCards.json.zip),
+     * inflated on a second thread into a buffer of its size, so that it can
+     * be read while the rest is still decompressed. Stored and deflated
+     * members are supported, ZIP64 and encrypted ones are not.
+     */
+    class zip_input {
+    private:
+        mapped_file archive;
+        std::string_view compressed;
+        int method;
+        uint32_t crc;
+        size_t size;
+        std::unique_ptr<char[]> text;
+
+        std::mutex guard;
+        std::condition_variable progress;
+        size_t ready; // Bytes of text inflated so far, under guard.
+        std::exception_ptr error;
+        std::atomic<bool> stopping;
+        std::thread inflating;
+
+        void
+        inflate_all();
+
+        void
+        publish(size_t bytes);
+
+    public:
+        // Throws runtime_error if the archive has no readable .json member.
+        explicit
+        zip_input(const std::string & path);
+
+        zip_input(const zip_input &) = delete;
+
+        zip_input &
+        operator=(const zip_input &) = delete;
+
+        ~zip_input();
+
+        // The whole inflated member, its bytes from wait_beyond on are not
+        // written yet.
+        std::string_view
+        view() const;
+
+        /*
+         * Blocks until more than from bytes are inflated, or all of them, and
+         * returns how many are. Throws runtime_error if the member is corrupt.
+         */
+        size_t
+        wait_beyond(size_t from);
+
+        // Whether path names a zip archive.
+        static bool
+        is_zip(const std::string & path);
+    } ;
+}
+
+#endif /* ZIP_INPUT_HPP */